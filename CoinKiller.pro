@@ -49,9 +49,15 @@ isEmpty(CK_VERSION) {
 DEFINES += CK_VERSION=\\\"$$CK_VERSION\\\"
 
 SOURCES += \
+    alphakernels.cpp \
+    atlaskernels.cpp \
+    filesystem/asyncarchivewriter.cpp \
     filesystem/externalfile.cpp \
     filesystem/externalfilesystem.cpp \
     filesystem/filebase.cpp \
+    filesystem/fileblock.cpp \
+    filesystem/lz11.cpp \
+    filesystem/lzfile.cpp \
     filedownloader.cpp \
     filesystem/memoryfile.cpp \
     filesystem/sarcfilesystem.cpp \
@@ -81,35 +87,49 @@ SOURCES += \
     leveleditor/settingsdialog.cpp \
     leveleditor/spriteeditorwidget.cpp \
     leveleditor/spriteidswidget.cpp \
+    leveleditor/tilechunkcache.cpp \
     leveleditor/tilesetpalette.cpp \
     leveleditor/zoneeditorwidget.cpp \
     tileseteditor/tileseteditorwidgets.cpp \
     tileseteditor/tileseteditorwindow.cpp \
     clickablelabel.cpp \
     ctpk.cpp \
+    etc1decoder.cpp \
+    etc1encoder.cpp \
     game.cpp \
     imagecache.cpp \
     level.cpp \
     levelmanager.cpp \
+    leveltilemap.cpp \
     main.cpp\
     mainwindow.cpp \
     newleveldialog.cpp \
     newtilesetdialog.cpp \
+    objectindex.cpp \
     objectrenderer.cpp \
     objects.cpp \
     rg_etc1.cpp \
     sarcexplorerwindow.cpp \
     settingsmanager.cpp \
     spritedata.cpp \
+    texturecache.cpp \
+    texturecodec.cpp \
     tileset.cpp \
     unitsconvert.cpp
 
 HEADERS += \
+    alphakernels.h \
+    atlaskernels.h \
+    filesystem/asyncarchivewriter.h \
+    filesystem/binarycursor.h \
     filesystem/externalfile.h \
     filesystem/externalfilesystem.h \
     filesystem/filebase.h \
+    filesystem/fileblock.h \
     filesystem/filesystem.h \
     filesystem/filesystembase.h \
+    filesystem/lz11.h \
+    filesystem/lzfile.h \
     filesystem/memoryfile.h \
     filesystem/sarcfilesystem.h \
     leveleditor/commands/bgdatcommands.h \
@@ -141,6 +161,7 @@ HEADERS += \
     leveleditor/settingsdialog.h \
     leveleditor/spriteeditorwidget.h \
     leveleditor/spriteidswidget.h \
+    leveleditor/tilechunkcache.h \
     leveleditor/tilesetpalette.h \
     leveleditor/zoneeditorwidget.h \
     tileseteditor/tileseteditorwidgets.h \
@@ -148,15 +169,19 @@ HEADERS += \
     clickablelabel.h \
     crc32.h \
     ctpk.h \
+    etc1decoder.h \
+    etc1encoder.h \
     filedownloader.h \
     game.h \
     imagecache.h \
     is.h \
     level.h \
     levelmanager.h \
+    leveltilemap.h \
     mainwindow.h \
     newleveldialog.h \
     newtilesetdialog.h \
+    objectindex.h \
     objectrenderer.h \
     objects.h \
     rg_etc1.h \
@@ -164,6 +189,8 @@ HEADERS += \
     settingsmanager.h \
     shit.h \
     spritedata.h \
+    texturecache.h \
+    texturecodec.h \
     tileset.h \
     unitsconvert.h \
     windowbase.h
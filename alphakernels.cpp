@@ -0,0 +1,125 @@
+#include "alphakernels.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ALPHAKERNELS_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ALPHAKERNELS_NEON
+#endif
+
+// (x*a+127)/255 for any x, a in 0..255
+static inline quint8 mulDiv255(quint32 x, quint32 a)
+{
+    quint32 t = x*a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#ifdef ALPHAKERNELS_SSE2
+// two pixels in 16 bit lanes
+static inline __m128i premultiply2(__m128i px)
+{
+    // alpha of each pixel in all four lanes, the alpha lane itself gets multiplied by 255
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+    __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    a = _mm_or_si128(_mm_andnot_si128(alphaLanes, a), _mm_and_si128(alphaLanes, _mm_set1_epi16(255)));
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+void AlphaKernels::premultiply(quint8* rgba, quint64 count)
+{
+    quint64 i = 0;
+
+#if defined(ALPHAKERNELS_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4, rgba += 16)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i*)rgba);
+        __m128i lo = premultiply2(_mm_unpacklo_epi8(px, zero));
+        __m128i hi = premultiply2(_mm_unpackhi_epi8(px, zero));
+        _mm_storeu_si128((__m128i*)rgba, _mm_packus_epi16(lo, hi));
+    }
+#elif defined(ALPHAKERNELS_NEON)
+    uint16x8_t round = vdupq_n_u16(128);
+    for (; i + 16 <= count; i += 16, rgba += 64)
+    {
+        uint8x16x4_t px = vld4q_u8(rgba);
+
+        for (int c = 0; c < 3; c++)
+        {
+            uint16x8_t lo = vaddq_u16(vmull_u8(vget_low_u8(px.val[c]), vget_low_u8(px.val[3])), round);
+            uint16x8_t hi = vaddq_u16(vmull_u8(vget_high_u8(px.val[c]), vget_high_u8(px.val[3])), round);
+            lo = vaddq_u16(lo, vshrq_n_u16(lo, 8));
+            hi = vaddq_u16(hi, vshrq_n_u16(hi, 8));
+            px.val[c] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+        }
+
+        vst4q_u8(rgba, px);
+    }
+#endif
+
+    premultiplyScalar(rgba, count - i);
+}
+
+void AlphaKernels::premultiplyScalar(quint8* rgba, quint64 count)
+{
+    for (quint64 i = 0; i < count; i++, rgba += 4)
+    {
+        quint32 a = rgba[3];
+        rgba[0] = mulDiv255(rgba[0], a);
+        rgba[1] = mulDiv255(rgba[1], a);
+        rgba[2] = mulDiv255(rgba[2], a);
+    }
+}
+
+void AlphaKernels::unpremultiply(quint8* rgba, quint64 count)
+{
+    // 255/a in 8.16 fixed point, rounded, so no divides are left in the loop
+    static const struct Reciprocals
+    {
+        quint32 v[256];
+        Reciprocals()
+        {
+            v[0] = 0;
+            for (int a = 1; a < 256; a++)
+                v[a] = (255*65536 + a/2) / a;
+        }
+    } recip;
+
+    for (quint64 i = 0; i < count; i++, rgba += 4)
+    {
+        quint32 a = rgba[3];
+        if (a == 255)
+            continue;
+
+        quint32 r = recip.v[a];
+        rgba[0] = qMin<quint32>(255, (rgba[0]*r + 32768) >> 16);
+        rgba[1] = qMin<quint32>(255, (rgba[1]*r + 32768) >> 16);
+        rgba[2] = qMin<quint32>(255, (rgba[2]*r + 32768) >> 16);
+    }
+}
+
+void AlphaKernels::premultiply(QImage* img)
+{
+    if (img->format() != QImage::Format_RGBA8888)
+        return;
+
+    for (int y = 0; y < img->height(); y++)
+        premultiply(img->scanLine(y), img->width());
+
+    img->reinterpretAsFormat(QImage::Format_RGBA8888_Premultiplied);
+}
+
+void AlphaKernels::unpremultiply(QImage* img)
+{
+    if (img->format() != QImage::Format_RGBA8888_Premultiplied)
+        return;
+
+    for (int y = 0; y < img->height(); y++)
+        unpremultiply(img->scanLine(y), img->width());
+
+    img->reinterpretAsFormat(QImage::Format_RGBA8888);
+}
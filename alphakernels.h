@@ -0,0 +1,23 @@
+#ifndef ALPHAKERNELS_H
+#define ALPHAKERNELS_H
+
+#include <QImage>
+
+// Premultiply/unpremultiply passes over whole RGBA8888 images.
+// Premultiplying is the exact (x*a+127)/255, done with a multiply and two shifts.
+class AlphaKernels
+{
+public:
+    // count pixels of RGBA bytes, in place
+    static void premultiply(quint8* rgba, quint64 count);
+    static void unpremultiply(quint8* rgba, quint64 count);
+
+    // one pixel at a time, the SSE2/NEON path of premultiply() has to give exactly the same
+    static void premultiplyScalar(quint8* rgba, quint64 count);
+
+    // converts between Format_RGBA8888 and Format_RGBA8888_Premultiplied without copying the image
+    static void premultiply(QImage* img);
+    static void unpremultiply(QImage* img);
+};
+
+#endif // ALPHAKERNELS_H
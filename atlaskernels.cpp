@@ -0,0 +1,119 @@
+#include "atlaskernels.h"
+
+#include <cstring>
+
+QImage AtlasKernels::pad(const QImage& img, quint32 outWidth, quint32 outHeight)
+{
+    QImage ret(outWidth, outHeight, QImage::Format_RGBA8888);
+    pad(img, ret);
+    return ret;
+}
+
+void AtlasKernels::pad(const QImage& srcImg, QImage& dst)
+{
+    const QImage src = (srcImg.format() == dst.format()) ? srcImg : srcImg.convertToFormat(dst.format());
+
+    int bpp = dst.depth() / 8;
+    int tilew = qMin(src.width() / 20, dst.width() / 24);
+    int tileh = qMin(src.height() / 20, dst.height() / 24);
+
+    uchar* out = dst.bits();
+    qsizetype outStride = dst.bytesPerLine();
+    qsizetype usedWidth = tilew * 24 * bpp;
+    qsizetype rowWidth = dst.width() * bpp;
+
+    for (int ty = 0; ty < tileh; ty++)
+    {
+        // rows -2 and -1 repeat the first tile row, 20 and 21 the last one
+        for (int row = -2; row < 22; row++)
+        {
+            const uchar* in = src.constScanLine(ty*20 + qBound(0, row, 19));
+            uchar* line = out + (ty*24 + 2 + row) * outStride;
+
+            for (int tx = 0; tx < tilew; tx++)
+            {
+                const uchar* tin = in + tx*20*bpp;
+                uchar* tout = line + tx*24*bpp;
+
+                memcpy(tout, tin, bpp);
+                memcpy(tout + bpp, tin, bpp);
+                memcpy(tout + 2*bpp, tin, 20*bpp);
+                memcpy(tout + 22*bpp, tin + 19*bpp, bpp);
+                memcpy(tout + 23*bpp, tin + 19*bpp, bpp);
+            }
+
+            memset(line + usedWidth, 0, rowWidth - usedWidth);
+        }
+    }
+
+    for (int y = tileh*24; y < dst.height(); y++)
+        memset(out + y*outStride, 0, rowWidth);
+}
+
+QImage AtlasKernels::unpad(const QImage& img, int tilesX, int tilesY)
+{
+    QImage ret(tilesX*20, tilesY*20, img.format());
+    unpad(img, ret);
+    return ret;
+}
+
+void AtlasKernels::unpad(const QImage& srcImg, QImage& dst)
+{
+    const QImage src = (srcImg.format() == dst.format()) ? srcImg : srcImg.convertToFormat(dst.format());
+
+    int bpp = dst.depth() / 8;
+    int tilew = qMin(src.width() / 24, dst.width() / 20);
+    int tileh = qMin(src.height() / 24, dst.height() / 20);
+
+    uchar* out = dst.bits();
+    qsizetype outStride = dst.bytesPerLine();
+
+    for (int ty = 0; ty < tileh; ty++)
+    {
+        for (int row = 0; row < 20; row++)
+        {
+            const uchar* in = src.constScanLine(ty*24 + 2 + row) + 2*bpp;
+            uchar* line = out + (ty*20 + row) * outStride;
+
+            for (int tx = 0; tx < tilew; tx++)
+                memcpy(line + tx*20*bpp, in + tx*24*bpp, 20*bpp);
+        }
+    }
+}
+
+QImage AtlasKernels::downscale(const QImage& atlas, int lod)
+{
+    int tilesX = atlas.width() / 24;
+    int tilesY = atlas.height() / 24;
+    int size = tileSize(lod);
+    int border = borderSize(lod);
+    int cell = cellSize(lod);
+
+    QImage ret(tilesX*cell, tilesY*cell, atlas.format());
+    int bpp = ret.depth() / 8;
+
+    for (int ty = 0; ty < tilesY; ty++)
+    {
+        for (int tx = 0; tx < tilesX; tx++)
+        {
+            QImage tile = atlas.copy(tx*24 + 2, ty*24 + 2, 20, 20).scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            if (tile.format() != ret.format())
+                tile = tile.convertToFormat(ret.format());
+
+            for (int row = -border; row < size + border; row++)
+            {
+                const uchar* in = tile.constScanLine(qBound(0, row, size - 1));
+                uchar* out = ret.scanLine(ty*cell + border + row) + tx*cell*bpp;
+
+                for (int i = 0; i < border; i++)
+                {
+                    memcpy(out + i*bpp, in, bpp);
+                    memcpy(out + (border + size + i)*bpp, in + (size - 1)*bpp, bpp);
+                }
+                memcpy(out + border*bpp, in, size*bpp);
+            }
+        }
+    }
+
+    return ret;
+}
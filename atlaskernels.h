@@ -0,0 +1,27 @@
+#ifndef ATLASKERNELS_H
+#define ATLASKERNELS_H
+
+#include <QImage>
+
+// The tileset atlas stores every 20x20 tile with a 2 pixel border repeating its edge pixels, 24 pixels apart.
+// These only touch raw scanlines, so they are fine to use from worker threads.
+class AtlasKernels
+{
+public:
+    static QImage pad(const QImage& img, quint32 outWidth = 512, quint32 outHeight = 512);
+    static QImage unpad(const QImage& img, int tilesX = 21, int tilesY = 21);
+
+    // write into an existing image in its own format, src gets converted once if needed
+    static void pad(const QImage& src, QImage& dst);
+    static void unpad(const QImage& src, QImage& dst);
+
+    // zoomed out atlases, every tile scaled down on its own and given a border of at least 1 pixel
+    // so filtering never reaches into the next tile. lod 1 is the padded layout halved,
+    // the 2.5 and 1.25 pixel tiles of lod 2 and 3 get rounded up
+    static int tileSize(int lod) { return (20 + (1 << lod) - 1) >> lod; }
+    static int borderSize(int lod) { return qMax(1, 2 >> lod); }
+    static int cellSize(int lod) { return tileSize(lod) + 2*borderSize(lod); }
+    static QImage downscale(const QImage& atlas, int lod);
+};
+
+#endif // ATLASKERNELS_H
@@ -1,86 +1,112 @@
 #include "ctpk.h"
-#include "settingsmanager.h"
 
 #include <QDebug>
 #include <QtEndian>
+#include <QDateTime>
+#include <algorithm>
+#include <cstring>
 #include "rg_etc1.h"
+#include "etc1encoder.h"
+#include "etc1decoder.h"
+#include "texturecodec.h"
+#include "alphakernels.h"
+#include "texturecache.h"
 #include "crc32.h"
 
-Ctpk::Ctpk(FileBase* file)
+Ctpk::Ctpk(FileBase* file, bool premultiplyAlpha)
 {
     this->file = file;
+    this->premultiplyAlpha = premultiplyAlpha;
 
     file->open();
+
+    if (file->size() == 0)
+    {
+        file->close();
+
+        version = 1;
+        numEntries = 0;
+        texSectionOffset = 0;
+        texSectionSize = 0;
+        hashSectionOffset = 0;
+        infoSectionOffset = 0;
+        return;
+    }
+
     file->seek(0);
+    FileBytes headerData = file->peek(file->size());
+    BinaryCursor<> in(headerData);
 
     QString magic;
-    file->readStringASCII(magic, 4);
+    in.readStringASCII(magic, 4);
 
     if (magic != "CTPK")
         throw std::runtime_error("CTPK: invalid file");
 
     // Parse CTPK Header
 
-    version = file->read16();
-    numEntries = file->read16();
+    version = in.read16();
+    numEntries = in.read16();
 
-    texSectionOffset = file->read32();
-    texSectionSize = file->read32();
-    hashSectionOffset = file->read32();
-    infoSectionOffset = file->read32();
+    texSectionOffset = in.read32();
+    texSectionSize = in.read32();
+    hashSectionOffset = in.read32();
+    infoSectionOffset = in.read32();
 
 
     // Parse Entries
 
     for (uint i = 0; i < numEntries; i++)
     {
-        file->seek((i + 1) * 0x20);
+        in.seek((i + 1) * 0x20);
 
         CtpkEntry* entry = new CtpkEntry();
-        entry->filenameOffset = file->read32();
-        entry->dataSize = file->read32();
-        entry->dataOffset = file->read32();
-        entry->format = (TextrueFormat)file->read32();
+        entry->filenameOffset = in.read32();
+        entry->dataSize = in.read32();
+        entry->dataOffset = in.read32();
+        entry->format = (TextrueFormat)in.read32();
         updataEntryHasAlpha(entry);
-        entry->width = file->read16();
-        entry->height = file->read16();
-        entry->mipLevel = file->read8();
-        entry->type = file->read8();
-        entry->unk = file->read16();
-        entry->bmpSizeOffset = file->read32();
-        entry->unixTimestamp = file->read32();
+        entry->width = in.read16();
+        entry->height = in.read16();
+        entry->mipLevel = in.read8();
+        entry->type = in.read8();
+        entry->unk = in.read16();
+        entry->bmpSizeOffset = in.read32();
+        entry->unixTimestamp = in.read32();
         entries.append(entry);
     }
 
 
     // Parse Info 1 (Whatever this is)
     for (uint i = 0; i< numEntries; i++)
-        entries[i]->info1 = file->read32();
+        entries[i]->info1 = in.read32();
 
     // Parse Hashes
-    file->seek(hashSectionOffset);
+    in.seek(hashSectionOffset);
 
     for (uint i = 0; i< numEntries; i++)
     {
-        entries[i]->filenameHash = file->read32();
-        file->skip(4);      // Hash Index?
+        quint32 hash = in.read32();
+        quint32 index = in.read32();    // sorted by hash, this is the entry it belongs to
+        if (index < numEntries)
+            entries[index]->filenameHash = hash;
     }
 
 
     // Parse Info 2 (Whatever this is, something about the texture)
 
-    file->seek(infoSectionOffset);
+    in.seek(infoSectionOffset);
 
     for (uint i = 0; i< numEntries; i++)
-        entries[i]->info2 = file->read32();
+        entries[i]->info2 = in.read32();
 
 
     // Parse Filenames
 
     foreach (CtpkEntry* entry, entries)
     {
-        file->seek(entry->filenameOffset);
-        file->readStringASCII(entry->filename);
+        in.seek(entry->filenameOffset);
+        in.readStringASCII(entry->filename);
     }
 
     file->close();
@@ -111,6 +137,10 @@ void Ctpk::updataEntryHasAlpha(CtpkEntry* entry)
     case RGBA4444:
     case RGBA5551:
     case RGBA8888:
+    case LA88:
+    case A8:
+    case LA44:
+    case A4:
     case ETC1_A4:
         entry->hasAlpha = true;
         break;
@@ -120,14 +150,51 @@ void Ctpk::updataEntryHasAlpha(CtpkEntry* entry)
     }
 }
 
-QImage Ctpk::getTexture(quint32 entryIndex)
+QImage Ctpk::getTexture(quint32 entryIndex, quint32 level)
+{
+    if (entryIndex >= numEntries)
+    {
+        throw std::runtime_error("CTPK: Texture Index out ouf Bounds");
+    }
+
+    return decode(getEncodedLevel(entries[entryIndex], level));
+}
+
+quint32 Ctpk::getMipCount(quint32 entryIndex)
 {
-    if (entryIndex > numEntries-1)
+    if (entryIndex >= numEntries)
     {
         throw std::runtime_error("CTPK: Texture Index out ouf Bounds");
     }
 
-    return getTexture(entries[entryIndex]);
+    return qMax<quint32>(entries[entryIndex]->mipLevel, 1);
+}
+
+Ctpk::TextrueFormat Ctpk::getTextureFormat(quint32 entryIndex)
+{
+    if (entryIndex >= numEntries)
+    {
+        throw std::runtime_error("CTPK: Texture Index out ouf Bounds");
+    }
+
+    return entries[entryIndex]->format;
+}
+
+QByteArray Ctpk::getTextureData(quint32 entryIndex, quint32 level)
+{
+    if (entryIndex >= numEntries)
+        throw std::runtime_error("CTPK: Texture Index out ouf Bounds");
+
+    CtpkEntry* entry = entries[entryIndex];
+    checkLevel(entry, level);
+    quint32 levelOffset = textureSize(entry->format, entry->width, entry->height, level);
+    quint32 dataSize = textureSize(entry->format, entry->width >> level, entry->height >> level);
+
+    file->open();
+    QByteArray data = file->peekAt(texSectionOffset + entry->dataOffset + levelOffset, dataSize).toByteArray();
+    file->close();
+
+    return data;
 }
 
 QImage Ctpk::getTexture(QString filename)
@@ -139,391 +206,407 @@ QImage Ctpk::getTexture(QString filename)
         throw std::runtime_error("CTPK: Texture not found");
     }
 
-    return getTexture(entry);
+    return decode(getEncodedLevel(entry, 0));
 }
 
-QImage Ctpk::getTexture(CtpkEntry* entry)
+void Ctpk::checkLevel(CtpkEntry* entry, quint32 level)
 {
-    QImage::Format imgFormat;
+    if (level >= qMax<quint32>(entry->mipLevel, 1))
+        throw std::runtime_error("CTPK: Mip Level out of Bounds");
 
-    if (entry->hasAlpha)
+    // every level is made of whole 8x8 tiles, a file claiming more levels than that is broken
+    if ((entry->width >> level) < 8 || (entry->height >> level) < 8)
+        throw std::runtime_error("CTPK: Mip Level smaller than a tile");
+
+    if (textureSize(entry->format, entry->width, entry->height, level + 1) > entry->dataSize)
+        throw std::runtime_error("CTPK: Mip Level past the end of the texture data");
+}
+
+Ctpk::EncodedLevel Ctpk::getEncodedLevel(quint32 entryIndex, quint32 level)
+{
+    if (entryIndex >= numEntries)
     {
-        if (SettingsManager::getInstance()->get("premultiplyAlpha", true).toBool())
-            imgFormat = QImage::Format_RGBA8888_Premultiplied;
-        else
-            imgFormat = QImage::Format_RGBA8888;
+        throw std::runtime_error("CTPK: Texture Index out ouf Bounds");
+    }
+
+    return getEncodedLevel(entries[entryIndex], level);
+}
+
+Ctpk::EncodedLevel Ctpk::getEncodedLevel(CtpkEntry* entry, quint32 level)
+{
+    checkLevel(entry, level);
+
+    if (entry->format != ETC1 && entry->format != ETC1_A4 && !TextureCodec::isSupported(entry->format))
+        throw std::runtime_error("CTPK: Unsupported Texture Format");
+
+    // levels are stored one after another, each half the size of the previous one
+    EncodedLevel ret;
+    ret.format = entry->format;
+    ret.width = entry->width >> level;
+    ret.height = entry->height >> level;
+    ret.hasAlpha = entry->hasAlpha;
+    ret.premultiply = entry->hasAlpha && premultiplyAlpha;
+
+    quint32 levelOffset = textureSize(entry->format, entry->width, entry->height, level);
+    quint32 dataSize = textureSize(entry->format, ret.width, ret.height);
+
+    // the whole level in one go, it stays as it is even if the file changes later
+    file->open();
+    ret.data = file->peekAt(texSectionOffset + entry->dataOffset + levelOffset, dataSize);
+    file->close();
+
+    // zero padded if the file is short
+    if (ret.data.size() < dataSize)
+    {
+        FileBlockRef padded(new FileBlock(dataSize));
+        if (!ret.data.isNull())
+            memcpy(padded->data, ret.data.data(), ret.data.size());
+        memset(padded->data + ret.data.size(), 0, dataSize - ret.data.size());
+        ret.data = FileBytes(padded, 0, dataSize);
     }
+
+    return ret;
+}
+
+QImage Ctpk::decode(const EncodedLevel& level)
+{
+    QImage::Format imgFormat;
+    if (level.hasAlpha)
+        imgFormat = level.premultiply ? QImage::Format_RGBA8888_Premultiplied : QImage::Format_RGBA8888;
     else
         imgFormat = QImage::Format_RGB888;
 
+    // decoded textures are cached on disk, keyed by their encoded data
+    QByteArray texData = QByteArray::fromRawData(level.data.constData(), level.data.size());
+    TextureCache* cache = TextureCache::getInstance();
+    QByteArray cacheKey = TextureCache::makeKey(texData, level.format, level.width, level.height, level.premultiply);
 
-    QImage tex = QImage(entry->width, entry->height, imgFormat);
+    QImage cached = cache->load(cacheKey);
+    if (!cached.isNull() && cached.format() == imgFormat && (quint32)cached.width() == level.width && (quint32)cached.height() == level.height)
+        return cached;
 
-    switch (entry->format)
+
+    // the decoders emit straight alpha, premultiplying is one pass over the whole image
+    QImage tex = QImage(level.width, level.height, level.hasAlpha ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    const quint8* src = level.data.data();
+
+    switch (level.format)
     {
         case ETC1:
         case ETC1_A4:
-            getTextureETC1(entry, &tex);
+            Etc1Decoder::decode(src, level.width, level.height, level.format == ETC1_A4, &tex);
             break;
         default:
-            getTextureRaster(entry, &tex);
+            TextureCodec::decode(level.format, src, level.width, level.height, &tex);
             break;
     }
 
+    if (level.premultiply)
+        AlphaKernels::premultiply(&tex);
+
+    cache->store(cacheKey, tex);
     return tex;
 }
 
-void Ctpk::getTextureRaster(CtpkEntry* entry, QImage* tex)
-{    
-    quint8* data = tex->scanLine(0);
-    bool premultiply = (tex->format() == QImage::Format_RGBA8888_Premultiplied);
+void Ctpk::setTextureEtc1(quint32 entryIndex, QImage& img, bool alpha, uint quality, bool dither)
+{
+    assert(entryIndex < numEntries);
+
+    // keeps the mip levels the texture already had
+    setTexture(entryIndex, img, alpha ? ETC1_A4 : ETC1, entries[entryIndex]->mipLevel, quality, dither);
+}
+
+void Ctpk::setTexture(quint32 entryIndex, const QImage& img, TextrueFormat format, quint8 mipCount, uint quality, bool dither)
+{
+    assert(entryIndex < numEntries);
+
+    mipCount = clampMipCount(img.width(), img.height(), mipCount);
+    setTextureData(entryIndex, format, img.width(), img.height(), mipCount, encodeTexture(img, format, mipCount, quality, dither));
+}
+
+quint32 Ctpk::addTexture(QString filename, const QImage& img, TextrueFormat format, quint8 mipCount, uint quality, bool dither)
+{
+    mipCount = clampMipCount(img.width(), img.height(), mipCount);
+    QByteArray data = encodeTexture(img, format, mipCount, quality, dither);
+
+    QList<QByteArray> texData = readAllTextureData();
+
+    CtpkEntry* entry = new CtpkEntry();
+    entry->filename = filename;
+    entry->type = entries.isEmpty() ? 0 : entries[0]->type;
+    entry->unk = 0;
+    setEntryLayout(entry, format, img.width(), img.height(), mipCount, quality);
+
+    entries.append(entry);
+    texData.append(data);
+
+    rebuild(texData);
+    return numEntries - 1;
+}
+
+void Ctpk::removeTexture(quint32 entryIndex)
+{
+    assert(entryIndex < numEntries);
+
+    QList<QByteArray> texData = readAllTextureData();
+    texData.removeAt(entryIndex);
+    delete entries.takeAt(entryIndex);
+
+    rebuild(texData);
+}
+
+void Ctpk::setTextureData(quint32 entryIndex, const QByteArray& data)
+{
+    assert(entryIndex < numEntries);
+
+    CtpkEntry* entry = entries[entryIndex];
+    assert((quint32)data.size() == entry->dataSize);
 
     file->open();
     file->seek(texSectionOffset + entry->dataOffset);
+    file->writeBlock(data);
+    file->save();
+    file->close();
+}
 
-    for (quint32 y = 0; y < entry->height; y += 8)
+void Ctpk::setTextureData(quint32 entryIndex, TextrueFormat format, quint16 width, quint16 height, quint8 mipCount, const QByteArray& data)
+{
+    assert(entryIndex < numEntries);
+    assert((quint32)data.size() == textureSize(format, width, height, mipCount));
+
+    CtpkEntry* entry = entries[entryIndex];
+
+    // same layout, the data can just be overwritten
+    if (entry->format == format && entry->width == width && entry->height == height && entry->mipLevel == mipCount && entry->dataSize == (quint32)data.size())
     {
-        for (quint32 x = 0; x < entry->width; x += 8)
-        {
-            for (quint32 ty = 0; ty < 8; ty += 4)
-            {
-                for (quint32 tx = 0; tx < 8; tx += 4)
-                {
-                    for (quint32 sy = 0; sy < 4; sy += 2)
-                    {
-                        for (quint32 sx = 0; sx < 4; sx += 2)
-                        {
-                            for (quint32 yy = 0; yy < 2; yy++)
-                            {
-                                for (quint32 xx = 0; xx < 2; xx++)
-                                {
-
-                                    quint32 r, g, b, a;
-
-                                    switch (entry->format)
-                                    {
-                                    case RGBA4444:
-                                    {
-                                        quint16 i = file->read16();
-                                        r = ((i >> 12) & 0xF) << 4;
-                                        g = ((i >> 8) & 0xF) << 4;
-                                        b = ((i >> 4) & 0xF) << 4;
-                                        a = (i & 0xF) << 4;
-                                        break;
-                                    }
-                                    case RGBA5551:
-                                    {
-                                        quint16 i = file->read16();
-                                        r = ((i >> 11) & 0x1F) << 3;
-                                        g = ((i >> 6) & 0x1F) << 3;
-                                        b = ((i >> 1) & 0x1F) << 3;
-                                        if (i & 1)
-                                            a = 255;
-                                        else
-                                            a = 0;
-                                        break;
-                                    }
-                                    case RGBA8888:
-                                    {
-                                        a = file->read8();
-                                        b = file->read8();
-                                        g = file->read8();
-                                        r = file->read8();
-                                        break;
-                                    }
-                                    case RGB565:
-                                    {
-                                        quint16 i = file->read16();
-                                        r = ((i >> 11) & 0x1F) << 3;
-                                        g = ((i >> 5) & 0x3F) << 2;
-                                        b = (i & 0x1F) << 3;
-                                        break;
-                                    }
-                                    case RGB888:
-                                    {
-                                        b = file->read8();
-                                        g = file->read8();
-                                        r = file->read8();
-                                        break;
-                                    }
-                                    default:
-                                    {
-                                        throw std::runtime_error("CTPK: Unsupported Texture Format");
-                                        break;
-                                    }
-                                    }
-
-                                    if (entry->hasAlpha)
-                                    {
-                                        quint32 dstpos = ((yy + sy + ty + y) * entry->width + xx + sx + tx + x) * 4;
-
-                                        if (premultiply)
-                                        {
-                                            r = (r * a) / 255;
-                                            g = (g * a) / 255;
-                                            b = (b * a) / 255;
-                                        }
-
-                                        data[dstpos + 0] = r;
-                                        data[dstpos + 1] = g;
-                                        data[dstpos + 2] = b;
-                                        data[dstpos + 3] = a;
-                                    }
-                                    else
-                                    {
-                                        quint32 dstpos = ((yy + sy + ty + y) * entry->width + xx + sx + tx + x) * 3;
-                                        data[dstpos + 0] = r;
-                                        data[dstpos + 1] = g;
-                                        data[dstpos + 2] = b;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
+        setTextureData(entryIndex, data);
+        return;
     }
 
-    file->close();
+    QList<QByteArray> texData = readAllTextureData();
+    texData[entryIndex] = data;
+
+    setEntryLayout(entry, format, width, height, mipCount, (entry->info2 >> 24) & 0xFF);
+    rebuild(texData);
 }
 
-void Ctpk::getTextureETC1(CtpkEntry* entry, QImage* tex)
+void Ctpk::setFilename(QString newName)
 {
-    const qint32 etc1_mod[8][2] =
-    {
-        {2, 8}, {5, 17}, {9, 29}, {13, 42},
-        {18, 60}, {24, 80}, {33, 106}, {47, 183}
-    };
+    foreach (CtpkEntry* entry, entries)
+        entry->filename = newName;
 
-    quint8* data = tex->scanLine(0);
-    bool premultiply = (tex->format() == QImage::Format_RGBA8888_Premultiplied);
+    rebuild(readAllTextureData());
+}
 
-    file->open();
-    file->seek(texSectionOffset + entry->dataOffset);
+void Ctpk::setEntryLayout(CtpkEntry* entry, TextrueFormat format, quint16 width, quint16 height, quint8 mipCount, uint quality)
+{
+    entry->format = format;
+    updataEntryHasAlpha(entry);
+    entry->width = width;
+    entry->height = height;
+    entry->mipLevel = mipCount;
+    entry->unixTimestamp = QDateTime::currentSecsSinceEpoch();
+
+    // bitmap size is the size of the first level
+    entry->info1 = textureSize(format, width, height, 1);
+
+    // conversion info: format, mip count, compressed flag, etc1 quality
+    bool etc = (format == ETC1 || format == ETC1_A4);
+    entry->info2 = format | (mipCount << 8) | ((etc ? 1 : 0) << 16) | ((etc ? qMin(quality, 2u) : 0) << 24);
+}
 
-    for (quint32 y = 0; y < entry->height; y += 8)
+QList<QByteArray> Ctpk::readAllTextureData()
+{
+    QList<QByteArray> texData;
+
+    file->open();
+    foreach (CtpkEntry* entry, entries)
     {
-        for (quint32 x = 0; x < entry->width; x += 8)
-        {
-            for (quint32 ty = 0; ty < 8; ty += 4)
-            {
-                for (quint32 tx = 0; tx < 8; tx += 4)
-                {
-                    quint64 alpha;
-                    if (entry->format == ETC1_A4)
-                    {
-                        alpha = (quint64)file->read32();
-                        alpha |= ((quint64)file->read32() << 32);
-                    }
-
-                    quint16 subindexes = file->read16();
-                    quint16 negative = file->read16();
-                    quint32 flags_col = file->read32();
-
-                    for (quint32 sx = 0; sx < 4; sx++)
-                    {
-                        for (quint32 sy = 0; sy < 4; sy++)
-                        {
-                            qint32 r, g, b;
-                            quint32 tsx;
-
-                            // dirty
-                            if (flags_col & 0x1)
-                                tsx = sy;
-                            else
-                                tsx = sx;
-
-                            if (flags_col & 0x2)
-                            {
-                                r = (flags_col & 0xF8000000) >> 24;
-                                g = (flags_col & 0x00F80000) >> 16;
-                                b = (flags_col & 0x0000F800) >> 8;
-                                if (tsx >= 2)
-                                {
-                                    qint32 dr = (flags_col & 0x07000000) >> 21;
-                                    qint32 dg = (flags_col & 0x00070000) >> 13;
-                                    qint32 db = (flags_col & 0x00000700) >> 5;
-                                    if (dr & 0x20) dr -= 0x40;
-                                    if (dg & 0x20) dg -= 0x40;
-                                    if (db & 0x20) db -= 0x40;
-                                    r += dr;
-                                    g += dg;
-                                    b += db;
-                                }
-
-                                r |= (r >> 5);
-                                g |= (g >> 5);
-                                b |= (b >> 5);
-                            }
-                            else
-                            {
-                                if (tsx >= 2)
-                                {
-                                    r = (flags_col & 0x0F000000) >> 20;
-                                    g = (flags_col & 0x000F0000) >> 12;
-                                    b = (flags_col & 0x00000F00) >> 4;
-                                }
-                                else
-                                {
-                                    r = (flags_col & 0xF0000000) >> 24;
-                                    g = (flags_col & 0x00F00000) >> 16;
-                                    b = (flags_col & 0x0000F000) >> 8;
-                                }
-
-                                r |= (r >> 4);
-                                g |= (g >> 4);
-                                b |= (b >> 4);
-                            }
-
-                            quint32 mod_index = (flags_col >> (tsx>=2 ? 2:5)) & 0x7;
-                            qint32 mod = etc1_mod[mod_index][subindexes & 0x1];
-                            if (negative & 0x1) mod = -mod;
-
-                            r = clampColor(r + mod);
-                            g = clampColor(g + mod);
-                            b = clampColor(b + mod);
-
-
-
-                            if (entry->hasAlpha)
-                            {
-                                quint8 a = alpha & 0xF;
-                                a |= (a << 4);
-
-                                quint32 dstpos = ((sy + ty + y) * entry->width + sx + tx + x) * 4;
-
-                                if (premultiply)
-                                {
-                                    r = (r * a) / 255;
-                                    g = (g * a) / 255;
-                                    b = (b * a) / 255;
-                                }
-
-                                data[dstpos + 0] = r;
-                                data[dstpos + 1] = g;
-                                data[dstpos + 2] = b;
-                                data[dstpos + 3] = a;
-                            }
-                            else
-                            {
-                                quint32 dstpos = ((sy + ty + y) * entry->width + sx + tx + x) * 3;
-                                data[dstpos + 0] = r;
-                                data[dstpos + 1] = g;
-                                data[dstpos + 2] = b;
-                            }
-
-                            subindexes >>= 1;
-                            negative >>= 1;
-                            alpha >>= 4ULL;
-                        }
-                    }
-                }
-            }
-        }
+        QByteArray data = file->peekAt(texSectionOffset + entry->dataOffset, entry->dataSize).toByteArray();
+        if ((quint32)data.size() < entry->dataSize)
+            data.append(entry->dataSize - data.size(), '\0');
+        texData.append(data);
     }
-
     file->close();
+
+    return texData;
 }
 
-void Ctpk::setTextureEtc1(quint32 entryIndex, QImage& img, bool alpha, uint quality, bool dither)
+void Ctpk::rebuild(const QList<QByteArray>& texData)
 {
-    assert(entryIndex < numEntries);
+    assert(texData.size() == entries.size());
 
-    TextrueFormat format = alpha ? ETC1_A4 : ETC1;
+    numEntries = entries.size();
 
-    CtpkEntry* entry = entries[entryIndex];
-    assert(entry->format == format);
-    assert(entry->width == img.width());
-    assert(entry->height == img.height());
-
-    rg_etc1::etc1_pack_params pack_params;
-    if (quality == 0)
-        pack_params.m_quality = rg_etc1::cLowQuality;
-    else if (quality == 1)
-        pack_params.m_quality = rg_etc1::cMediumQuality;
-    else
-        pack_params.m_quality = rg_etc1::cHighQuality;
-    pack_params.m_dithering = dither;
+    // header and entries, then the bitmap sizes, filenames, hashes and infos, the textures come last
+    quint32 sizesOffset = 0x20 + numEntries*0x20;
+    quint32 pos = sizesOffset + numEntries*4;
 
-    printf("ETC1 compression progress: 0%%");
-    fflush(stdout);
+    for (quint32 i = 0; i < numEntries; i++)
+    {
+        entries[i]->bmpSizeOffset = i;
+        entries[i]->filenameOffset = pos;
+        pos += entries[i]->filename.toLatin1().size() + 1;
+    }
 
-    file->open();
-    file->seek(texSectionOffset + entry->dataOffset);
+    hashSectionOffset = (pos + 3) & ~3;
+    infoSectionOffset = hashSectionOffset + numEntries*8;
+    texSectionOffset = (infoSectionOffset + numEntries*4 + 0x7F) & ~0x7F;
 
-    for (int y = 0; y < img.height(); y += 8)
+    texSectionSize = 0;
+    for (quint32 i = 0; i < numEntries; i++)
     {
-        for (int x = 0; x < img.width(); x += 8)
-        {
-            for (int ty = 0; ty < 8; ty += 4)
-            {
-                for (int tx = 0; tx < 8; tx += 4)
-                {
-                    quint64 alphaData = 0;
-                    unsigned int packData[4*4];
-
-                    for (int sx = 0; sx < 4; sx++)
-                    {
-                        for (int sy = 0; sy < 4; sy++)
-                        {
-                            int x_ = x+tx+sx;
-                            int y_ = y+ty+sy;
-
-                            QColor c = img.pixelColor(x_, y_);
-                            packData[sy*4 + sx] = (c.red()<<0) | (c.green()<<8) | (c.blue()<<16) | (0xFF<<24);
-
-                            alphaData = (alphaData >> 4ULL) | (static_cast<quint64>(c.alpha() >> 4) << 60ULL);
-                        }
-                    }
-
-                    if (alpha)
-                        file->write64(alphaData);
-
-                    quint64 etc1block;
-                    rg_etc1::pack_etc1_block(&etc1block, packData, pack_params);
-
-                    file->write64(qbswap(etc1block));
-                }
-            }
-        }
+        entries[i]->dataOffset = texSectionSize;
+        entries[i]->dataSize = texData[i].size();
+        texSectionSize = (texSectionSize + entries[i]->dataSize + 0x7F) & ~0x7F;
+    }
+
+    quint32 table[256];
+    crc32::generate_table(table);
+
+    QList<QPair<quint32,quint32>> hashes;
+    for (quint32 i = 0; i < numEntries; i++)
+    {
+        QByteArray name = entries[i]->filename.toLatin1();
+        entries[i]->filenameHash = crc32::update(table, 0, name.constData(), name.size());
+        hashes.append(qMakePair(entries[i]->filenameHash, i));
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+
+    BinaryWriter<> out(texSectionOffset + texSectionSize);
+
+    out.writeStringASCII("CTPK", 4);
+    out.write16(version);
+    out.write16(numEntries);
+    out.write32(texSectionOffset);
+    out.write32(texSectionSize);
+    out.write32(hashSectionOffset);
+    out.write32(infoSectionOffset);
+
+    for (quint32 i = 0; i < numEntries; i++)
+    {
+        CtpkEntry* entry = entries[i];
+
+        out.seek((i + 1) * 0x20);
+        out.write32(entry->filenameOffset);
+        out.write32(entry->dataSize);
+        out.write32(entry->dataOffset);
+        out.write32(entry->format);
+        out.write16(entry->width);
+        out.write16(entry->height);
+        out.write8(entry->mipLevel);
+        out.write8(entry->type);
+        out.write16(entry->unk);
+        out.write32(entry->bmpSizeOffset);
+        out.write32(entry->unixTimestamp);
+    }
+
+    out.seek(sizesOffset);
+    foreach (CtpkEntry* entry, entries)
+        out.write32(entry->info1);
 
-        printf("\rETC1 compression progress: %d%%", (y+8)*100 / img.height());
-        fflush(stdout);
+    foreach (CtpkEntry* entry, entries)
+        out.writeStringASCII(entry->filename);
+
+    out.seek(hashSectionOffset);
+    for (int i = 0; i < hashes.size(); i++)
+    {
+        out.write32(hashes[i].first);
+        out.write32(hashes[i].second);
     }
 
-    printf("\rETC1 compression progress: Done.\n");
-    fflush(stdout);
+    out.seek(infoSectionOffset);
+    foreach (CtpkEntry* entry, entries)
+        out.write32(entry->info2);
 
+    for (quint32 i = 0; i < numEntries; i++)
+    {
+        out.seek(texSectionOffset + entries[i]->dataOffset);
+        out.writeData((const quint8*)texData[i].constData(), texData[i].size());
+    }
+
+    file->open();
+    file->resize(out.size());
+    file->seek(0);
+    file->writeBlock(out.block());
     file->save();
     file->close();
 }
 
-void Ctpk::setFilename(QString newName)
+quint32 Ctpk::bitsPerPixel(TextrueFormat format)
 {
-    // Hacky fix to ensure ctpk filename is correct when creating new tilesets
-    // TODO: implement proper ctpk writing so files
-    for (uint i = 0; i< numEntries; i++)
+    switch (format)
     {
-        file->open();
-        file->seek(entries[i]->filenameOffset);
-        file->writeStringASCII(newName, 36);
+    case RGBA8888:
+        return 32;
+    case RGB888:
+        return 24;
+    case RGBA5551:
+    case RGB565:
+    case RGBA4444:
+    case LA88:
+    case HL8:
+        return 16;
+    case L8:
+    case A8:
+    case LA44:
+    case ETC1_A4:
+        return 8;
+    case L4:
+    case A4:
+    case ETC1:
+        return 4;
+    }
 
-        // Calculate filename hash
-        file->seek(hashSectionOffset + i*64);
+    throw std::runtime_error("CTPK: Unsupported Texture Format");
+}
 
-        quint32 table[256];
-        crc32::generate_table(table);
+quint32 Ctpk::textureSize(TextrueFormat format, quint32 width, quint32 height, quint8 mipCount)
+{
+    quint32 size = 0;
+    for (quint32 level = 0; level < mipCount; level++)
+        size += (width >> level) * (height >> level) * bitsPerPixel(format) / 8;
+    return size;
+}
 
-        std::string utf8_text = newName.toUtf8().constData();
-        const void * a = utf8_text.c_str();
+quint8 Ctpk::clampMipCount(quint32 width, quint32 height, quint8 mipCount)
+{
+    // every level still has to be made of whole 8x8 tiles
+    quint8 max = 1;
+    while (((width >> max) % 8) == 0 && ((height >> max) % 8) == 0 && (width >> max) > 0 && (height >> max) > 0)
+        max++;
 
-        quint32 crc = crc32::update(table, 0, a, utf8_text.size());
-        file->write32(crc);
+    return qBound<quint8>(1, mipCount, max);
+}
 
-        file->save();
-        file->close();
+QByteArray Ctpk::encodeTexture(const QImage& img, TextrueFormat format, quint8 mipCount, uint quality, bool dither)
+{
+    if (img.width() % 8 || img.height() % 8 || img.width() > 0xFFFF || img.height() > 0xFFFF)
+        throw std::runtime_error("CTPK: Texture dimensions have to be multiples of 8");
+
+    mipCount = clampMipCount(img.width(), img.height(), mipCount);
+
+    QByteArray ret;
+    ret.reserve(textureSize(format, img.width(), img.height(), mipCount));
+
+    for (quint32 level = 0; level < mipCount; level++)
+    {
+        QImage levelImg = img;
+        if (level > 0)
+            levelImg = img.scaled(img.width() >> level, img.height() >> level, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+        if (format == ETC1 || format == ETC1_A4)
+        {
+            Etc1Encoder encoder(levelImg, format == ETC1_A4, quality, dither);
+            encoder.encode();
+            ret.append(encoder.result());
+        }
+        else
+            ret.append(TextureCodec::encode(levelImg, format));
     }
+
+    return ret;
 }
 
 void Ctpk::printInfo()
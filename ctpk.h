@@ -8,20 +8,6 @@
 class Ctpk
 {
 public:
-    Ctpk(FileBase* file);
-    ~Ctpk();
-
-    QImage getTexture(quint32 entryIndex);
-    QImage getTexture(QString filename);
-
-    // only supports replacing with exact same data size for now!
-    void setTextureEtc1(quint32 entryIndex, QImage& img, bool alpha, uint quality = 1, bool dither = false);
-
-    void setFilename(QString newName);
-
-private:
-    FileBase* file;
-
     enum TextrueFormat
     {
         RGBA8888 = 0,
@@ -40,6 +26,59 @@ private:
         ETC1_A4 = 13
     };
 
+    // an empty file gives an empty CTPK
+    // premultiplyAlpha is the user's setting, read by the caller since decoding may run on other threads
+    Ctpk(FileBase* file, bool premultiplyAlpha = true);
+    ~Ctpk();
+
+    quint32 getNumEntries() { return numEntries; }
+
+    // level 0 is the full size texture, every further level is half the size
+    QImage getTexture(quint32 entryIndex, quint32 level = 0);
+
+    // what decoding one level needs, taken out of the file so it can be decoded on another thread
+    // while the CTPK or the archive it's in gets changed
+    struct EncodedLevel
+    {
+        TextrueFormat format = RGBA8888;
+        quint32 width = 0, height = 0;
+        bool hasAlpha = false;
+        bool premultiply = false;
+        FileBytes data;
+    };
+    EncodedLevel getEncodedLevel(quint32 entryIndex, quint32 level = 0);
+    static QImage decode(const EncodedLevel& level);
+    quint32 getMipCount(quint32 entryIndex);
+    TextrueFormat getTextureFormat(quint32 entryIndex);
+
+    // encoded data of one level, as stored in the file
+    QByteArray getTextureData(quint32 entryIndex, quint32 level = 0);
+    QImage getTexture(QString filename);
+
+    void setTextureEtc1(quint32 entryIndex, QImage& img, bool alpha, uint quality = 1, bool dither = false);
+
+    // encodes all mip levels, the file gets rebuilt if the layout changes
+    void setTexture(quint32 entryIndex, const QImage& img, TextrueFormat format, quint8 mipCount = 1, uint quality = 1, bool dither = false);
+    quint32 addTexture(QString filename, const QImage& img, TextrueFormat format, quint8 mipCount = 1, uint quality = 1, bool dither = false);
+    void removeTexture(quint32 entryIndex);
+
+    // already encoded data, e.g. from an Etc1Encoder running in the background
+    void setTextureData(quint32 entryIndex, const QByteArray& data);
+    void setTextureData(quint32 entryIndex, TextrueFormat format, quint16 width, quint16 height, quint8 mipCount, const QByteArray& data);
+
+    void setFilename(QString newName);
+
+    static quint32 bitsPerPixel(TextrueFormat format);
+    // size of the first mipCount levels
+    static quint32 textureSize(TextrueFormat format, quint32 width, quint32 height, quint8 mipCount = 1);
+    static QByteArray encodeTexture(const QImage& img, TextrueFormat format, quint8 mipCount = 1, uint quality = 1, bool dither = false);
+    // levels past the last one made of whole 8x8 tiles are dropped
+    static quint8 clampMipCount(quint32 width, quint32 height, quint8 mipCount);
+
+private:
+    FileBase* file;
+    bool premultiplyAlpha;
+
     struct CtpkEntry
     {
         quint32 filenameOffset;
@@ -77,19 +116,19 @@ private:
 
     CtpkEntry* getEntryByFilename(QString filename);
 
-    QImage getTexture(CtpkEntry* entry);
-    void getTextureRaster(CtpkEntry* entry, QImage* tex);
-    void getTextureETC1(CtpkEntry* entry, QImage* tex);
-
-    qint32 clampColor(qint32 val)
-    {
-        if (val > 255) return 255;
-        if (val < 0) return 0;
-        return val;
-    }
+    EncodedLevel getEncodedLevel(CtpkEntry* entry, quint32 level);
+    // throws if the level isn't there or doesn't fit in the entry's data
+    void checkLevel(CtpkEntry* entry, quint32 level);
 
     void updataEntryHasAlpha(CtpkEntry* entry);
 
+    // serializes the whole file from the entry list, texData holds each entry's data in order
+    void rebuild(const QList<QByteArray>& texData);
+    QList<QByteArray> readAllTextureData();
+    void setEntryLayout(CtpkEntry* entry, TextrueFormat format, quint16 width, quint16 height, quint8 mipCount, uint quality);
+
+
+
 
     void printInfo();
 
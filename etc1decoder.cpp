@@ -0,0 +1,158 @@
+#include "etc1decoder.h"
+
+#include <QtEndian>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// ETC1 palette helpers: base colours and modifiers are worked out once per block,
+// the clamp of all 32 palette values (2 subblocks x 4 modifiers x RGBA) is vectorized
+
+static const qint32 etc1_mod[8][2] =
+{
+    {2, 8}, {5, 17}, {9, 29}, {13, 42},
+    {18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+static inline void clampPalette(const qint16* in, quint8* out)
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    for (int i = 0; i < 32; i += 16)
+    {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(in + i + 8));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (int i = 0; i < 32; i += 8)
+        vst1_u8(out + i, vqmovun_s16(vld1q_s16(in + i)));
+#else
+    for (int i = 0; i < 32; i++)
+        out[i] = (in[i] < 0) ? 0 : ((in[i] > 255) ? 255 : in[i]);
+#endif
+}
+
+// palette[subblock][negative<<1 | subindex][channel]
+static inline void etc1Palette(quint32 flags_col, quint8 palette[2][4][4])
+{
+    qint32 base[2][3];
+
+    if (flags_col & 0x2)
+    {
+        qint32 r = (flags_col & 0xF8000000) >> 24;
+        qint32 g = (flags_col & 0x00F80000) >> 16;
+        qint32 b = (flags_col & 0x0000F800) >> 8;
+
+        qint32 dr = (flags_col & 0x07000000) >> 21;
+        qint32 dg = (flags_col & 0x00070000) >> 13;
+        qint32 db = (flags_col & 0x00000700) >> 5;
+        if (dr & 0x20) dr -= 0x40;
+        if (dg & 0x20) dg -= 0x40;
+        if (db & 0x20) db -= 0x40;
+
+        base[0][0] = r; base[0][1] = g; base[0][2] = b;
+        base[1][0] = r + dr; base[1][1] = g + dg; base[1][2] = b + db;
+
+        for (int s = 0; s < 2; s++)
+            for (int c = 0; c < 3; c++)
+                base[s][c] |= (base[s][c] >> 5);
+    }
+    else
+    {
+        base[0][0] = (flags_col & 0xF0000000) >> 24;
+        base[0][1] = (flags_col & 0x00F00000) >> 16;
+        base[0][2] = (flags_col & 0x0000F000) >> 8;
+        base[1][0] = (flags_col & 0x0F000000) >> 20;
+        base[1][1] = (flags_col & 0x000F0000) >> 12;
+        base[1][2] = (flags_col & 0x00000F00) >> 4;
+
+        for (int s = 0; s < 2; s++)
+            for (int c = 0; c < 3; c++)
+                base[s][c] |= (base[s][c] >> 4);
+    }
+
+    qint16 values[32];
+    for (int s = 0; s < 2; s++)
+    {
+        quint32 table = (flags_col >> (s ? 2 : 5)) & 0x7;
+        for (int code = 0; code < 4; code++)
+        {
+            qint32 mod = etc1_mod[table][code & 0x1];
+            if (code & 0x2) mod = -mod;
+
+            qint16* v = &values[(s*4 + code) * 4];
+            v[0] = base[s][0] + mod;
+            v[1] = base[s][1] + mod;
+            v[2] = base[s][2] + mod;
+            v[3] = 0;
+        }
+    }
+
+    clampPalette(values, &palette[0][0][0]);
+}
+
+void Etc1Decoder::decode(const quint8* src, quint32 width, quint32 height, bool alphaBlocks, QImage* tex)
+{
+    quint32 bpp = (tex->format() == QImage::Format_RGB888) ? 3 : 4;
+
+    for (quint32 y = 0; y < height; y += 8)
+    {
+        for (quint32 x = 0; x < width; x += 8)
+        {
+            for (quint32 ty = 0; ty < 8; ty += 4)
+            {
+                for (quint32 tx = 0; tx < 8; tx += 4)
+                {
+                    quint64 alpha = ~0ULL;
+                    if (alphaBlocks)
+                    {
+                        alpha = qFromLittleEndian<quint64>(src);
+                        src += 8;
+                    }
+
+                    quint32 subindexes = qFromLittleEndian<quint16>(src);
+                    quint32 negative = qFromLittleEndian<quint16>(src + 2);
+                    quint32 flags_col = qFromLittleEndian<quint32>(src + 4);
+                    src += 8;
+
+                    quint8 palette[2][4][4];
+                    etc1Palette(flags_col, palette);
+
+                    bool flip = flags_col & 0x1;
+
+                    // pixels are stored column by column
+                    for (quint32 sy = 0; sy < 4; sy++)
+                    {
+                        quint8* dst = tex->scanLine(y + ty + sy) + (x + tx) * bpp;
+
+                        for (quint32 sx = 0; sx < 4; sx++, dst += bpp)
+                        {
+                            quint32 i = sx*4 + sy;
+                            quint32 sub = (flip ? sy : sx) >> 1;
+                            quint32 code = (((negative >> i) & 0x1) << 1) | ((subindexes >> i) & 0x1);
+                            const quint8* col = palette[sub][code];
+
+                            if (bpp == 4)
+                            {
+                                quint32 a = (alpha >> (i*4)) & 0xF;
+                                dst[0] = col[0];
+                                dst[1] = col[1];
+                                dst[2] = col[2];
+                                dst[3] = a | (a << 4);
+                            }
+                            else
+                            {
+                                dst[0] = col[0];
+                                dst[1] = col[1];
+                                dst[2] = col[2];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
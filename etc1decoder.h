@@ -0,0 +1,16 @@
+#ifndef ETC1DECODER_H
+#define ETC1DECODER_H
+
+#include <QImage>
+
+// Decodes ETC1/ETC1A4 textures in CTPK tile order.
+// Each block's eight colours are worked out once, its pixels are lookups into them.
+class Etc1Decoder
+{
+public:
+    // src holds all blocks of a width x height texture, 16 bytes each with alpha, 8 without
+    // dst has to be width x height, RGBA8888 or RGB888, alpha comes out straight
+    static void decode(const quint8* src, quint32 width, quint32 height, bool alphaBlocks, QImage* dst);
+};
+
+#endif // ETC1DECODER_H
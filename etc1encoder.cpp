@@ -0,0 +1,149 @@
+#include "etc1encoder.h"
+
+#include <QtEndian>
+#include <cstring>
+
+Etc1Encoder::Etc1Encoder(const QImage& img, bool alpha, uint quality, bool dither, QObject* parent) :
+    QObject(parent)
+{
+    // straight RGBA bytes, read directly by the jobs
+    this->img = img.convertToFormat(QImage::Format_RGBA8888);
+    this->alpha = alpha;
+    this->quality = quality;
+    this->dither = dither;
+
+    if (quality == 0)
+        packParams.m_quality = rg_etc1::cLowQuality;
+    else if (quality == 1)
+        packParams.m_quality = rg_etc1::cMediumQuality;
+    else
+        packParams.m_quality = rg_etc1::cHighQuality;
+    packParams.m_dithering = dither;
+
+    output = QByteArray(encodedSize(img.width(), img.height(), alpha), '\0');
+    tileRows = img.height() / 8;
+
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+Etc1Encoder::~Etc1Encoder()
+{
+    cancel();
+    pool.waitForDone();
+}
+
+void Etc1Encoder::setReference(const QImage& refImg, const QByteArray& refData)
+{
+    // only usable if it has the exact same layout
+    if (refImg.size() != img.size() || refData.size() != output.size())
+        return;
+
+    this->refImg = refImg.convertToFormat(QImage::Format_RGBA8888);
+    this->refData = refData;
+}
+
+void Etc1Encoder::start()
+{
+    rowsDone = 0;
+    cancelled = 0;
+    reusedBlocks = 0;
+
+    if (tileRows == 0)
+    {
+        emit finished(true);
+        return;
+    }
+
+    for (int row = 0; row < tileRows; row++)
+        pool.start(QRunnable::create([this, row]() { encodeRow(row); }));
+}
+
+bool Etc1Encoder::encode()
+{
+    start();
+    return wait();
+}
+
+void Etc1Encoder::cancel()
+{
+    cancelled = 1;
+}
+
+bool Etc1Encoder::wait()
+{
+    pool.waitForDone();
+    return !isCancelled();
+}
+
+void Etc1Encoder::encodeRow(int row)
+{
+    if (!isCancelled())
+    {
+        quint32 blockSize = alpha ? 16 : 8;
+        quint8* dst = (quint8*)output.data() + row * (img.width()/8) * 4 * blockSize;
+
+        int y = row * 8;
+        for (int x = 0; x < img.width() && !isCancelled(); x += 8)
+        {
+            for (int ty = 0; ty < 8; ty += 4)
+            {
+                for (int tx = 0; tx < 8; tx += 4)
+                {
+                    if (!refData.isEmpty() && blockUnchanged(x+tx, y+ty))
+                    {
+                        qsizetype offset = dst - (quint8*)output.data();
+                        memcpy(dst, refData.constData() + offset, blockSize);
+                        dst += blockSize;
+                        reusedBlocks.ref();
+                        continue;
+                    }
+
+                    quint64 alphaData = 0;
+                    unsigned int packData[4*4];
+
+                    for (int sx = 0; sx < 4; sx++)
+                    {
+                        for (int sy = 0; sy < 4; sy++)
+                        {
+                            const uchar* p = img.constScanLine(y+ty+sy) + (x+tx+sx)*4;
+                            packData[sy*4 + sx] = (p[0]<<0) | (p[1]<<8) | (p[2]<<16) | (0xFF<<24);
+
+                            alphaData = (alphaData >> 4ULL) | (static_cast<quint64>(p[3] >> 4) << 60ULL);
+                        }
+                    }
+
+                    if (alpha)
+                    {
+                        qToLittleEndian<quint64>(alphaData, dst);
+                        dst += 8;
+                    }
+
+                    quint64 etc1block;
+                    rg_etc1::pack_etc1_block(&etc1block, packData, packParams);
+
+                    // same bytes the old write64(qbswap(block)) put in the file
+                    quint64 swapped = qbswap(etc1block);
+                    memcpy(dst, &swapped, 8);
+                    dst += 8;
+                }
+            }
+        }
+    }
+
+    int done = rowsDone.fetchAndAddOrdered(1) + 1;
+    emit progress(done * 100 / tileRows);
+
+    if (done == tileRows)
+        emit finished(!isCancelled());
+}
+
+bool Etc1Encoder::blockUnchanged(int x, int y)
+{
+    for (int sy = 0; sy < 4; sy++)
+    {
+        if (memcmp(img.constScanLine(y+sy) + x*4, refImg.constScanLine(y+sy) + x*4, 4*4) != 0)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef ETC1ENCODER_H
+#define ETC1ENCODER_H
+
+#include "rg_etc1.h"
+
+#include <QObject>
+#include <QImage>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+// Encodes an image to ETC1/ETC1A4 in CTPK tile order.
+// Every row of 8x8 tiles is its own job on a thread pool, writing into a preallocated buffer.
+class Etc1Encoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    Etc1Encoder(const QImage& img, bool alpha, uint quality = 1, bool dither = false, QObject* parent = nullptr);
+    ~Etc1Encoder(); // cancels and waits for running jobs
+
+    void start();   // returns right away, finished() tells when it's done
+    bool encode();  // blocking, false if cancelled
+    void cancel();
+    bool wait();
+
+    bool isCancelled() { return cancelled.loadAcquire() != 0; }
+
+    // blocks whose pixels are the same as in refImg keep their data from refData, has to be called before start()
+    void setReference(const QImage& refImg, const QByteArray& refData);
+    int getReusedBlocks() { return reusedBlocks.loadRelaxed(); }
+    int getTotalBlocks() { return (img.width()/4) * (img.height()/4); }
+
+    // the straight RGBA source that gets encoded
+    const QImage& getSource() { return img; }
+    bool hasAlpha() { return alpha; }
+    uint getQuality() { return quality; }
+    bool getDither() { return dither; }
+
+    // only complete after finished(true)
+    const QByteArray& result() { return output; }
+
+    static quint32 encodedSize(int width, int height, bool alpha) { return (width/4) * (height/4) * (alpha ? 16 : 8); }
+
+signals:
+    // both are emitted from worker threads
+    void progress(int percent);
+    void finished(bool success);
+
+private:
+    QImage img;
+    bool alpha;
+    uint quality;
+    bool dither;
+    rg_etc1::etc1_pack_params packParams;
+
+    QByteArray output;
+    int tileRows;
+
+    QImage refImg;
+    QByteArray refData;
+    QAtomicInt reusedBlocks;
+
+    QThreadPool pool;
+    QAtomicInt rowsDone;
+    QAtomicInt cancelled;
+
+    void encodeRow(int row);
+    bool blockUnchanged(int x, int y);
+};
+
+#endif // ETC1ENCODER_H
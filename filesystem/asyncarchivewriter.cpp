@@ -0,0 +1,125 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "asyncarchivewriter.h"
+
+#include <QSaveFile>
+
+AsyncArchiveWriter::AsyncArchiveWriter(QString path, QObject* parent) :
+    QObject(parent)
+{
+    this->path = path;
+}
+
+AsyncArchiveWriter::~AsyncArchiveWriter()
+{
+    waitForFinished();
+}
+
+void AsyncArchiveWriter::write(const FileBytes& snapshot)
+{
+    if (worker)
+    {
+        pending = snapshot;
+        hasPending = true;
+        return;
+    }
+
+    startWrite(snapshot);
+}
+
+void AsyncArchiveWriter::waitForFinished()
+{
+    while (worker)
+    {
+        worker->wait();
+        writeDone();
+    }
+}
+
+void AsyncArchiveWriter::startWrite(const FileBytes& snapshot)
+{
+    writeOk = false;
+    writeError.clear();
+
+    worker = QThread::create([this, snapshot]() { writeSnapshot(snapshot); });
+    connect(worker, &QThread::finished, this, &AsyncArchiveWriter::writeDone);
+    worker->start();
+}
+
+// runs on the worker thread
+void AsyncArchiveWriter::writeSnapshot(const FileBytes& image)
+{
+    QByteArray snapshot;
+    if (compression != Lz11::None)
+        snapshot = Lz11::compress(image.data(), image.size(), compression);
+    else
+        snapshot = QByteArray::fromRawData(image.constData(), image.size());
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        writeError = file.errorString();
+        return;
+    }
+
+    const qint64 chunkSize = 256*1024;
+    qint64 written = 0;
+    while (written < snapshot.size())
+    {
+        qint64 len = qMin(chunkSize, snapshot.size() - written);
+        if (file.write(snapshot.constData() + written, len) != len)
+        {
+            writeError = file.errorString();
+            file.cancelWriting();
+            return;
+        }
+
+        written += len;
+        emit progress((int)(written * 100 / snapshot.size()));
+    }
+
+    // flushes and fsyncs the temp file, then renames it over the original
+    if (!file.commit())
+    {
+        writeError = file.errorString();
+        return;
+    }
+
+    writeOk = true;
+}
+
+void AsyncArchiveWriter::writeDone()
+{
+    // may already have been handled by waitForFinished()
+    if (!worker || !worker->isFinished())
+        return;
+
+    worker->wait();
+    delete worker;
+    worker = nullptr;
+
+    bool ok = writeOk;
+    QString error = writeError;
+
+    if (hasPending)
+    {
+        hasPending = false;
+        startWrite(pending);
+        pending = FileBytes();
+    }
+
+    emit finished(ok, error);
+}
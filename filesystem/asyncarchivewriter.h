@@ -0,0 +1,69 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef ASYNCARCHIVEWRITER_H
+#define ASYNCARCHIVEWRITER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QThread>
+
+#include "lz11.h"
+#include "fileblock.h"
+
+// Writes archive snapshots to disk on a worker thread.
+// Each snapshot goes to a temp file next to the target, gets fsynced and is
+// then renamed over the original, so a crash leaves either the old or the new file.
+class AsyncArchiveWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    AsyncArchiveWriter(QString path, QObject* parent = nullptr);
+    ~AsyncArchiveWriter(); // finishes any pending write first
+
+    // the snapshot is queued if a write is still running, only the newest one is kept
+    // the writer holds on to the bytes until it's done, the file they came from copies them if it changes meanwhile
+    void write(const FileBytes& snapshot);
+
+    // snapshots get compressed on the worker thread before being written
+    void setCompression(Lz11::Format format) { compression = format; }
+
+    bool isBusy() { return worker != nullptr; }
+    void waitForFinished();
+
+signals:
+    void progress(int percent);
+    void finished(bool success, QString error);
+
+private:
+    QString path;
+    Lz11::Format compression = Lz11::None;
+
+    QThread* worker = nullptr;
+    FileBytes pending;
+    bool hasPending = false;
+
+    // results of the last write, set by the worker
+    bool writeOk = false;
+    QString writeError;
+
+    void startWrite(const FileBytes& snapshot);
+    void writeSnapshot(const FileBytes& image);
+    void writeDone();
+};
+
+#endif // ASYNCARCHIVEWRITER_H
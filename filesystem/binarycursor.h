@@ -0,0 +1,188 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef BINARYCURSOR_H
+#define BINARYCURSOR_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtEndian>
+#include <cstring>
+
+#include "fileblock.h"
+
+// Non-virtual reader over a contiguous block (usually from FileBase::peek()).
+// Reads past the end return zeroes, like reading past the end of a MemoryFile.
+template <bool BigEndian = false>
+class BinaryCursor
+{
+public:
+    BinaryCursor(const quint8* data, quint64 size) : data(data), _size(size), _pos(0) {}
+    BinaryCursor(const QByteArray& block) : data((const quint8*)block.constData()), _size(block.size()), _pos(0) {}
+    BinaryCursor(const FileBytes& block) : data(block.data()), _size(block.size()), _pos(0) {}
+
+    quint64 pos() const { return _pos; }
+    quint64 size() const { return _size; }
+    bool atEnd() const { return _pos >= _size; }
+    void seek(quint64 pos) { _pos = pos; }
+    void skip(qint64 num) { _pos += num; }
+
+    const quint8* current() const { return data + _pos; }
+    bool has(quint64 len) const { return _pos <= _size && len <= _size - _pos; }
+
+    quint8 read8()
+    {
+        if (!has(1)) { _pos++; return 0; }
+        return data[_pos++];
+    }
+
+    quint16 read16() { return readValue<quint16>(); }
+    quint32 read32() { return readValue<quint32>(); }
+    quint64 read64() { return readValue<quint64>(); }
+
+    float readFloat()
+    {
+        quint32 bin = read32();
+        float ret;
+        memcpy(&ret, &bin, 4);
+        return ret;
+    }
+
+    quint64 readData(quint8* out, quint64 len)
+    {
+        if (!has(len))
+            len = (_pos < _size) ? _size - _pos : 0;
+
+        memcpy(out, data + _pos, len);
+        _pos += len;
+        return len;
+    }
+
+    quint32 readStringASCII(QString& ret, quint32 len=0) // len=0 for NULL terminated string
+    {
+        quint64 avail = (_pos < _size) ? _size - _pos : 0;
+        quint64 max = len ? qMin<quint64>(len, avail) : avail;
+
+        const char* str = (const char*)(data + _pos);
+        quint32 actuallen = 0;
+        while (actuallen < max && str[actuallen])
+            actuallen++;
+
+        ret = QString::fromLatin1(str, actuallen);
+
+        // fixed length fields are skipped entirely, terminated strings include the NULL
+        _pos += len ? len : actuallen + 1;
+        return actuallen;
+    }
+
+private:
+    const quint8* data;
+    quint64 _size;
+    quint64 _pos;
+
+    template <typename T> T readValue()
+    {
+        if (!has(sizeof(T))) { _pos += sizeof(T); return 0; }
+
+        T ret;
+        if constexpr (BigEndian)
+            ret = qFromBigEndian<T>(data + _pos);
+        else
+            ret = qFromLittleEndian<T>(data + _pos);
+
+        _pos += sizeof(T);
+        return ret;
+    }
+};
+
+// Counterpart to BinaryCursor: builds a whole block in memory,
+// which then goes to the file with a single FileBase::writeBlock().
+template <bool BigEndian = false>
+class BinaryWriter
+{
+public:
+    BinaryWriter(quint64 size = 0) : buf(size, '\0'), _pos(0) {}
+
+    quint64 pos() const { return _pos; }
+    quint64 size() const { return buf.size(); }
+    void seek(quint64 pos) { _pos = pos; }
+    void skip(qint64 num) { _pos += num; }
+
+    const QByteArray& block() const { return buf; }
+
+    void write8(quint8 val) { writeData(&val, 1); }
+    void write16(quint16 val) { writeValue<quint16>(val); }
+    void write32(quint32 val) { writeValue<quint32>(val); }
+    void write64(quint64 val) { writeValue<quint64>(val); }
+
+    void writeFloat(float val)
+    {
+        quint32 bin;
+        memcpy(&bin, &val, 4);
+        write32(bin);
+    }
+
+    void writeZeroes(quint64 len)
+    {
+        reserve(len);
+        memset(buf.data() + _pos, 0, len);
+        _pos += len;
+    }
+
+    void writeData(const quint8* data, quint64 len)
+    {
+        reserve(len);
+        memcpy(buf.data() + _pos, data, len);
+        _pos += len;
+    }
+
+    void writeStringASCII(QString str, int len=0) // len=0 for NULL terminated string
+    {
+        if (len == 0)
+            len = str.length() + 1;
+
+        QByteArray latin = str.left(len).toLatin1();
+        writeData((const quint8*)latin.constData(), latin.size());
+        writeZeroes(len - latin.size());
+    }
+
+private:
+    QByteArray buf;
+    quint64 _pos;
+
+    void reserve(quint64 len)
+    {
+        quint64 oldSize = buf.size();
+        if (_pos + len > oldSize)
+        {
+            buf.resize(_pos + len);
+            memset(buf.data() + oldSize, 0, _pos + len - oldSize);
+        }
+    }
+
+    template <typename T> void writeValue(T val)
+    {
+        reserve(sizeof(T));
+
+        if constexpr (BigEndian)
+            qToBigEndian<T>(val, buf.data() + _pos);
+        else
+            qToLittleEndian<T>(val, buf.data() + _pos);
+
+        _pos += sizeof(T);
+    }
+};
+
+#endif // BINARYCURSOR_H
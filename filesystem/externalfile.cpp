@@ -21,6 +21,7 @@ ExternalFile::ExternalFile(FilesystemBase *fs, QString path)
 {
     parent = fs;
     file = new QFile(path);
+    _pos = 0;
 
     openCount = 0;
 }
@@ -29,70 +30,210 @@ ExternalFile::ExternalFile(FilesystemBase* fs)
 {
     parent = fs;
     file = new QTemporaryFile();
+    _pos = 0;
 
     openCount = 0;
 }
 
 ExternalFile::~ExternalFile()
 {
+    QMutexLocker locker(&fileLock);
+    unmap();
     delete file;
 }
 
 
 void ExternalFile::open()
 {
+    QMutexLocker locker(&fileLock);
+
     if (openCount == 0)
+    {
         file->open(QIODevice::ReadWrite);
+        map();
+    }
 
     openCount++;
 }
 
 void ExternalFile::save()
 {
+    fileLock.lock();
     file->flush();
+    fileLock.unlock();
+
     if (parent) parent->save(this); // we never know
 }
 
 void ExternalFile::close()
 {
-    openCount--;
-    if (openCount == 0)
+    QMutexLocker locker(&fileLock);
+
+    int count = --openCount;
+    if (count == 0)
     {
         file->close();
         //if (parent) parent->save(this); // we never know
     }
 
-    if (openCount < 0)
+    if (count < 0)
         throw std::logic_error("MemoryFile: openCount<0");
 }
 
+void ExternalFile::map()
+{
+    if (mapping)
+        return;
+
+    // nobody can change the file in place between reading its size and mapping it
+    QMutexLocker mappingLocker(&FileBlock::mappingLock);
+
+    quint64 fileSize = file->size();
+    if (fileSize == 0)
+        return;
+
+    // separate handle, so the mapping outlives close()
+    QFile* mapFile = new QFile(file->fileName());
+    uchar* mapped = NULL;
+    if (mapFile->open(QIODevice::ReadOnly))
+        mapped = mapFile->map(0, fileSize, QFileDevice::MapPrivateOption);
+
+    if (!mapped)
+    {
+        delete mapFile;
+        return;
+    }
+
+    mapping.reset(new FileBlock(mapFile, mapped, fileSize));
+}
+
+void ExternalFile::unmap()
+{
+    mapping.reset();
+}
+
+void ExternalFile::beginWrite()
+{
+    // peeks and views of this file or any other ExternalFile on the same path
+    // keep what they have, and this one reads the file itself from now on
+    FileBlock::privatizeMappings(file->fileName());
+    unmap();
+}
+
+FileBytes ExternalFile::mapData()
+{
+#ifdef Q_OS_WIN
+    // windows won't resize a file that is still mapped, so the mapping is never handed out
+    return FileBytes();
+#else
+    QMutexLocker locker(&fileLock);
+
+    if (!mapping)
+        return FileBytes();
+
+    return FileBytes(mapping, 0, mapping->size);
+#endif
+}
+
 quint64 ExternalFile::readData(quint8* data, quint64 len)
 {
-    return file->read((char*)data, len);
+    QMutexLocker locker(&fileLock);
+
+    if (mapping)
+    {
+        if (_pos >= mapping->size)
+            return 0;
+
+        if ((_pos+len) > mapping->size)
+            len = mapping->size-_pos;
+
+        memcpy(data, mapping->data+_pos, len);
+        _pos += len;
+        return len;
+    }
+
+    if ((quint64)file->pos() != _pos)
+        file->seek(_pos);
+
+    qint64 ret = file->read((char*)data, len);
+    if (ret < 0)
+        return 0;
+
+    _pos += ret;
+    return ret;
+}
+
+quint64 ExternalFile::readAt(quint64 offset, quint8* data, quint64 len)
+{
+    QMutexLocker locker(&fileLock);
+
+    if (mapping)
+    {
+        if (offset >= mapping->size)
+            return 0;
+
+        if ((offset+len) > mapping->size)
+            len = mapping->size-offset;
+
+        memcpy(data, mapping->data+offset, len);
+        return len;
+    }
+
+    // readData() seeks the QFile back to _pos itself
+    if (!file->seek(offset))
+        return 0;
+
+    qint64 ret = file->read((char*)data, len);
+    if (ret < 0)
+        return 0;
+
+    return ret;
 }
 
 quint64 ExternalFile::writeData(quint8* data, quint64 len)
 {
-    return file->write((const char*)data, len);
+    QMutexLocker locker(&fileLock);
+    QMutexLocker mappingLocker(&FileBlock::mappingLock);
+
+    beginWrite();
+
+    if ((quint64)file->pos() != _pos)
+        file->seek(_pos);
+
+    qint64 ret = file->write((const char*)data, len);
+    if (ret < 0)
+        return 0;
+
+    _pos += ret;
+    return ret;
 }
 
 quint64 ExternalFile::pos()
 {
-    return file->pos();
+    return _pos;
 }
 
 bool ExternalFile::seek(quint64 pos)
 {
-    return file->seek(pos);
+    _pos = pos;
+    return true;
 }
 
 quint64 ExternalFile::size()
 {
+    QMutexLocker locker(&fileLock);
+
+    if (mapping)
+        return mapping->size;
+
     return file->size();
 }
 
 bool ExternalFile::resize(quint64 size)
 {
+    QMutexLocker locker(&fileLock);
+    QMutexLocker mappingLocker(&FileBlock::mappingLock);
+
+    beginWrite();
     return file->resize(size);
 }
-
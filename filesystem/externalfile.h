@@ -36,9 +36,24 @@ public:
     quint64 size();
     bool resize(quint64 size);
 
+    quint64 readAt(quint64 offset, quint8* data, quint64 len);
+    FileBytes mapData();
+
 
 private:
     QFile* file;
+    quint64 _pos;
+
+    QMutex fileLock; // guards file and the mapping
+
+    // private mapping of the file, dropped as soon as it gets written to
+    // whoever still holds it after that gets the old contents
+    FileBlockRef mapping;
+
+    // fileLock has to be held for these
+    void map();
+    void unmap();
+    void beginWrite(); // FileBlock::mappingLock too, until the write is done
 };
 
 #endif // EXTERNALFILE_H
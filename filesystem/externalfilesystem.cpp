@@ -92,5 +92,5 @@ bool ExternalFilesystem::copyFile(QString path, QString newPath)
 {
     QFile file(basepath + path);
     if (!file.exists()) return false;
-    return file.copy(newPath);
+    return file.copy(basepath + newPath);
 }
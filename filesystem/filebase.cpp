@@ -17,14 +17,19 @@
 
 #include "filesystem.h"
 
-
 FileBase* FileBase::getSubfile(FilesystemBase* container, quint64 offset, quint64 size)
 {
     open();
-    seek(offset);
     FileBase* ret;
 
-    if (size >= 32*1024*1024)
+    FileBytes mapped = mapData();
+
+    if (!mapped.isNull() && (offset+size) <= mapped.size())
+    {
+        // view into our data, only copied once it gets written to
+        ret = new MemoryFile(container, mapped.mid(offset, size));
+    }
+    else if (size >= 32*1024*1024)
     {
         // backed by temporary file
         ret = new ExternalFile(container);
@@ -39,7 +44,7 @@ FileBase* FileBase::getSubfile(FilesystemBase* container, quint64 offset, quint6
             quint64 toread = 4096;
             if ((pos+toread) > size) toread = size-pos;
 
-            readData(tempbuf, toread);
+            readAt(offset+pos, tempbuf, toread);
             ret->writeData(tempbuf, toread);
             pos += toread;
         }
@@ -51,7 +56,7 @@ FileBase* FileBase::getSubfile(FilesystemBase* container, quint64 offset, quint6
     {
         // backed by memory
         quint8* data = new quint8[size];
-        readData(data, size);
+        readAt(offset, data, size);
         ret = new MemoryFile(container, data, size);
     }
 
@@ -19,6 +19,12 @@
 #define FILEBASE
 
 #include <QString>
+#include <QList>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QMutex>
+
+#include "fileblock.h"
 
 class FileBase
 {
@@ -36,6 +42,23 @@ public:
     virtual quint64 size()=0;
     virtual bool resize(quint64 size)=0;
 
+    // reads at a fixed offset without touching pos(), safe to call from several threads at once
+    // (writing the same file at the same time is not)
+    virtual quint64 readAt(quint64 offset, quint8* data, quint64 len)
+    {
+        QMutexLocker locker(&ioLock);
+
+        quint64 oldPos = pos();
+        seek(offset);
+        quint64 ret = readData(data, len);
+        seek(oldPos);
+        return ret;
+    }
+
+    // the whole file as one contiguous read-only block shared with the caller, or null if
+    // the file can't provide that (subfiles then point into it instead of copying)
+    virtual FileBytes mapData() { return FileBytes(); }
+
 
     // conveniency
 
@@ -157,6 +180,58 @@ public:
     }
 
 
+    // bulk access, meant to be walked with a BinaryCursor
+
+    // up to len bytes from the current position, without moving it
+    // shares the file's data if it's mapped, the bytes stay as they are even if the file changes
+    FileBytes peek(quint64 len)
+    {
+        quint64 start = pos();
+        quint64 fileSize = size();
+        if (start >= fileSize)
+            return FileBytes();
+        if (start+len > fileSize)
+            len = fileSize-start;
+
+        FileBytes mapped = mapData();
+        if (!mapped.isNull())
+            return mapped.mid(start, len);
+
+        FileBlockRef block(new FileBlock(len));
+        len = readData(block->data, len);
+        seek(start);
+        return FileBytes(block, 0, len);
+    }
+
+    // like peek(), but positional, see readAt()
+    FileBytes peekAt(quint64 offset, quint64 len)
+    {
+        quint64 fileSize = size();
+        if (offset >= fileSize)
+            return FileBytes();
+        if (offset+len > fileSize)
+            len = fileSize-offset;
+
+        FileBytes mapped = mapData();
+        if (!mapped.isNull())
+            return mapped.mid(offset, len);
+
+        FileBlockRef block(new FileBlock(len));
+        len = readAt(offset, block->data, len);
+        return FileBytes(block, 0, len);
+    }
+
+    quint64 readInto(QByteArray& block)
+    {
+        return readData((quint8*)block.data(), block.size());
+    }
+
+    quint64 writeBlock(const QByteArray& block)
+    {
+        return writeData((quint8*)block.constData(), block.size());
+    }
+
+
     FileBase* getSubfile(FilesystemBase* container, quint64 offset, quint64 size);
 
 
@@ -176,9 +251,9 @@ public:
         return idPath;
     }
 
-    int& getOpenCount()
+    int getOpenCount()
     {
-        return openCount;
+        return openCount.loadAcquire();
     }
 
 
@@ -186,7 +261,9 @@ protected:
     FilesystemBase* parent;
     QString idPath; // identifies the file in its parent FS
 
-    int openCount;
+    QAtomicInt openCount;
+
+    QMutex ioLock; // only for the fallback readAt()
 };
 
 
@@ -0,0 +1,91 @@
+#include "fileblock.h"
+
+#include <QFileInfo>
+#include <QMultiHash>
+#include <cstring>
+
+QRecursiveMutex FileBlock::mappingLock;
+
+// every live mapping by the file it maps, guarded by mappingLock
+static QMultiHash<QString, FileBlock*> mappedBlocks;
+
+static QString mappingKey(const QString& fileName)
+{
+    QFileInfo info(fileName);
+    QString path = info.canonicalFilePath();
+    return path.isEmpty() ? info.absoluteFilePath() : path;
+}
+
+FileBlock::FileBlock(quint64 size) :
+    data(size ? new quint8[size] : nullptr), size(size), mapFile(nullptr), privatized(false)
+{
+}
+
+FileBlock::FileBlock(quint8* buffer, quint64 size) :
+    data(buffer), size(size), mapFile(nullptr), privatized(false)
+{
+}
+
+FileBlock::FileBlock(QFile* mapFile, uchar* mapping, quint64 size) :
+    data(mapping), size(size), mapFile(mapFile), privatized(false)
+{
+    QMutexLocker locker(&mappingLock);
+    mapPath = mappingKey(mapFile->fileName());
+    mappedBlocks.insert(mapPath, this);
+}
+
+FileBlock::~FileBlock()
+{
+    if (mapFile)
+    {
+        QMutexLocker locker(&mappingLock);
+        mappedBlocks.remove(mapPath, this);
+
+        mapFile->unmap(data);
+        delete mapFile;
+    }
+    else
+        delete[] data;
+}
+
+void FileBlock::privatize()
+{
+    if (!mapFile || privatized)
+        return;
+
+    // writing a byte back copies its page, 4K is the smallest page size around
+    volatile quint8* bytes = data;
+    for (quint64 i = 0; i < size; i += 4096)
+        bytes[i] = bytes[i];
+
+    privatized = true;
+}
+
+void FileBlock::privatizeMappings(const QString& fileName)
+{
+    QList<FileBlock*> blocks = mappedBlocks.values(mappingKey(fileName));
+    foreach (FileBlock* block, blocks)
+        block->privatize();
+}
+
+FileBytes FileBytes::mid(quint64 offset, quint64 len) const
+{
+    if (offset >= this->len)
+        return FileBytes();
+
+    if (len > this->len - offset)
+        len = this->len - offset;
+
+    FileBytes ret(*this);
+    ret.ptr += offset;
+    ret.len = len;
+    return ret;
+}
+
+bool FileBytes::operator==(const FileBytes& other) const
+{
+    if (len != other.len)
+        return false;
+
+    return ptr == other.ptr || len == 0 || memcmp(ptr, other.ptr, len) == 0;
+}
@@ -0,0 +1,79 @@
+#ifndef FILEBLOCK_H
+#define FILEBLOCK_H
+
+#include <QSharedData>
+#include <QExplicitlySharedDataPointer>
+#include <QByteArray>
+#include <QFile>
+#include <QRecursiveMutex>
+
+// Bytes a file's data lives in, either a heap buffer or a mapping of a file on disk.
+// Every file and every peek() result pointing into a block holds a reference to it,
+// so a file that is about to change a block someone else still holds makes its own copy
+// and the others keep reading the old contents, without any locking on the read side.
+class FileBlock : public QSharedData
+{
+public:
+    FileBlock(quint64 size); // uninitialized
+    FileBlock(quint8* buffer, quint64 size); // takes over a new[] buffer
+    FileBlock(QFile* mapFile, uchar* mapping, quint64 size); // takes over both, has to be a private mapping
+    ~FileBlock();
+    FileBlock(const FileBlock&) = delete;
+    FileBlock& operator=(const FileBlock&) = delete;
+
+    quint8* data;
+    quint64 size;
+
+    bool isMapped() const { return mapFile != nullptr; }
+    bool isShared() const { return ref.loadAcquire() > 1; }
+
+    // gives every page of a mapping its own private copy, so they keep the current
+    // contents after the file underneath gets rewritten or truncated
+    void privatize();
+
+    // a private mapping still follows changes to pages it hasn't copied yet, whoever made them.
+    // Files get mapped and changed in place with mappingLock held, and the change privatizes
+    // every mapping of the file first, so none of them sees it or faults past a new end
+    static QRecursiveMutex mappingLock;
+    static void privatizeMappings(const QString& fileName); // mappingLock has to be held
+
+private:
+    QFile* mapFile;
+    QString mapPath; // key in the list of mappings
+    bool privatized;
+};
+
+typedef QExplicitlySharedDataPointer<FileBlock> FileBlockRef;
+
+
+// A range of bytes that stays valid for as long as the FileBytes is around.
+class FileBytes
+{
+public:
+    FileBytes() : ptr(nullptr), len(0) {}
+    FileBytes(const FileBlockRef& block, quint64 offset, quint64 len) : block(block), ptr(block->data + offset), len(len) {}
+
+    // bytes nobody shares ownership of, whoever passes them keeps them alive
+    FileBytes(const quint8* data, quint64 len) : ptr(data), len(len) {}
+
+    const quint8* data() const { return ptr; }
+    const char* constData() const { return (const char*)ptr; }
+    quint64 size() const { return len; }
+    bool isNull() const { return ptr == nullptr; }
+
+    // the block the bytes are in, null for unowned bytes
+    const FileBlockRef& getBlock() const { return block; }
+
+    FileBytes mid(quint64 offset, quint64 len) const;
+    QByteArray toByteArray() const { return QByteArray(constData(), len); }
+
+    bool operator==(const FileBytes& other) const;
+    bool operator!=(const FileBytes& other) const { return !(*this == other); }
+
+private:
+    FileBlockRef block;
+    const quint8* ptr;
+    quint64 len;
+};
+
+#endif // FILEBLOCK_H
@@ -26,14 +26,18 @@ class FilesystemBase;
 class ExternalFile;
 class MemoryFile;
 
+#include "fileblock.h"
 #include "filebase.h"
+#include "binarycursor.h"
 #include "filesystembase.h"
 
 #include "externalfile.h"
 #include "memoryfile.h"
+#include "lzfile.h"
 
 #include "externalfilesystem.h"
 #include "sarcfilesystem.h"
+#include "asyncarchivewriter.h"
 
 #endif // FILESYSTEM_H
 
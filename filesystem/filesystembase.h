@@ -35,6 +35,36 @@ public:
     virtual bool renameDir(QString path, QString newName)=0;
 
     virtual bool copyFile(QString path, QString newPath)=0;
+
+    // group several modifications so they are written out only once
+    // (filesystems that write through immediately can ignore these)
+    // rolling back drops everything done since the outermost beginTransaction()
+    // once that one ends, commitTransaction() then returns false
+    virtual void beginTransaction() {}
+    virtual bool commitTransaction() { return true; }
+    virtual void rollbackTransaction() {}
+};
+
+
+// Transaction on a filesystem for the current scope.
+// Rolled back when it goes out of scope without commit(), like when something throws halfway.
+class FilesystemTransaction
+{
+public:
+    FilesystemTransaction(FilesystemBase* fs) : fs(fs) { fs->beginTransaction(); }
+    ~FilesystemTransaction() { if (fs) fs->rollbackTransaction(); }
+    FilesystemTransaction(const FilesystemTransaction&) = delete;
+    FilesystemTransaction& operator=(const FilesystemTransaction&) = delete;
+
+    bool commit()
+    {
+        FilesystemBase* committing = fs;
+        fs = nullptr;
+        return committing->commitTransaction();
+    }
+
+private:
+    FilesystemBase* fs;
 };
 
 
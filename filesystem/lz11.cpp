@@ -0,0 +1,333 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "lz11.h"
+
+#include <QThread>
+#include <cstring>
+
+Lz11::Format Lz11::detect(const quint8* src, quint64 len, quint32* size, quint32* headerSize)
+{
+    Format format = None;
+    quint32 skip = 0;
+
+    if (len >= 8 && src[0] == 0x13 && src[4] == 0x11)
+    {
+        format = LZ13;
+        skip = 4;
+    }
+    else if (len >= 4 && src[0] == 0x11)
+        format = LZ11;
+    else
+        return None;
+
+    const quint8* hdr = src + skip;
+    quint32 outSize = hdr[1] | (hdr[2] << 8) | (hdr[3] << 16);
+    quint32 hdrSize = skip + 4;
+
+    if (outSize == 0)
+    {
+        if (len < skip + 8)
+            return None;
+
+        outSize = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((quint32)hdr[7] << 24);
+        hdrSize += 4;
+    }
+
+    if (outSize == 0)
+        return None;
+
+    if (size) *size = outSize;
+    if (headerSize) *headerSize = hdrSize;
+    return format;
+}
+
+bool Lz11::decompress(const quint8* src, quint64 len, quint8* dst, quint32 dstSize)
+{
+    quint32 headerSize;
+    if (detect(src, len, NULL, &headerSize) == None)
+        return false;
+
+    const quint8* in = src + headerSize;
+    const quint8* inEnd = src + len;
+    quint8* out = dst;
+    quint8* outEnd = dst + dstSize;
+
+    while (out < outEnd)
+    {
+        if (in >= inEnd)
+            return false;
+
+        quint8 flags = *in++;
+
+        for (int i = 0; i < 8 && out < outEnd; i++, flags <<= 1)
+        {
+            if (!(flags & 0x80))
+            {
+                if (in >= inEnd)
+                    return false;
+
+                *out++ = *in++;
+                continue;
+            }
+
+            if (inEnd - in < 2)
+                return false;
+
+            quint32 b0 = in[0];
+            quint32 matchLen, disp;
+
+            switch (b0 >> 4)
+            {
+            case 0:
+                if (inEnd - in < 3)
+                    return false;
+                matchLen = (((b0 & 0xF) << 4) | (in[1] >> 4)) + 0x11;
+                disp = (((in[1] & 0xF) << 8) | in[2]) + 1;
+                in += 3;
+                break;
+
+            case 1:
+                if (inEnd - in < 4)
+                    return false;
+                matchLen = (((b0 & 0xF) << 12) | (in[1] << 4) | (in[2] >> 4)) + 0x111;
+                disp = (((in[2] & 0xF) << 8) | in[3]) + 1;
+                in += 4;
+                break;
+
+            default:
+                matchLen = (b0 >> 4) + 1;
+                disp = (((b0 & 0xF) << 8) | in[1]) + 1;
+                in += 2;
+                break;
+            }
+
+            if (disp > (quint32)(out - dst))
+                return false;
+
+            if (matchLen > (quint32)(outEnd - out))
+                matchLen = outEnd - out;
+
+            const quint8* from = out - disp;
+            if (disp >= matchLen)
+                memcpy(out, from, matchLen);
+            else
+            {
+                // overlapping run, has to go byte by byte
+                for (quint32 j = 0; j < matchLen; j++)
+                    out[j] = from[j];
+            }
+
+            out += matchLen;
+        }
+    }
+
+    return true;
+}
+
+void Lz11::findTokens(const quint8* src, quint32 len, quint32 start, quint32 end, QList<quint32>& tokens)
+{
+    const int hashBits = 14;
+    const quint32 windowMask = windowSize - 1;
+    const int maxChain = 64;
+
+    QList<qint32> head(1 << hashBits, -1);
+    QList<qint32> prev(windowSize, -1);
+
+    auto hash3 = [src](quint32 p)
+    {
+        quint32 v = (src[p] << 16) | (src[p+1] << 8) | src[p+2];
+        return (v * 2654435761u) >> (32 - hashBits);
+    };
+
+    auto insert = [&](quint32 p)
+    {
+        if (p + 3 > len)
+            return;
+
+        quint32 h = hash3(p);
+        prev[p & windowMask] = head[h];
+        head[h] = p;
+    };
+
+    // data in front of the chunk can still be referenced
+    for (quint32 p = (start > windowSize) ? start - windowSize : 0; p < start; p++)
+        insert(p);
+
+    quint32 pos = start;
+    while (pos < end)
+    {
+        quint32 bestLen = 0;
+        quint32 bestDisp = 0;
+
+        if (pos + 3 <= end)
+        {
+            // matches stop at the chunk end, so the next chunk starts where it expects to
+            quint32 limit = qMin(maxMatch, end - pos);
+
+            qint32 cand = head[hash3(pos)];
+            for (int chain = 0; chain < maxChain && cand >= 0 && pos - cand <= windowSize; chain++)
+            {
+                const quint8* a = src + cand;
+                const quint8* b = src + pos;
+
+                quint32 l = 0;
+                while (l < limit && a[l] == b[l])
+                    l++;
+
+                if (l > bestLen)
+                {
+                    bestLen = l;
+                    bestDisp = pos - cand;
+                    if (l == limit)
+                        break;
+                }
+
+                qint32 next = prev[cand & windowMask];
+                if (next >= cand) // slot was reused by a newer position
+                    break;
+                cand = next;
+            }
+        }
+
+        if (bestLen >= 3)
+        {
+            tokens.append((bestLen << 12) | (bestDisp - 1));
+            for (quint32 i = 0; i < bestLen; i++)
+                insert(pos + i);
+            pos += bestLen;
+        }
+        else
+        {
+            tokens.append(0);
+            insert(pos);
+            pos++;
+        }
+    }
+}
+
+QByteArray Lz11::compress(const quint8* src, quint32 len, Format format)
+{
+    // split the match finding into chunks, each one can look back into the previous one
+    const quint32 minChunk = 0x10000;
+    int numChunks = qBound(1, (int)(len / minChunk), qMax(1, QThread::idealThreadCount()));
+    quint32 chunkSize = (len + numChunks - 1) / numChunks;
+
+    QList<QList<quint32>> chunkTokens(numChunks);
+    QList<QThread*> workers;
+
+    for (int i = 1; i < numChunks; i++)
+    {
+        quint32 start = i * chunkSize;
+        quint32 end = qMin(len, start + chunkSize);
+        QList<quint32>* tokens = &chunkTokens[i];
+
+        QThread* worker = QThread::create([=]() { findTokens(src, len, start, end, *tokens); });
+        worker->start();
+        workers.append(worker);
+    }
+
+    findTokens(src, len, 0, qMin(len, chunkSize), chunkTokens[0]);
+
+    foreach (QThread* worker, workers)
+    {
+        worker->wait();
+        delete worker;
+    }
+
+
+    QByteArray out;
+    out.reserve(len / 2 + 16);
+
+    if (format == LZ13)
+    {
+        out.append((char)0x13);
+        out.append((char)(len & 0xFF));
+        out.append((char)((len >> 8) & 0xFF));
+        out.append((char)((len >> 16) & 0xFF));
+    }
+
+    out.append((char)0x11);
+    if (len < 0x1000000)
+    {
+        out.append((char)(len & 0xFF));
+        out.append((char)((len >> 8) & 0xFF));
+        out.append((char)((len >> 16) & 0xFF));
+    }
+    else
+    {
+        out.append(3, (char)0);
+        for (int i = 0; i < 4; i++)
+            out.append((char)((len >> (i*8)) & 0xFF));
+    }
+
+    // the token streams of all chunks go into one run of flag groups
+    quint32 pos = 0;
+    int flagPos = -1;
+    int flagBit = 8;
+
+    for (int c = 0; c < numChunks; c++)
+    {
+        foreach (quint32 token, chunkTokens[c])
+        {
+            if (flagBit == 8)
+            {
+                flagPos = out.size();
+                out.append((char)0);
+                flagBit = 0;
+            }
+
+            if (token == 0)
+            {
+                out.append((char)src[pos]);
+                pos++;
+                flagBit++;
+                continue;
+            }
+
+            quint32 matchLen = token >> 12;
+            quint32 disp = token & 0xFFF;
+
+            out[flagPos] = (char)(out[flagPos] | (0x80 >> flagBit));
+            flagBit++;
+
+            if (matchLen <= 0x10)
+            {
+                out.append((char)(((matchLen - 1) << 4) | (disp >> 8)));
+            }
+            else if (matchLen <= 0x110)
+            {
+                quint32 l = matchLen - 0x11;
+                out.append((char)(l >> 4));
+                out.append((char)(((l & 0xF) << 4) | (disp >> 8)));
+            }
+            else
+            {
+                quint32 l = matchLen - 0x111;
+                out.append((char)(0x10 | (l >> 12)));
+                out.append((char)((l >> 4) & 0xFF));
+                out.append((char)(((l & 0xF) << 4) | (disp >> 8)));
+            }
+            out.append((char)(disp & 0xFF));
+
+            pos += matchLen;
+        }
+    }
+
+    while (out.size() % 4)
+        out.append((char)0);
+
+    return out;
+}
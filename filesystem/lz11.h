@@ -0,0 +1,55 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LZ11_H
+#define LZ11_H
+
+#include <QByteArray>
+#include <QList>
+
+// LZ11 as used on the 3DS, and LZ13, which is an LZ11 stream behind one more 4 byte header
+class Lz11
+{
+public:
+    enum Format
+    {
+        None,
+        LZ11,
+        LZ13
+    };
+
+    // returns None if the data doesn't start with a known header
+    static Format detect(const quint8* src, quint64 len, quint32* size = NULL, quint32* headerSize = NULL);
+
+    // the size in a header is whatever the file says, this is what it can really be:
+    // no token gives more than maxMatch bytes for every 4 bytes of it, and nothing in the game gets near the cap
+    static constexpr quint32 maxOutputSize = 256*1024*1024;
+    static quint64 maxDecompressedSize(quint64 len) { return qMin<quint64>((len / 4 + 1) * maxMatch, maxOutputSize); }
+
+    // dst has to hold the size from detect(), false on corrupt data
+    static bool decompress(const quint8* src, quint64 len, quint8* dst, quint32 dstSize);
+
+    // match finding is split across threads for big inputs
+    static QByteArray compress(const quint8* src, quint32 len, Format format = LZ11);
+
+private:
+    static constexpr quint32 windowSize = 0x1000;
+    static constexpr quint32 maxMatch = 0x10110;
+
+    // a literal is 0, a match is length<<12 | (distance-1)
+    static void findTokens(const quint8* src, quint32 len, quint32 start, quint32 end, QList<quint32>& tokens);
+};
+
+#endif // LZ11_H
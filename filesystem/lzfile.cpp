@@ -0,0 +1,78 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#include "filesystem.h"
+
+FileBase* LzFile::wrap(FileBase* raw, bool recompress)
+{
+    raw->open();
+
+    FileBytes header = raw->peekAt(0, 8);
+    quint32 size;
+    Lz11::Format format = Lz11::detect(header.data(), header.size(), &size);
+
+    // a header claiming more than the rest of the file can decode to isn't one
+    if (format == Lz11::None || size > Lz11::maxDecompressedSize(raw->size()))
+    {
+        raw->close();
+        return raw;
+    }
+
+    // decoded straight into the buffer the LzFile ends up owning
+    FileBytes packed = raw->peekAt(0, raw->size());
+    quint8* data = new quint8[size];
+    bool ok = Lz11::decompress(packed.data(), packed.size(), data, size);
+
+    raw->close();
+
+    if (!ok)
+    {
+        // just looked like a header
+        delete[] data;
+        return raw;
+    }
+
+    return new LzFile(raw, format, data, size, recompress);
+}
+
+LzFile::LzFile(FileBase* raw, Lz11::Format format, quint8* data, quint32 size, bool recompress) :
+    MemoryFile(NULL, data, size)
+{
+    this->raw = raw;
+    this->format = format;
+    this->recompress = recompress;
+}
+
+LzFile::~LzFile()
+{
+    delete raw;
+}
+
+void LzFile::save()
+{
+    FileBytes plain = mapData();
+    QByteArray out;
+    if (recompress)
+        out = Lz11::compress(plain.data(), plain.size(), format);
+    else
+        out = QByteArray::fromRawData(plain.constData(), plain.size());
+
+    raw->open();
+    raw->resize(out.size());
+    raw->seek(0);
+    raw->writeBlock(out);
+    raw->save();
+    raw->close();
+}
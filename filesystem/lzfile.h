@@ -0,0 +1,46 @@
+/*
+    This file is part of CoinKiller.
+
+    CoinKiller is free software: you can redistribute it and/or modify it under
+    the terms of the GNU General Public License as published by the Free
+    Software Foundation, either version 3 of the License, or (at your option)
+    any later version.
+
+    CoinKiller is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License along
+    with CoinKiller. If not, see http://www.gnu.org/licenses/.
+*/
+
+#ifndef LZFILE_H
+#define LZFILE_H
+
+#include "lz11.h"
+
+// Decompressed contents of an LZ11/LZ13 file, kept in memory.
+// Saving writes them back to the compressed file, recompressed unless that's turned off.
+class LzFile : public MemoryFile
+{
+public:
+    // returns the file itself if it isn't compressed, otherwise takes ownership of it
+    static FileBase* wrap(FileBase* raw, bool recompress = true);
+
+    ~LzFile();
+
+    void save();
+
+    Lz11::Format getFormat() { return format; }
+
+    // what the file gets written back as
+    Lz11::Format getSaveFormat() { return recompress ? format : Lz11::None; }
+
+private:
+    LzFile(FileBase* raw, Lz11::Format format, quint8* data, quint32 size, bool recompress);
+
+    FileBase* raw;
+    Lz11::Format format;
+    bool recompress;
+};
+
+#endif // LZFILE_H
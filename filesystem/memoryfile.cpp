@@ -20,6 +20,8 @@
 MemoryFile::MemoryFile(FilesystemBase* fs, quint8* blob, quint32 size)
 {
     this->parent = fs;
+    if (blob)
+        this->block.reset(new FileBlock(blob, size));
     this->data = blob;
     this->_size = size;
     this->_pos = 0;
@@ -30,17 +32,46 @@ MemoryFile::MemoryFile(FilesystemBase* fs, quint8* blob, quint32 size)
 MemoryFile::MemoryFile(FilesystemBase *fs, quint32 size)
 {
     this->parent = fs;
-    this->data = new quint8[size];
-    memset(data, 0, size);
+    this->block.reset(new FileBlock(size));
+    this->data = block->data;
+    if (size) memset(data, 0, size);
     this->_size = size;
     this->_pos = 0;
 
     openCount = 0;
 }
 
-MemoryFile::~MemoryFile()
+MemoryFile::MemoryFile(FilesystemBase* fs, const FileBytes& view)
 {
-    delete[] data;
+    this->parent = fs;
+    this->block = view.getBlock();
+    this->data = const_cast<quint8*>(view.data()); // not written to before makeWritable()
+    this->_size = view.size();
+    this->_pos = 0;
+
+    openCount = 0;
+}
+
+void MemoryFile::makeWritable()
+{
+    // already ours alone
+    if (block && !block->isShared() && !block->isMapped())
+        return;
+    if (!data)
+        return;
+
+    FileBlockRef copy(new FileBlock(_size));
+    memcpy(copy->data, data, _size);
+    block = copy;
+    data = block->data;
+}
+
+FileBytes MemoryFile::mapData()
+{
+    if (!block)
+        return FileBytes();
+
+    return FileBytes(block, data - block->data, _size);
 }
 
 
@@ -56,13 +87,13 @@ void MemoryFile::save()
 
 void MemoryFile::close()
 {
-    openCount--;
-    if (openCount == 0)
+    int count = --openCount;
+    if (count == 0)
     {
         //if (parent) parent->save(this);
     }
 
-    if (openCount < 0)
+    if (count < 0)
         throw std::logic_error("MemoryFile: openCount<0");
 }
 
@@ -88,8 +119,23 @@ quint64 MemoryFile::readData(quint8* data, quint64 len)
     return len;
 }
 
+quint64 MemoryFile::readAt(quint64 offset, quint8* data, quint64 len)
+{
+    if (offset >= _size)
+        return 0;
+
+    if ((offset+len) > _size)
+        len = _size-offset;
+
+    memcpy(data, &this->data[offset], len);
+    return len;
+}
+
 quint64 MemoryFile::writeData(quint8* data, quint64 len)
 {
+    // copy on write
+    makeWritable();
+
     // resize the file if needed
     // (it is still more efficient to resize the file prior to writing)
     if ((_pos+len) > _size)
@@ -132,7 +178,7 @@ bool MemoryFile::resize(quint64 size)
 {
     if (size == 0)
     {
-        delete[] this->data;
+        this->block.reset();
         this->data = NULL;
         this->_size = 0;
     }
@@ -140,11 +186,12 @@ bool MemoryFile::resize(quint64 size)
     if (size < 1 || size > 0xFFFFFFFF)
         return false;
 
-    quint8* newdata = new quint8[size];
-    if (size >= this->_size) memcpy(newdata, this->data, this->_size);
-    else memcpy(newdata, this->data, size);
-    delete[] this->data;
-    this->data = newdata;
+    // always a new block, whoever still holds the old one keeps it
+    FileBlockRef newblock(new FileBlock(size));
+    if (size >= this->_size) memcpy(newblock->data, this->data, this->_size);
+    else memcpy(newblock->data, this->data, size);
+    this->block = newblock;
+    this->data = block->data;
     this->_size = size;
 
     return true;
@@ -24,7 +24,7 @@ class MemoryFile : public FileBase
 public:
     MemoryFile(FilesystemBase *fs, quint8* blob, quint32 size);
     MemoryFile(FilesystemBase *fs, quint32 size=0);
-    ~MemoryFile();
+    MemoryFile(FilesystemBase *fs, const FileBytes& view); // shares the bytes until it gets written to
 
     void open();
     void save();
@@ -36,12 +36,19 @@ public:
     quint64 size();
     bool resize(quint64 size);
 
+    quint64 readAt(quint64 offset, quint8* data, quint64 len);
+    FileBytes mapData();
+
 
 private:
-    quint8* data;
+    FileBlockRef block;
+    quint8* data; // somewhere in block
     quint32 _size;
 
     quint32 _pos;
+
+    // gets the data its own copy if the block is shared or a mapping
+    void makeWritable();
 };
 
 #endif // MEMORYFILE_H
@@ -16,18 +16,31 @@
 */
 
 #include "filesystem.h"
+#include "crc32.h"
 
 #include <QDebug>
+#include <QMultiHash>
+#include <QReadLocker>
+#include <QWriteLocker>
 
 SarcFilesystem::SarcFilesystem(FileBase* file)
 {
     sarc = file;
 
+    transactionDepth = 0;
+    repackPending = false;
+    rollbackPending = false;
+
+    asyncWriter = NULL;
+
     // TODO: someshit if the file was already opened??
     file->open();
 
     file->seek(0);
-    quint32 tag = file->read32();
+    FileBytes headerData = file->peek(0x14);
+    BinaryCursor<> header(headerData);
+
+    quint32 tag = header.read32();
     if (tag != 0x43524153)
     {
         qDebug("SARC: bad tag %08X", tag);
@@ -35,117 +48,277 @@ SarcFilesystem::SarcFilesystem(FileBase* file)
     }
 
     // SARC header
-    file->skip(0x8);
-    dataOffset = file->read32();
-    file->skip(0x4);
+    header.skip(0x8);
+    dataOffset = header.read32();
 
-    // SFAT header
-    sfatOffset = (quint32)file->pos();
-    file->skip(0x6);
-    numFiles = file->read16();
-    hashMult = file->read32();
+    // SFAT header and nodes only, names are read when they're first needed
+    sfatOffset = 0x14;
+    file->seek(sfatOffset);
+    FileBytes sfatHeader = file->peek(0xC);
+    BinaryCursor<> in(sfatHeader);
+
+    in.skip(0x6);
+    numFiles = in.read16();
+    hashMult = in.read32();
 
     sfntOffset = sfatOffset + 0xC + (numFiles * 0x10);
 
+    file->seek(sfatOffset + 0xC);
+    FileBytes nodeData = file->peek(numFiles * 0x10);
+    BinaryCursor<> nodes(nodeData);
+
     for (quint32 i = 0; i < numFiles; i++)
     {
-        file->seek(sfatOffset + 0xC + (i * 0x10));
         InternalSarcFile* entry = new InternalSarcFile();
-        entry->entryOffset = (quint32)file->pos();
+        entry->entryOffset = sfatOffset + 0xC + (quint32)nodes.pos();
 
-        entry->nameHash = file->read32();
-        entry->nameOffset = (file->read32() & 0x00FFFFFF) << 2;
-        entry->offset = file->read32();
-        entry->size = file->read32() - entry->offset;
+        entry->nameHash = nodes.read32();
+        entry->nameOffset = (nodes.read32() & 0x00FFFFFF) << 2;
+        entry->offset = nodes.read32();
+        entry->size = nodes.read32() - entry->offset;
+        entry->nameLoaded = false;
 
-        file->seek(sfntOffset + 0x8 + entry->nameOffset);
-        file->readStringASCII(entry->name, 0);
-
-        files.insert(entry->name, entry);
+        files.append(entry);
     }
 
     file->close();
+
+    namesLoaded = false;
+
+    // SFAT nodes should already be in hash order, but don't rely on it
+    std::stable_sort(files.begin(), files.end(), hashSort);
 }
 
 SarcFilesystem::~SarcFilesystem()
 {
     delete sarc;
     qDeleteAll(files);
+    qDeleteAll(savedFiles);
 }
 
 
-bool SarcFilesystem::directoryExists(QString path)
+QString& SarcFilesystem::entryName(InternalSarcFile* entry)
 {
-    if (path[0] == '/')
-        path.remove(0,1);
+    // readers can get here concurrently
+    QMutexLocker locker(&nameLock);
 
-    if (!path.endsWith("/"))
-        path.append("/");
+    if (entry->nameLoaded)
+        return entry->name;
 
-    for (int i = 0; i < files.size(); i++)
+    sarc->open();
+
+    // names are short, grow the window in the rare case one doesn't fit
+    quint32 nameStart = sfntOffset + 0x8 + entry->nameOffset;
+    for (quint32 len = 0x80; ; len *= 2)
     {
-        QString thispath = files.keys()[i];
+        FileBytes block = sarc->peekAt(nameStart, len);
+        BinaryCursor<> in(block);
 
-        if (thispath.startsWith(path))
-            return true;
+        quint32 nameLen = in.readStringASCII(entry->name, 0);
+        if (nameLen < (quint32)block.size() || (quint64)block.size() < len)
+            break;
     }
 
-    return false;
+    sarc->close();
+
+    entry->nameLoaded = true;
+    return entry->name;
 }
 
-void SarcFilesystem::directoryContents(QString path, QDir::Filter filter, QList<QString>& out)
+void SarcFilesystem::loadNames()
+{
+    QMutexLocker locker(&nameLock);
+
+    if (namesLoaded)
+        return;
+
+    // the whole SFNT in one go
+    sarc->open();
+    FileBytes sfntData = sarc->peekAt(sfntOffset + 0x8, dataOffset - sfntOffset - 0x8);
+    BinaryCursor<> in(sfntData);
+
+    foreach (InternalSarcFile* entry, files)
+    {
+        if (!entry->nameLoaded)
+        {
+            in.seek(entry->nameOffset);
+            in.readStringASCII(entry->name, 0);
+            entry->nameLoaded = true;
+        }
+
+        addToTree(entry);
+    }
+
+    sarc->close();
+
+    namesLoaded = true;
+}
+
+void SarcFilesystem::addToTree(InternalSarcFile* file)
+{
+    QStringList parts = file->name.split('/', Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return;
+
+    DirNode* dir = &rootDir;
+    for (int i = 0; i < parts.size()-1; i++)
+    {
+        DirNode*& child = dir->dirs[parts[i]];
+        if (!child) child = new DirNode();
+        dir = child;
+    }
+    dir->files.insert(parts.last(), file);
+}
+
+SarcFilesystem::InternalSarcFile* SarcFilesystem::findFile(QString path)
 {
     if (path.startsWith('/'))
         path.remove(0,1);
 
-    if (path != "" && !path.endsWith("/"))
-        path.append("/");
+    quint32 hash = filenameHash(path);
 
-    out.clear();
+    QList<InternalSarcFile*>::const_iterator it = std::lower_bound(files.constBegin(), files.constEnd(), hash, hashLess);
+    for (; it != files.constEnd() && (*it)->nameHash == hash; ++it)
+    {
+        if (entryName(*it) == path)
+            return *it;
+    }
 
-    for (int i = 0; i < files.size(); i++)
+    return NULL;
+}
+
+SarcFilesystem::DirNode* SarcFilesystem::findDir(QString path)
+{
+    loadNames();
+
+    QStringList parts = path.split('/', Qt::SkipEmptyParts);
+
+    DirNode* dir = &rootDir;
+    foreach (const QString& part, parts)
     {
-        QString thispath = files.keys()[i];
+        dir = dir->dirs.value(part, NULL);
+        if (!dir)
+            return NULL;
+    }
 
-        if (thispath.startsWith(path))
-        {
-            thispath.remove(0, path.length());
+    return dir;
+}
 
-            int slashidx = thispath.indexOf('/');
-            bool isdir = (slashidx != -1);
+void SarcFilesystem::insertFile(InternalSarcFile* file)
+{
+    loadNames();
 
-            if ((isdir && (filter & QDir::Dirs)) || ((!isdir) && (filter & QDir::Files)))
-            {
-                if (isdir) thispath = thispath.left(slashidx);
-                if (!out.contains(thispath))
-                    out.append(thispath);
-            }
-        }
+    file->nameHash = filenameHash(file->name);
+    files.insert(std::upper_bound(files.begin(), files.end(), file, hashSort), file);
+
+    addToTree(file);
+}
+
+void SarcFilesystem::removeFile(InternalSarcFile* file)
+{
+    loadNames();
+
+    QList<InternalSarcFile*>::iterator it = std::lower_bound(files.begin(), files.end(), file->nameHash, hashLess);
+    while (it != files.end() && *it != file)
+        ++it;
+    if (it != files.end())
+        files.erase(it);
+
+    QStringList parts = file->name.split('/', Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return;
+
+    // walk down, then prune directories that became empty on the way back up
+    QList<DirNode*> trail;
+    DirNode* dir = &rootDir;
+    for (int i = 0; i < parts.size()-1; i++)
+    {
+        trail.append(dir);
+        dir = dir->dirs.value(parts[i], NULL);
+        if (!dir)
+            return;
     }
+    dir->files.remove(parts.last());
+
+    for (int i = trail.size()-1; i >= 0; i--)
+    {
+        if (!dir->files.isEmpty() || !dir->dirs.isEmpty())
+            break;
+
+        trail[i]->dirs.remove(parts[i]);
+        delete dir;
+        dir = trail[i];
+    }
+}
+
+void SarcFilesystem::collectFiles(DirNode* dir, QList<InternalSarcFile*>& out)
+{
+    foreach (InternalSarcFile* file, dir->files)
+        out.append(file);
+
+    foreach (DirNode* child, dir->dirs)
+        collectFiles(child, out);
+}
+
+
+bool SarcFilesystem::directoryExists(QString path)
+{
+    QReadLocker locker(&metaLock);
+
+    return findDir(path) != NULL;
+}
+
+void SarcFilesystem::directoryContents(QString path, QDir::Filter filter, QList<QString>& out)
+{
+    QReadLocker locker(&metaLock);
+
+    out.clear();
+
+    DirNode* dir = findDir(path);
+    if (!dir)
+        return;
+
+    if (filter & QDir::Dirs)
+        out.append(dir->dirs.keys());
+
+    if (filter & QDir::Files)
+        out.append(dir->files.keys());
 }
 
 
 bool SarcFilesystem::fileExists(QString path)
 {
-    if (path[0] == '/')
-        path.remove(0,1);
+    QReadLocker locker(&metaLock);
 
-    return files.contains(path);
+    return findFile(path) != NULL;
 }
 
 FileBase* SarcFilesystem::openFile(QString path)
 {
+    QReadLocker locker(&metaLock);
+
     if (path[0] == '/')
         path.remove(0,1);
 
-    if (!files.contains(path))
+    InternalSarcFile* entry = findFile(path);
+
+    if (!entry)
     {
         MemoryFile* ret = new MemoryFile(this);
         ret->setIdPath(path);
         return ret;
     }
 
-    InternalSarcFile* entry = files[path];
+    if (entry->stagedData)
+    {
+        // saved during a transaction that wasn't committed yet
+        quint8* data = new quint8[entry->size];
+        memcpy(data, entry->stagedData, entry->size);
+
+        MemoryFile* ret = new MemoryFile(this, data, entry->size);
+        ret->setIdPath(path);
+        return ret;
+    }
 
     FileBase* ret = sarc->getSubfile(this, dataOffset+entry->offset, entry->size);
     ret->setIdPath(path);
@@ -154,58 +327,163 @@ FileBase* SarcFilesystem::openFile(QString path)
 
 bool SarcFilesystem::save(FileBase *file)
 {
-    sarc->open();
-    file->open();
+    QWriteLocker locker(&metaLock);
 
-    numFiles = files.size();    // just to be sure
+    file->open();
 
     QString path = file->getIdPath();
 
     if (path.isNull() || path.isEmpty())
         throw std::runtime_error("tried saving file without specified filename");
 
-    if (!files.contains(path))
+    InternalSarcFile* entry = findFile(path);
+
+    if (!entry)
     {
-        InternalSarcFile* entry = new InternalSarcFile();
+        entry = new InternalSarcFile();
         entry->name = path;
-        entry->size = file->size();
-        files.insert(entry->name, entry);
+        insertFile(entry);
+    }
+
+    // stage the new contents, they get written out with the next repack
+    delete[] entry->stagedData;
+    entry->size = file->size();
+    entry->stagedData = new quint8[entry->size];
+    file->seek(0);
+    file->readData(entry->stagedData, entry->size);
+    entry->hashValid = false;
+
+    file->close();
+
+    repack();
+
+    return true;
+}
+
+void SarcFilesystem::beginTransaction()
+{
+    QWriteLocker locker(&metaLock);
+
+    if (transactionDepth == 0)
+    {
+        // nothing is written to the archive before the end, so the entries are all a rollback needs
+        loadNames();
 
-        numFiles++;
+        foreach (InternalSarcFile* entry, files)
+            savedFiles.append(copyEntry(entry));
     }
-    else
+
+    transactionDepth++;
+}
+
+bool SarcFilesystem::commitTransaction()
+{
+    QWriteLocker locker(&metaLock);
+
+    if (transactionDepth <= 0)
+        throw std::logic_error("SarcFilesystem: commitTransaction() without beginTransaction()");
+
+    bool ok = !rollbackPending;
+    endTransaction();
+    return ok;
+}
+
+void SarcFilesystem::rollbackTransaction()
+{
+    QWriteLocker locker(&metaLock);
+
+    if (transactionDepth <= 0)
+        return; // runs from destructors, so no throwing here
+
+    // an inner transaction failing fails the whole thing
+    rollbackPending = true;
+    endTransaction();
+}
+
+void SarcFilesystem::endTransaction()
+{
+    transactionDepth--;
+    if (transactionDepth > 0)
+        return;
+
+    if (rollbackPending)
     {
-        InternalSarcFile* thisfile = files[path];
+        qDeleteAll(files);
+        files.clear();
+        qDeleteAll(rootDir.dirs);
+        rootDir.dirs.clear();
+        rootDir.files.clear();
+
+        files.swap(savedFiles);
+        foreach (InternalSarcFile* entry, files)
+            addToTree(entry);
+
+        rollbackPending = false;
+        repackPending = false;
+        return;
+    }
 
-        if (thisfile == NULL)
-            throw std::logic_error("thisfile is NULL, shouldn't happen");
+    qDeleteAll(savedFiles);
+    savedFiles.clear();
+
+    if (repackPending)
+        repack();
+}
 
-        thisfile->size = file->size();
+SarcFilesystem::InternalSarcFile* SarcFilesystem::copyEntry(const InternalSarcFile* entry)
+{
+    InternalSarcFile* copy = new InternalSarcFile();
+    copy->name = entry->name;
+    copy->offset = entry->offset;
+    copy->size = entry->size;
+    copy->nameOffset = entry->nameOffset;
+    copy->nameHash = entry->nameHash;
+    copy->entryOffset = entry->entryOffset;
+    copy->nameLoaded = entry->nameLoaded;
+    copy->contentHash = entry->contentHash;
+    copy->hashValid = entry->hashValid;
+
+    if (entry->stagedData)
+    {
+        copy->stagedData = new quint8[entry->size];
+        memcpy(copy->stagedData, entry->stagedData, entry->size);
     }
 
+    return copy;
+}
 
-    // Generate sorted List, since SARCs want to be ordered after their File Name Hash
-    QList<InternalSarcFile*> sortedFiles;
-    for (int i = 0; i < files.size(); i++)
+void SarcFilesystem::repack()
+{
+    // inside a transaction, only remember that the archive needs rewriting
+    if (transactionDepth > 0)
     {
-        InternalSarcFile* ifile = files.values()[i];
-        ifile->nameHash = filenameHash(ifile->name);
-        sortedFiles.append(ifile);
+        repackPending = true;
+        return;
     }
-    std::sort(sortedFiles.begin(), sortedFiles.end(), hashSort);
 
+    loadNames();
+
+    // a file on disk gets replaced by the writer, so it can't be edited in place anymore
+    if (asyncWriter && !dynamic_cast<MemoryFile*>(sarc))
+        moveToMemory();
+
+    sarc->open();
+
+    numFiles = files.size();    // just to be sure
+
+    // SARCs want to be ordered after their File Name Hash, which files already is
 
-    // recreate SARC
 
-    // get correct size
+    // plan the new layout
+
     quint32 newSarcSize = 0x28;             // SARC, SFAT and SFNT headers
     newSarcSize += numFiles*0x10;           // SFAT nodes
 
     quint32 sfntNodeOffset = newSarcSize;
 
-    for (int i = 0; i < sortedFiles.size(); i++)  // SFNT nodes
+    for (int i = 0; i < files.size(); i++)  // SFNT nodes
     {
-        InternalSarcFile* ifile = sortedFiles[i];
+        InternalSarcFile* ifile = files[i];
         ifile->nameOffset = (newSarcSize-sfntNodeOffset) / 4;
         newSarcSize += ifile->name.length() + 1;
         newSarcSize = align(newSarcSize, 4);
@@ -214,262 +492,384 @@ bool SarcFilesystem::save(FileBase *file)
     newSarcSize = align(newSarcSize, dataAlign);
     quint32 newDataOffset = newSarcSize;
 
-    quint32* oldOffsets =  new quint32[numFiles];
+    // entries with the same contents share one payload
+    QList<Payload> payloads;
+    QList<int> payloadOf;
+    QMultiHash<quint32, int> payloadsByHash;
 
-    for (int i = 0; i < sortedFiles.size(); i++)  // data
+    for (int i = 0; i < files.size(); i++)
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        oldOffsets[i] = ifile->offset;
-        ifile->offset = newSarcSize - newDataOffset;
-        newSarcSize += ifile->size;
-        if (i < sortedFiles.size() - 1) newSarcSize = align(newSarcSize, dataAlign);
-    }
-
+        InternalSarcFile* ifile = files[i];
+        FileBytes data; // only read when needed
 
-    // buffer old SARC file data
-    quint8* oldSarc = new quint8[sarc->size() - dataOffset];
-    sarc->seek(dataOffset);
-    sarc->readData(oldSarc, sarc->size() - dataOffset);
+        if (!ifile->hashValid)
+        {
+            data = payloadData(ifile);
+            ifile->contentHash = payloadHash(data);
+            ifile->hashValid = true;
+        }
 
-    sarc->resize(newSarcSize);
-    sarc->seek(0);
+        int match = -1;
+        QMultiHash<quint32, int>::const_iterator it = payloadsByHash.constFind(ifile->contentHash);
+        for (; it != payloadsByHash.constEnd() && it.key() == ifile->contentHash; ++it)
+        {
+            InternalSarcFile* other = payloads[it.value()].owner;
+            if (other->size != ifile->size)
+                continue;
 
+            if (!ifile->stagedData && !other->stagedData && other->offset == ifile->offset)
+            {
+                match = it.value();
+                break;
+            }
 
-    dataOffset = newDataOffset;
+            if (data.isNull())
+                data = payloadData(ifile);
 
+            if (data == payloadData(other))
+            {
+                match = it.value();
+                break;
+            }
+        }
 
-    // write SARC
+        if (match >= 0)
+        {
+            // already stored once, staged bytes aren't needed anymore
+            delete[] ifile->stagedData;
+            ifile->stagedData = nullptr;
+            payloadOf.append(match);
+            continue;
+        }
 
-    // Header
-    sarc->write32(0x43524153);      // Magic
-    sarc->write16(0x14);            // Header Length
-    sarc->write16(0xFEFF);          // Byte order mark (little endian)
-    sarc->write32(newSarcSize);     // SARC size
-    sarc->write32(newDataOffset);   // Beginning of data
-    sarc->write32(0x00000100);
+        Payload payload;
+        payload.owner = ifile;
+        payload.from = dataOffset + ifile->offset;
+        payloadsByHash.insert(ifile->contentHash, payloads.size());
+        payloadOf.append(payloads.size());
+        payloads.append(payload);
+    }
 
-    // SFAT Header
-    sarc->write32(0x54414653);      // Magic
-    sarc->write16(0xC);             // Header Length
-    sarc->write16(numFiles);        // Node count
-    sarc->write32(hashMult);        // Hash Multiplier
+    // payloads that are already in the archive only get moved around
+    QList<PayloadMove> moves;
 
-    // SFAT Nodes
-    for (int i = 0; i < sortedFiles.size(); i++)
+    for (int i = 0; i < payloads.size(); i++)  // data
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        sarc->write32(filenameHash(ifile->name));   // File Name Hash
-        sarc->write32(ifile->nameOffset);           // File name table entry
-        sarc->seek(sarc->pos()-1);
-        sarc->write8(0x1);                          // whatever this is
-        sarc->write32(ifile->offset);               // Beginning of node file data
-        sarc->write32(ifile->offset + ifile->size); // End of node file data
-    }
+        Payload& payload = payloads[i];
+        payload.to = newSarcSize;
 
-    // SFNT Header
-    sarc->write32(0x544E4653);      // Magic
-    sarc->write16(0x8);             // Header Length
-    sarc->write16(0x0);             // whatever this is
+        if (!payload.owner->stagedData)
+        {
+            PayloadMove move;
+            move.from = payload.from;
+            move.to = payload.to;
+            move.size = payload.owner->size;
+            move.parked = NULL;
+            moves.append(move);
+        }
 
-    // Filename Strings
-    for (int i = 0; i < sortedFiles.size(); i++)
-    {
-        InternalSarcFile* ifile = sortedFiles[i];
-        sarc->writeStringASCII(ifile->name);
-        writeAlign(4);
+        newSarcSize += payload.owner->size;
+        if (i < payloads.size() - 1) newSarcSize = align(newSarcSize, dataAlign);
     }
 
-    // File data
-    for (int i = 0; i < sortedFiles.size(); i++)
-    {
-        writeAlign(dataAlign);
+    for (int i = 0; i < files.size(); i++)
+        files[i]->offset = payloads[payloadOf[i]].to - newDataOffset;
 
-        InternalSarcFile* ifile = sortedFiles[i];
 
-        if (ifile->name == path)
-        {
-            quint8* filetempbuf = new quint8[file->size()];
-            file->seek(0);
-            file->readData(filetempbuf, file->size());
-            sarc->writeData(filetempbuf, file->size());
-            delete[] filetempbuf;
+    // rewrite SARC in place
 
-            continue;
-        }
+    quint64 oldSarcSize = sarc->size();
+    if (newSarcSize > oldSarcSize)
+        sarc->resize(newSarcSize);
 
-        sarc->writeData(oldSarc+oldOffsets[i], ifile->size);
-    }
+    relocatePayloads(moves);
 
-    delete[] oldOffsets;
-    delete[] oldSarc;
+    if (newSarcSize < oldSarcSize)
+        sarc->resize(newSarcSize);
 
-    file->close();
-    sarc->save();
-    sarc->close();
+    dataOffset = newDataOffset;
 
-    return true;
-}
+    // File data that wasn't in the archive yet, and the padding between files
+    static const quint8 zeroes[0x10] = {0};
+    for (int i = 0; i < payloads.size(); i++)
+    {
+        InternalSarcFile* owner = payloads[i].owner;
+        quint32 payloadEnd = payloads[i].to + owner->size;
 
-void SarcFilesystem::repack()
-{
-    // oddly copy-pasted the code from the save method, but who cares :P
+        if (owner->stagedData)
+        {
+            sarc->seek(payloads[i].to);
+            sarc->writeData(owner->stagedData, owner->size);
+            delete[] owner->stagedData;
+            owner->stagedData = nullptr;
+        }
 
-    sarc->open();
+        if (i < payloads.size() - 1)
+        {
+            sarc->seek(payloadEnd);
+            sarc->writeData((quint8*)zeroes, align(payloadEnd, dataAlign) - payloadEnd);
+        }
+    }
 
-    numFiles = files.size();    // just to be sure
+    // everything in front of the data went into moved payloads already,
+    // so the tables can be written over it now
+    BinaryWriter<> out(newDataOffset);
+
+    // Header
+    out.write32(0x43524153);        // Magic
+    out.write16(0x14);              // Header Length
+    out.write16(0xFEFF);            // Byte order mark (little endian)
+    out.write32(newSarcSize);       // SARC size
+    out.write32(newDataOffset);     // Beginning of data
+    out.write32(0x00000100);
+
+    // SFAT Header
+    out.write32(0x54414653);        // Magic
+    out.write16(0xC);               // Header Length
+    out.write16(numFiles);          // Node count
+    out.write32(hashMult);          // Hash Multiplier
 
-    // Generate sorted List, since SARCs want to be ordered after their File Name Hash
-    QList<InternalSarcFile*> sortedFiles;
+    // SFAT Nodes
     for (int i = 0; i < files.size(); i++)
     {
-        InternalSarcFile* ifile = files.values()[i];
-        ifile->nameHash = filenameHash(ifile->name);
-        sortedFiles.append(ifile);
+        InternalSarcFile* ifile = files[i];
+        out.write32(ifile->nameHash);               // File Name Hash
+        out.write32(0x01000000 | ifile->nameOffset); // File name table entry, top byte is whatever this is
+        out.write32(ifile->offset);                 // Beginning of node file data
+        out.write32(ifile->offset + ifile->size);   // End of node file data
     }
-    std::sort(sortedFiles.begin(), sortedFiles.end(), hashSort);
 
+    // SFNT Header
+    out.write32(0x544E4653);        // Magic
+    out.write16(0x8);               // Header Length
+    out.write16(0x0);               // whatever this is
 
-    // recreate SARC
+    // Filename Strings
+    for (int i = 0; i < files.size(); i++)
+    {
+        out.writeStringASCII(files[i]->name);
+        out.seek(align(out.pos(), 4));
+    }
 
-    // get correct size
-    quint32 newSarcSize = 0x28;             // SARC, SFAT and SFNT headers
-    newSarcSize += numFiles*0x10;           // SFAT nodes
+    sarc->seek(0);
+    sarc->writeBlock(out.block());
 
-    quint32 sfntNodeOffset = newSarcSize;
+    repackPending = false;
 
-    for (int i = 0; i < sortedFiles.size(); i++)  // SFNT nodes
+    if (asyncWriter)
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        ifile->nameOffset = (newSarcSize-sfntNodeOffset) / 4;
-        newSarcSize += ifile->name.length() + 1;
-        newSarcSize = align(newSarcSize, 4);
+        // the writer shares the data, the next edit only copies it if the write is still running by then
+        asyncWriter->write(sarc->peekAt(0, sarc->size()));
     }
+    else
+        sarc->save();
 
-    newSarcSize = align(newSarcSize, dataAlign);
-    quint32 newDataOffset = newSarcSize;
+    sarc->close();
+}
 
-    quint32* oldOffsets =  new quint32[numFiles];
+void SarcFilesystem::relocatePayloads(QList<PayloadMove>& moves)
+{
+    quint8* scratch = new quint8[moveChunkSize];
 
-    for (int i = 0; i < sortedFiles.size(); i++)  // data
+    QList<PayloadMove*> pending;
+    for (int i = 0; i < moves.size(); i++)
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        oldOffsets[i] = ifile->offset;
-        ifile->offset = newSarcSize - newDataOffset;
-        newSarcSize += ifile->size;
-        if (i < sortedFiles.size() - 1) newSarcSize = align(newSarcSize, dataAlign);
+        if (moves[i].from != moves[i].to && moves[i].size > 0)
+            pending.append(&moves[i]);
     }
 
+    while (!pending.isEmpty())
+    {
+        bool moved = false;
 
-    // buffer old SARC file data
-    quint8* oldSarc = new quint8[sarc->size() - dataOffset];
-    sarc->seek(dataOffset);
-    sarc->readData(oldSarc, sarc->size() - dataOffset);
-
-    sarc->resize(newSarcSize);
-    sarc->seek(0);
+        // a payload can go once its destination doesn't cover data that is still to be read
+        for (int i = 0; i < pending.size(); )
+        {
+            PayloadMove* move = pending[i];
+            if (moveBlocked(move, pending))
+            {
+                i++;
+                continue;
+            }
 
+            if (move->parked)
+            {
+                sarc->seek(move->to);
+                sarc->writeData(move->parked, move->size);
+                delete[] move->parked;
+                move->parked = NULL;
+            }
+            else
+                movePayload(move->from, move->to, move->size, scratch);
 
-    dataOffset = newDataOffset;
+            pending.removeAt(i);
+            moved = true;
+        }
 
+        if (moved)
+            continue;
 
-    // write SARC
+        // the remaining moves wait on each other in a cycle:
+        // take the smallest payload out of the file to break it
+        PayloadMove* victim = NULL;
+        foreach (PayloadMove* move, pending)
+        {
+            if (!move->parked && (!victim || move->size < victim->size))
+                victim = move;
+        }
 
-    // Header
-    sarc->write32(0x43524153);      // Magic
-    sarc->write16(0x14);            // Header Length
-    sarc->write16(0xFEFF);          // Byte order mark (little endian)
-    sarc->write32(newSarcSize);     // SARC size
-    sarc->write32(newDataOffset);   // Beginning of data
-    sarc->write32(0x00000100);
+        victim->parked = new quint8[victim->size];
+        sarc->seek(victim->from);
+        sarc->readData(victim->parked, victim->size);
+    }
 
-    // SFAT Header
-    sarc->write32(0x54414653);      // Magic
-    sarc->write16(0xC);             // Header Length
-    sarc->write16(numFiles);        // Node count
-    sarc->write32(hashMult);        // Hash Multiplier
+    delete[] scratch;
+}
 
-    // SFAT Nodes
-    for (int i = 0; i < sortedFiles.size(); i++)
+bool SarcFilesystem::moveBlocked(PayloadMove* move, const QList<PayloadMove*>& pending)
+{
+    foreach (PayloadMove* other, pending)
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        sarc->write32(filenameHash(ifile->name));   // File Name Hash
-        sarc->write32(ifile->nameOffset);           // File name table entry
-        sarc->seek(sarc->pos()-1);
-        sarc->write8(0x1);                          // whatever this is
-        sarc->write32(ifile->offset);               // Beginning of node file data
-        sarc->write32(ifile->offset + ifile->size); // End of node file data
+        if (other == move || other->parked)
+            continue;
+
+        if (move->to < other->from + other->size && other->from < move->to + move->size)
+            return true;
     }
 
-    // SFNT Header
-    sarc->write32(0x544E4653);      // Magic
-    sarc->write16(0x8);             // Header Length
-    sarc->write16(0x0);             // whatever this is
+    return false;
+}
 
-    // Filename Strings
-    for (int i = 0; i < sortedFiles.size(); i++)
+void SarcFilesystem::movePayload(quint32 from, quint32 to, quint32 size, quint8* scratch)
+{
+    // copy in the direction that never overwrites bytes of the payload not read yet
+    if (to < from)
     {
-        InternalSarcFile* ifile = sortedFiles[i];
-        sarc->writeStringASCII(ifile->name);
-        writeAlign(4);
+        for (quint32 done = 0; done < size; )
+        {
+            quint32 len = qMin(moveChunkSize, size - done);
+            sarc->seek(from + done);
+            sarc->readData(scratch, len);
+            sarc->seek(to + done);
+            sarc->writeData(scratch, len);
+            done += len;
+        }
     }
-
-    // File data
-    for (int i = 0; i < sortedFiles.size(); i++)
+    else
     {
-        writeAlign(dataAlign);
-        InternalSarcFile* ifile = sortedFiles[i];
-        sarc->writeData(oldSarc+oldOffsets[i], ifile->size);
+        for (quint32 left = size; left > 0; )
+        {
+            quint32 len = qMin(moveChunkSize, left);
+            left -= len;
+            sarc->seek(from + left);
+            sarc->readData(scratch, len);
+            sarc->seek(to + left);
+            sarc->writeData(scratch, len);
+        }
     }
+}
 
-    delete[] oldOffsets;
-    delete[] oldSarc;
+FileBytes SarcFilesystem::payloadData(InternalSarcFile* file)
+{
+    if (file->stagedData)
+        return FileBytes(file->stagedData, file->size);
+
+    sarc->seek(dataOffset + file->offset);
+    return sarc->peek(file->size);
+}
+
+quint32 SarcFilesystem::payloadHash(const FileBytes& data)
+{
+    static quint32 table[256];
+    static bool tableReady = (crc32::generate_table(table), true);
+    Q_UNUSED(tableReady);
 
-    sarc->save();
+    return crc32::update(table, 0, data.constData(), data.size());
+}
+
+void SarcFilesystem::moveToMemory()
+{
+    // from now on the file on disk only gets replaced by the async writer
+    // a plain copy, a view of the mapping would just get copied again on the first edit
+    sarc->open();
+    quint32 size = sarc->size();
+    quint8* data = new quint8[size];
+    sarc->readAt(0, data, size);
     sarc->close();
+
+    delete sarc; // open subfiles keep their own reference to the old data
+    sarc = new MemoryFile(NULL, data, size);
 }
 
 
 bool SarcFilesystem::deleteFile(QString path)
 {
-    if (path[0] == '/')
-        path.remove(0,1);
+    QWriteLocker locker(&metaLock);
 
-    if (!files.contains(path))
+    InternalSarcFile* thisfile = findFile(path);
+
+    if (!thisfile)
         return false;
 
-    files.remove(path);
+    removeFile(thisfile);
+    delete thisfile;
 
     repack();
 
     return true;
 }
 
-bool SarcFilesystem::renameFile(QString path, QString newName)
+bool SarcFilesystem::copyFile(QString path, QString newPath)
 {
-    if (path[0] == '/')
-        path.remove(0,1);
+    QWriteLocker locker(&metaLock);
 
-    if (!files.contains(path))
-        return false;
+    if (newPath[0] == '/')
+        newPath.remove(0,1);
 
-    InternalSarcFile* thisfile = files.value(path);
+    InternalSarcFile* source = findFile(path);
 
-    if (thisfile == NULL)
-        throw std::logic_error("thisfile is NULL, shouldn't happen");
+    if (!source)
+        return false;
 
-    QStringList splitted = thisfile->name.split("/");
-    splitted[splitted.length()-1] = newName;
+    if (findFile(newPath))
+        return false;
 
-    thisfile->name = "";
+    // points at the same payload, it only gets its own once it's saved
+    InternalSarcFile* copy = new InternalSarcFile();
+    copy->name = newPath;
+    copy->offset = source->offset;
+    copy->size = source->size;
+    copy->contentHash = source->contentHash;
+    copy->hashValid = source->hashValid;
 
-    for(int i = 0; i < splitted.length(); i++)
+    if (source->stagedData)
     {
-        thisfile->name.append(splitted.at(i));
-        if (i < splitted.length()-1) thisfile->name.append("/");
+        copy->stagedData = new quint8[source->size];
+        memcpy(copy->stagedData, source->stagedData, source->size);
     }
 
-    files.remove(path);
-    files.insert(thisfile->name, thisfile);
+    insertFile(copy);
+
+    repack();
+
+    return true;
+}
+
+bool SarcFilesystem::renameFile(QString path, QString newName)
+{
+    QWriteLocker locker(&metaLock);
+
+    InternalSarcFile* thisfile = findFile(path);
+
+    if (!thisfile)
+        return false;
+
+    QStringList splitted = thisfile->name.split("/");
+    splitted[splitted.length()-1] = newName;
+
+    removeFile(thisfile);
+    thisfile->name = splitted.join("/");
+    insertFile(thisfile);
 
     repack();
 
@@ -478,6 +878,8 @@ bool SarcFilesystem::renameFile(QString path, QString newName)
 
 bool SarcFilesystem::renameDir(QString path, QString newPath)
 {
+    QWriteLocker locker(&metaLock);
+
     if (path[0] == '/')
         path.remove(0,1);
 
@@ -490,21 +892,18 @@ bool SarcFilesystem::renameDir(QString path, QString newPath)
     if (newPath.endsWith("/"))
         newPath.chop(1);
 
-    foreach (InternalSarcFile* thisfile, files.values())
-    {
-        if (thisfile == NULL)
-            throw std::logic_error("thisfile is NULL, shouldn't happen");
-
-        if (thisfile->name.startsWith(path + "/"))
-        {
-            QString oldName = thisfile->name;
-            files.remove(oldName);
+    DirNode* dir = findDir(path);
+    if (!dir)
+        return false;
 
-            QString newName = oldName.replace(path, newPath);
-            thisfile->name = newName;
+    QList<InternalSarcFile*> dirFiles;
+    collectFiles(dir, dirFiles);
 
-            files.insert(thisfile->name, thisfile);
-        }
+    foreach (InternalSarcFile* thisfile, dirFiles)
+    {
+        removeFile(thisfile);
+        thisfile->name = newPath + thisfile->name.mid(path.length());
+        insertFile(thisfile);
     }
 
     repack();
@@ -514,27 +913,22 @@ bool SarcFilesystem::renameDir(QString path, QString newPath)
 
 bool SarcFilesystem::changeFileDir(QString path, QString newPath)
 {
+    QWriteLocker locker(&metaLock);
+
     if (newPath[0] == '/')
         newPath.remove(0,1);
 
-    if (path[0] == '/')
-        path.remove(0,1);
+    InternalSarcFile* thisfile = findFile(path);
 
-    if (!files.contains(path))
+    if (!thisfile)
         return false;
 
-    if (files.contains(newPath))
+    if (findFile(newPath))
         return false;
 
-    InternalSarcFile* thisfile = files.value(path);
-
-    if (thisfile == NULL)
-        throw std::logic_error("thisfile is NULL, shouldn't happen");
-
+    removeFile(thisfile);
     thisfile->name = newPath;
-
-    files.remove(path);
-    files.insert(thisfile->name, thisfile);
+    insertFile(thisfile);
 
     repack();
 
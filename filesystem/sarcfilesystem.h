@@ -20,6 +20,11 @@
 
 #include "filebase.h"
 #include <QDebug>
+#include <QMap>
+#include <QMutex>
+#include <QReadWriteLock>
+
+class AsyncArchiveWriter;
 
 class SarcFilesystem : public FilesystemBase
 {
@@ -38,11 +43,26 @@ public:
     bool renameDir(QString path, QString newName);
     bool changeFileDir(QString path, QString newName);
 
-    bool copyFile(QString path, QString newPath) { Q_UNUSED(path); Q_UNUSED(newPath); return false; } // TODO
+    bool copyFile(QString path, QString newPath);
+
+    void beginTransaction();
+    bool commitTransaction();
+    void rollbackTransaction();
+
+    // once set, the archive is edited in memory and every repack hands
+    // a snapshot to the writer instead of rewriting the file in place
+    void setAsyncWriter(AsyncArchiveWriter* writer) { asyncWriter = writer; }
 
 private:
     FileBase* sarc;
 
+    // readers (lookups, listings, openFile) can run on several threads at once,
+    // anything that changes the archive takes it exclusively
+    QReadWriteLock metaLock;
+
+    AsyncArchiveWriter* asyncWriter;
+    void moveToMemory();
+
     struct InternalSarcFile
     {
         QString name;
@@ -52,6 +72,15 @@ private:
         quint32 nameHash;
 
         quint32 entryOffset;
+
+        quint8* stagedData = nullptr; // new contents, written out on the next repack
+
+        bool nameLoaded = true; // entries read from the SFAT get their name on first use
+
+        quint32 contentHash = 0; // for storing identical files only once
+        bool hashValid = false;
+
+        ~InternalSarcFile() { delete[] stagedData; }
     };
 
     quint32 numFiles;
@@ -61,9 +90,66 @@ private:
     quint32 sfntOffset;
     quint32 dataOffset;
 
-    QHash<QString,InternalSarcFile*> files;
+    // all entries, sorted by name hash like the SFAT
+    QList<InternalSarcFile*> files;
+
+    // directory tree over the entry names
+    struct DirNode
+    {
+        QMap<QString,DirNode*> dirs;
+        QMap<QString,InternalSarcFile*> files;
+
+        ~DirNode() { qDeleteAll(dirs); }
+    };
+    DirNode rootDir;
+
+    // names and the directory tree are only read once something needs them
+    QMutex nameLock;
+    bool namesLoaded;
+    QString& entryName(InternalSarcFile* entry);
+    void loadNames();
+    void addToTree(InternalSarcFile* file);
+
+    InternalSarcFile* findFile(QString path);
+    DirNode* findDir(QString path);
+    void insertFile(InternalSarcFile* file);
+    void removeFile(InternalSarcFile* file);
+    void collectFiles(DirNode* dir, QList<InternalSarcFile*>& out);
+
     void repack();
 
+    // file data as stored in the archive, possibly shared by several entries
+    struct Payload
+    {
+        InternalSarcFile* owner; // first entry using it
+        quint32 from, to;
+    };
+
+    FileBytes payloadData(InternalSarcFile* file);
+    static quint32 payloadHash(const FileBytes& data);
+
+    // moving a payload that is already in the archive to its new place
+    struct PayloadMove
+    {
+        quint32 from, to, size;
+        quint8* parked; // taken out of the file to break a cycle of overlapping moves
+    };
+
+    static constexpr quint32 moveChunkSize = 0x10000;
+
+    void relocatePayloads(QList<PayloadMove>& moves);
+    bool moveBlocked(PayloadMove* move, const QList<PayloadMove*>& pending);
+    void movePayload(quint32 from, quint32 to, quint32 size, quint8* scratch);
+
+    int transactionDepth;
+    bool repackPending;
+    bool rollbackPending;
+
+    // the entries as they were when the outermost transaction began
+    QList<InternalSarcFile*> savedFiles;
+    static InternalSarcFile* copyEntry(const InternalSarcFile* entry);
+    void endTransaction();
+
 
     quint32 filenameHash(QString &name);
 
@@ -74,15 +160,14 @@ private:
         return (v + a - 1) / a * a;
     }
 
-    void writeAlign(quint32 a)
+    static bool hashSort(InternalSarcFile* f1, InternalSarcFile* f2)
     {
-        quint8 padSize = align(sarc->pos(), a) - sarc->pos();
-        for (quint8 i=0; i < padSize; i++) sarc->write8(0x00);
+        return f1->nameHash < f2->nameHash;
     }
 
-    static bool hashSort(InternalSarcFile* f1, InternalSarcFile* f2)
+    static bool hashLess(InternalSarcFile* f, quint32 hash)
     {
-        return f1->nameHash < f2->nameHash;
+        return f->nameHash < hash;
     }
 };
 
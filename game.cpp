@@ -11,11 +11,75 @@ Game::Game(const QString& path)
 
 Game::~Game()
 {
+    qDeleteAll(tilesetRefs.keys());
     delete fs;
 }
 
 
+FileBase* Game::openArchiveFile(QString path)
+{
+    bool recompress = SettingsManager::getInstance()->get("lzRecompress", true).toBool();
+    return LzFile::wrap(fs->openFile(path), recompress);
+}
+
 Tileset* Game::getTileset(QString name)
+{
+    Tileset* tileset = tilesets.value(name);
+
+    if (tileset)
+    {
+        idleTilesets.removeOne(tileset);
+        tilesetRefs[tileset]++;
+        return tileset;
+    }
+
+    tileset = openTileset(name);
+    tilesets.insert(name, tileset);
+    tilesetRefs.insert(tileset, 1);
+    return tileset;
+}
+
+void Game::releaseTileset(Tileset* tileset)
+{
+    if (!tileset)
+        return;
+
+    Q_ASSERT(tilesetRefs.value(tileset) > 0);
+
+    if (--tilesetRefs[tileset] > 0)
+        return;
+
+    // invalidated while in use
+    if (tilesets.value(tileset->getName()) != tileset)
+    {
+        tilesetRefs.remove(tileset);
+        delete tileset;
+        return;
+    }
+
+    idleTilesets.append(tileset);
+
+    while (idleTilesets.size() > maxIdleTilesets)
+    {
+        Tileset* oldest = idleTilesets.takeFirst();
+        tilesets.remove(oldest->getName());
+        tilesetRefs.remove(oldest);
+        delete oldest;
+    }
+}
+
+void Game::invalidateTileset(QString name)
+{
+    Tileset* tileset = tilesets.take(name);
+
+    if (tileset && idleTilesets.removeOne(tileset))
+    {
+        tilesetRefs.remove(tileset);
+        delete tileset;
+    }
+}
+
+Tileset* Game::openTileset(QString name)
 {
     QString path = name;
     path.prepend("/Unit/");
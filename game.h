@@ -6,6 +6,7 @@
 #include "levelmanager.h"
 
 #include <QStandardItemModel>
+#include <QHash>
 #include <QtXml>
 
 class Game
@@ -16,7 +17,19 @@ public:
 
     const QString& getPath() { return path; }
 
+    // opens a file from the RomFS, transparently decompressed if it's LZ11/LZ13 compressed
+    FileBase* openArchiveFile(QString path);
+
+    // tilesets are shared by all levels using them, every getTileset() needs a releaseTileset()
+    // released ones are kept around for a while, reopening them is free
     Tileset* getTileset(QString name);
+    void releaseTileset(Tileset* tileset);
+
+    // drops the cached tileset after its file changed, instances still in use live until released
+    void invalidateTileset(QString name);
+
+    // a private instance owned by the caller, for editing
+    Tileset* openTileset(QString name);
     LevelManager* getLevelManager(WindowBase* parent, QString path);
 
     QStandardItemModel* getCourseModel();
@@ -27,6 +40,12 @@ public:
 
 private:
     QString path;
+
+    static constexpr int maxIdleTilesets = 8;
+
+    QHash<QString, Tileset*> tilesets;
+    QHash<Tileset*, int> tilesetRefs;
+    QList<Tileset*> idleTilesets; // least recently released first
 };
 
 #endif // GAME_H
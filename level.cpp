@@ -26,6 +26,7 @@
 #include <limits>
 #include <QMessageBox>
 #include <algorithm>
+#include <QSet>
 
 Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
 {
@@ -43,22 +44,24 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     FileBase* header = archive->openFile(headerfile);
     header->open();
     header->seek(0);
+    FileBytes headerData = header->peek(header->size());
+    BinaryCursor<> in(headerData);
 
     quint32 blockOffsets[17];
     quint32 blockSizes[17];
     for (int b = 0; b < 17; b++)
     {
-        blockOffsets[b] = header->read32();
-        blockSizes[b] = header->read32();
+        blockOffsets[b] = in.read32();
+        blockSizes[b] = in.read32();
     }
 
     // Block 0: Tilesets
     for (int t = 0; t < 4; t++)
     {
-        header->seek(blockOffsets[0] + (t*32));
+        in.seek(blockOffsets[0] + (t*32));
 
         QString tilesetname;
-        header->readStringASCII(tilesetname, 32);
+        in.readStringASCII(tilesetname, 32);
 
         if (tilesetname.isEmpty())
         {
@@ -78,28 +81,28 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     }
 
     // Block 1: Area Settings
-    header->seek(blockOffsets[1]);
-    eventState = header->read64();
-    unk1 = header->read16();
-    timeLimit = header->read16();
-    header->skip(4);
-    levelEntranceID = header->read8();
-    unk2 = header->read8();
-    specialLevelFlag = header->read8();
-    specialLevelFlag2 = header->read8();
-    coinRushTimeLimit = header->read16();
+    in.seek(blockOffsets[1]);
+    eventState = in.read64();
+    unk1 = in.read16();
+    timeLimit = in.read16();
+    in.skip(4);
+    levelEntranceID = in.read8();
+    unk2 = in.read8();
+    specialLevelFlag = in.read8();
+    specialLevelFlag2 = in.read8();
+    coinRushTimeLimit = in.read16();
 
     // Block 2: Zone Boundings
-    header->seek(blockOffsets[2]);
+    in.seek(blockOffsets[2]);
     for (int i = 0; i < (int)(blockSizes[2]/28); i++)
     {
-        quint32 primaryUpperBound = header->read32();
-        quint32 primaryLowerBound = header->read32();
-        quint32 secondaryUpperBound = header->read32();
-        quint32 secondaryLowerBound = header->read32();
-        quint16 id = header->read16();
-        quint16 upScrolling = header->read16();
-        header->skip(8);
+        quint32 primaryUpperBound = in.read32();
+        quint32 primaryLowerBound = in.read32();
+        quint32 secondaryUpperBound = in.read32();
+        quint32 secondaryLowerBound = in.read32();
+        quint16 id = in.read16();
+        quint16 upScrolling = in.read16();
+        in.skip(8);
 
         ZoneBounding* bounding = new ZoneBounding(id, primaryUpperBound, primaryLowerBound, secondaryUpperBound, secondaryLowerBound, upScrolling);
 
@@ -109,18 +112,18 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     // Block 3: Unknown
 
     // Block 4: ZoneBackground Information
-    header->seek(blockOffsets[4]);
+    in.seek(blockOffsets[4]);
     for (int i = 0; i < (int)(blockSizes[4]/28); i++)
     {
-        quint16 id = header->read16();
-        qint16 yPos = header->read16();
-        qint16 xPos = header->read16();
-        header->skip(2);
+        quint16 id = in.read16();
+        qint16 yPos = in.read16();
+        qint16 xPos = in.read16();
+        in.skip(2);
         QString name;
-        header->readStringASCII(name, 16);
-        quint16 parallaxMode = header->read16();
+        in.readStringASCII(name, 16);
+        quint16 parallaxMode = in.read16();
 
-        header->skip(2);
+        in.skip(2);
 
         ZoneBackground* background = new ZoneBackground(id, yPos, xPos, name, parallaxMode);
 
@@ -130,23 +133,23 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     // Block 5: Static / Dummy?
 
     // Block 6: Entrances
-    header->seek(blockOffsets[6]);
+    in.seek(blockOffsets[6]);
     for (int e = 0; e < (int)(blockSizes[6]/24); e++)
     {
-        quint16 x = header->read16();
-        quint16 y = header->read16();
-        qint16 cameraX = header->read16();
-        qint16 cameraY = header->read16();
-        quint8 id = header->read8();
-        quint8 destArea = header->read8();
-        quint8 destEntr = header->read8();
-        quint8 entrType = header->read8();
-        header->skip(4);
-        quint16 settings = header->read16();
-        header->skip(2);
-        quint8 entrUnk1 = header->read8();
-        quint8 entrUnk2 = header->read8();
-        header->skip(2);
+        quint16 x = in.read16();
+        quint16 y = in.read16();
+        qint16 cameraX = in.read16();
+        qint16 cameraY = in.read16();
+        quint8 id = in.read8();
+        quint8 destArea = in.read8();
+        quint8 destEntr = in.read8();
+        quint8 entrType = in.read8();
+        in.skip(4);
+        quint16 settings = in.read16();
+        in.skip(2);
+        quint8 entrUnk1 = in.read8();
+        quint8 entrUnk2 = in.read8();
+        in.skip(2);
 
         Entrance* entr = new Entrance(to20(x), to20(y), cameraX, cameraY, id, destArea, destEntr, entrType, settings, entrUnk1, entrUnk2);
         entr->setRect();
@@ -154,25 +157,25 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     }
 
     // Block 7: Sprites
-    header->seek(blockOffsets[7]);
+    in.seek(blockOffsets[7]);
     for (;;)
     {
-        quint16 id = header->read16();
+        quint16 id = in.read16();
         if (id == 0xFFFF) break;
 
-        qint32 x = to20(header->read16());
-        qint32 y = to20(header->read16());
+        qint32 x = to20(in.read16());
+        qint32 y = to20(in.read16());
 
         Sprite* spr = new Sprite(x, y, id);
 
-        for (int i=0; i<2; i++) spr->setByte(i, header->read8());
-        spr->setNybbleData(header->read32(), 4, 11);
-        spr->setNybbleData(header->read32(), 12, 19);
-        header->skip(1);
-        spr->setLayer(header->read8());
-        for (int i=10; i<12; i++) spr->setByte(i, header->read8());
+        for (int i=0; i<2; i++) spr->setByte(i, in.read8());
+        spr->setNybbleData(in.read32(), 4, 11);
+        spr->setNybbleData(in.read32(), 12, 19);
+        in.skip(1);
+        spr->setLayer(in.read8());
+        for (int i=10; i<12; i++) spr->setByte(i, in.read8());
 
-        header->skip(4);
+        in.skip(4);
 
         spr->setRect();
         sprites.append(spr);
@@ -185,44 +188,44 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
 
 
     // Block 9: Zones
-    header->seek(blockOffsets[9]);
+    in.seek(blockOffsets[9]);
     for (int z = 0; z < (int)(blockSizes[9]/28); z++)
     {
-        quint16 x = header->read16();
-        quint16 y = header->read16();
-        quint16 width = header->read16();
-        quint16 height = header->read16();
-        quint16 zoneUnk1 = header->read16();
-        header->skip(2);
-        quint8 id = header->read8();
-        quint8 boundingId = header->read8();
-        header->skip(6);
-        quint8 multiplayerTracking = header->read8();
-        quint8 progPathId = header->read8();
-        quint8 musicId = header->read8();
-        header->skip(1);
-        quint8 backgroundId = header->read8();
-        quint8 cameraFlags = header->read8();
-        header->skip(2);
+        quint16 x = in.read16();
+        quint16 y = in.read16();
+        quint16 width = in.read16();
+        quint16 height = in.read16();
+        quint16 zoneUnk1 = in.read16();
+        in.skip(2);
+        quint8 id = in.read8();
+        quint8 boundingId = in.read8();
+        in.skip(6);
+        quint8 multiplayerTracking = in.read8();
+        quint8 progPathId = in.read8();
+        quint8 musicId = in.read8();
+        in.skip(1);
+        quint8 backgroundId = in.read8();
+        quint8 cameraFlags = in.read8();
+        in.skip(2);
 
         Zone* zone = new Zone(to20(x), to20(y), to20(width), to20(height), id, progPathId, musicId, multiplayerTracking, zoneUnk1, boundingId, backgroundId, cameraFlags);
         zones.append(zone);
     }
 
     // Block 10: Locations
-    header->seek(blockOffsets[10]);
+    in.seek(blockOffsets[10]);
     for (int l = 0; l < (int)(blockSizes[10]/12); l++)
     {
-        qint32 x = to20(header->read16());
-        qint32 y = to20(header->read16());
-        qint32 w = to20(header->read16());
-        qint32 h = to20(header->read16());
-        qint32 id = header->read8();
+        qint32 x = to20(in.read16());
+        qint32 y = to20(in.read16());
+        qint32 w = to20(in.read16());
+        qint32 h = to20(in.read16());
+        qint32 id = in.read8();
 
         Location* loc = new Location(x, y, w, h, id);
         locations.append(loc);
 
-        header->skip(3);
+        in.skip(3);
     }
 
     // Block 11/12: Empty
@@ -230,30 +233,30 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     // Block 13/14: Paths
     for (int p = 0; p < (int)(blockSizes[13]/12); p++)
     {
-        header->seek(blockOffsets[13]+p*12);
-        quint8 id = header->read8();
-        header->skip(1);
-        quint16 nodeOffset = header->read16();
-        quint16 nodeCount = header->read16();
-        quint16 loopFlag = header->read16();
-        header->skip(4);
+        in.seek(blockOffsets[13]+p*12);
+        quint8 id = in.read8();
+        in.skip(1);
+        quint16 nodeOffset = in.read16();
+        quint16 nodeCount = in.read16();
+        quint16 loopFlag = in.read16();
+        in.skip(4);
 
         Path* path = new Path(id, loopFlag);
 
         for (quint16 i = 0; i < nodeCount; i++)
         {
-            header->seek(blockOffsets[14] + i*20 + nodeOffset*20);
+            in.seek(blockOffsets[14] + i*20 + nodeOffset*20);
 
-            qint32 x = to20(header->read16());
-            qint32 y = to20(header->read16());
-            float speed = header->readFloat();
-            float accel = header->readFloat();
-            quint16 delay = header->read16();
-            qint16 rotation = header->read16();
+            qint32 x = to20(in.read16());
+            qint32 y = to20(in.read16());
+            float speed = in.readFloat();
+            float accel = in.readFloat();
+            quint16 delay = in.read16();
+            qint16 rotation = in.read16();
 
-            quint8 variableField = header->read8();
-            quint8 nextPathID = header->read8();
-            header->skip(2);
+            quint8 variableField = in.read8();
+            quint8 nextPathID = in.read8();
+            in.skip(2);
 
             PathNode* pathN = new PathNode(x, y, speed, accel, delay, rotation, variableField, nextPathID, path);
             path->insertNode(pathN);
@@ -264,21 +267,21 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
     // Block: 15/16 Progress Paths
     for (int p = 0; p < (int)(blockSizes[15]/12); p++)
     {
-        header->seek(blockOffsets[15]+p*12);
-        quint16 id = header->read16();
-        quint16 nodeOffset = header->read16();
-        quint16 nodeCount = header->read16();
-        header->skip(3);
-        quint8 alternatePathFlag = header->read8();
+        in.seek(blockOffsets[15]+p*12);
+        quint16 id = in.read16();
+        quint16 nodeOffset = in.read16();
+        quint16 nodeCount = in.read16();
+        in.skip(3);
+        quint8 alternatePathFlag = in.read8();
 
         ProgressPath* pPath = new ProgressPath(id, alternatePathFlag);
 
         for (int i = 0; i < nodeCount; i++)
         {
-            header->seek(blockOffsets[16] + i*20 + nodeOffset*20);
+            in.seek(blockOffsets[16] + i*20 + nodeOffset*20);
 
-            qint32 x = to20(header->read16());
-            qint32 y = to20(header->read16());
+            qint32 x = to20(in.read16());
+            qint32 y = to20(in.read16());
 
             ProgressPathNode* pPathN = new ProgressPathNode(x, y, pPath);
             pPath->insertNode(pPathN);
@@ -299,35 +302,59 @@ Level::Level(Game *game, SarcFilesystem* archive, int area, QString lvlName)
         FileBase* bgdat = archive->openFile(bgdatfile);
         bgdat->open();
         bgdat->seek(0);
+        FileBytes bgdatData = bgdat->peek(bgdat->size());
+        BinaryCursor<> bgdatIn(bgdatData);
         for (;;)
         {
-            if (bgdat->pos() >= bgdat->size()) break;
-            quint16 id = bgdat->read16();
+            if (bgdatIn.atEnd()) break;
+            quint16 id = bgdatIn.read16();
             if (id == 0xFFFF) break;
 
-            qint32 x = bgdat->read16()*20;
-            qint32 y = bgdat->read16()*20;
-            qint32 w = bgdat->read16()*20;
-            qint32 h = bgdat->read16()*20;
+            qint32 x = bgdatIn.read16()*20;
+            qint32 y = bgdatIn.read16()*20;
+            qint32 w = bgdatIn.read16()*20;
+            qint32 h = bgdatIn.read16()*20;
 
             BgdatObject* obj = new BgdatObject(x, y, w, h, id, l);
 
             objects[l].append(obj);
 
-            bgdat->skip(6);
+            bgdatIn.skip(6);
         }
         bgdat->close();
         delete bgdat;
     }
+
+    for (int l = 0; l < 2; l++)
+        foreach (BgdatObject* obj, objects[l]) objectIndex.insert(obj);
+    foreach (Sprite* spr, sprites) objectIndex.insert(spr);
+    foreach (Entrance* entr, entrances) objectIndex.insert(entr);
+    foreach (Location* loc, locations) objectIndex.insert(loc);
+
+    ObjectIndex::renumber(objects[0]);
+    ObjectIndex::renumber(objects[1]);
+    ObjectIndex::renumber(sprites);
+    ObjectIndex::renumber(entrances);
+    ObjectIndex::renumber(locations);
+
+    tilemap = new LevelTilemap(&objectIndex, objects,
+        [this](int slot, int num, int x, int y, int w, int h, const TileVisitor& visit)
+        {
+            if (num >= tilesets[slot]->getNumObjects())
+                return false;
+
+            tilesets[slot]->expandObject(num, x, y, w, h, visit);
+            return true;
+        },
+        [this](int slot) { return tilesets[slot] ? tilesets[slot]->getObjectRevision() : 0; });
 }
 
 Level::~Level()
 {
+    delete tilemap;
+
     for (int t = 0; t < 4; t++)
-    {
-        if (tilesets[t])
-            delete tilesets[t];
-    }
+        game->releaseTileset(tilesets[t]);
 
     for (int l = 0; l < 2; l++)
     {
@@ -385,6 +412,9 @@ qint8 Level::save()
         delete msgBox;
     }*/
 
+    // write all area files to the archive in one go
+    FilesystemTransaction transaction(archive);
+
     // Save BGDat
     QString bgdatfiletemp = QString("/course/course%1_bgdatL%2.bin").arg(area);
     for (int l = 0; l < 2; l++)
@@ -405,20 +435,22 @@ qint8 Level::save()
             bgdat->setIdPath(bgdatfile);
         }
 
-        bgdat->open();
-        bgdat->resize(objects[l].size()*16+2);
-        bgdat->seek(0);
-
+        BinaryWriter<> out(objects[l].size()*16+2);
         foreach (BgdatObject* obj, objects[l])
         {
-            bgdat->write16(obj->getid());
-            bgdat->write16(obj->getx()/20);
-            bgdat->write16(obj->gety()/20);
-            bgdat->write16(obj->getwidth()/20);
-            bgdat->write16(obj->getheight()/20);
-            for (int i = 0; i < 6; i++) bgdat->write8(0);
+            out.write16(obj->getid());
+            out.write16(obj->getx()/20);
+            out.write16(obj->gety()/20);
+            out.write16(obj->getwidth()/20);
+            out.write16(obj->getheight()/20);
+            out.writeZeroes(6);
         }
-        bgdat->write16(0xFFFF);
+        out.write16(0xFFFF);
+
+        bgdat->open();
+        bgdat->resize(out.size());
+        bgdat->seek(0);
+        bgdat->writeBlock(out.block());
 
         bgdat->save();
         bgdat->close();
@@ -456,6 +488,7 @@ qint8 Level::save()
             }
         }
         sprites = sortedSprites;
+        ObjectIndex::renumber(sprites);
     }
 
     // Calc Block Offsets/Sizes and File Size
@@ -536,165 +569,161 @@ qint8 Level::save()
     }
     blockSizes[16] = headersize-blockOffsets[16];
 
-    QString headerfile = QString("/course/course%1.bin").arg(area);
-    FileBase* header = archive->openFile(headerfile);
-    header->open();
-    header->resize(headersize);
-    header->seek(0);
+    BinaryWriter<> out(headersize);
 
     // Block Offsets/Sizes
     for (int i = 0; i < 17; i++)
     {
-        header->write32(blockOffsets[i]);
-        header->write32(blockSizes[i]);;
+        out.write32(blockOffsets[i]);
+        out.write32(blockSizes[i]);;
     }
 
     // Block 0: Tileset Names
-    header->seek(blockOffsets[0]);
+    out.seek(blockOffsets[0]);
     for (int i = 0; i < 4; i++)
     {
         if (!tilesets[i])
             for (int j = 0; j < 32; j++)
-                header->write8(0);
+                out.write8(0);
         else
-            header->writeStringASCII(tilesets[i]->getName(), 32);
+            out.writeStringASCII(tilesets[i]->getName(), 32);
     }
 
     // Block 1: Area Settings
-    header->seek(blockOffsets[1]);
-    header->write64(eventState);
-    header->write16(unk1);
-    header->write16(timeLimit);
-    header->write8(0);
-    for (int j = 0; j < 3; j++) header->write8(0x64);
-    header->write8(levelEntranceID);
-    header->write8(unk2);
-    header->write8(specialLevelFlag);
-    header->write8(specialLevelFlag2);
-    header->write16(coinRushTimeLimit);
-    header->write16(0);
+    out.seek(blockOffsets[1]);
+    out.write64(eventState);
+    out.write16(unk1);
+    out.write16(timeLimit);
+    out.write8(0);
+    for (int j = 0; j < 3; j++) out.write8(0x64);
+    out.write8(levelEntranceID);
+    out.write8(unk2);
+    out.write8(specialLevelFlag);
+    out.write8(specialLevelFlag2);
+    out.write16(coinRushTimeLimit);
+    out.write16(0);
 
     // Block 2: Zone Boundings
-    header->seek(blockOffsets[2]);
+    out.seek(blockOffsets[2]);
     foreach (ZoneBounding* bounding, boundings)
     {
-        header->write32(bounding->getPrimaryUpperBound());
-        header->write32(bounding->getPrimaryLowerBound());
-        header->write32(bounding->getSecondaryUpperBound());
-        header->write32(bounding->getSecondaryLowerBound());
-        header->write16(bounding->getId());
-        header->write16(bounding->getUpScrolling());
-        for (int j = 0; j < 8; j++) header->write8(0);
+        out.write32(bounding->getPrimaryUpperBound());
+        out.write32(bounding->getPrimaryLowerBound());
+        out.write32(bounding->getSecondaryUpperBound());
+        out.write32(bounding->getSecondaryLowerBound());
+        out.write16(bounding->getId());
+        out.write16(bounding->getUpScrolling());
+        for (int j = 0; j < 8; j++) out.write8(0);
     }
 
     // Block 3: Unknown / Useless
-    header->seek(blockOffsets[3]);
-    for (int i = 0; i < 8; i++) header->write8(0);  // There is an unknown value, probably useless
+    out.seek(blockOffsets[3]);
+    for (int i = 0; i < 8; i++) out.write8(0);  // There is an unknown value, probably useless
 
     // Block 4: Zone Backgrounds
-    header->seek(blockOffsets[4]);
+    out.seek(blockOffsets[4]);
     foreach (ZoneBackground* background, backgrounds)
     {
-        header->write16(background->getId());
-        header->write16(background->getYPos());
-        header->write16(background->getXPos());
-        header->write16(0);
-        header->writeStringASCII(background->getName(), 16);
-        header->write16(background->getParallaxMode());
-        header->write16(0);
+        out.write16(background->getId());
+        out.write16(background->getYPos());
+        out.write16(background->getXPos());
+        out.write16(0);
+        out.writeStringASCII(background->getName(), 16);
+        out.write16(background->getParallaxMode());
+        out.write16(0);
     }
 
     // Block 5: Unknown / Dummy
-    header->seek(blockOffsets[5]);
+    out.seek(blockOffsets[5]);
     {
-        header->write16(0);
-        header->write32(0xFFFFFFFF);
-        for (int i = 0; i < 14; i++) header->write8(0);
+        out.write16(0);
+        out.write32(0xFFFFFFFF);
+        for (int i = 0; i < 14; i++) out.write8(0);
     }
 
     // Block 6: Entrances
-    header->seek(blockOffsets[6]);
+    out.seek(blockOffsets[6]);
     foreach (Entrance* entr, entrances)
     {
-        header->write16(to16(entr->getx()));
-        header->write16(to16(entr->gety()));
-        header->write16(entr->getCameraX());
-        header->write16(entr->getCameraY());
-        header->write8(entr->getid());
-        header->write8(entr->getDestArea());
-        header->write8(entr->getDestEntr());
-        header->write8(entr->getEntrType());
-        header->write8(0);
-        header->write8(getNextZoneID(entr));
-        for (int i = 0; i < 2; i++) header->write8(0);
-        header->write16(entr->getSettings());
-        for (int i = 0; i < 2; i++) header->write8(0);
-        header->write8(entr->getUnk1());
-        header->write8(entr->getUnk2());
-        for (int i = 0; i < 2; i++) header->write8(0);
+        out.write16(to16(entr->getx()));
+        out.write16(to16(entr->gety()));
+        out.write16(entr->getCameraX());
+        out.write16(entr->getCameraY());
+        out.write8(entr->getid());
+        out.write8(entr->getDestArea());
+        out.write8(entr->getDestEntr());
+        out.write8(entr->getEntrType());
+        out.write8(0);
+        out.write8(getNextZoneID(entr));
+        for (int i = 0; i < 2; i++) out.write8(0);
+        out.write16(entr->getSettings());
+        for (int i = 0; i < 2; i++) out.write8(0);
+        out.write8(entr->getUnk1());
+        out.write8(entr->getUnk2());
+        for (int i = 0; i < 2; i++) out.write8(0);
     }
 
     // Block 7: Sprites
-    header->seek(blockOffsets[7]);
+    out.seek(blockOffsets[7]);
     foreach (Sprite* spr, sprites)
     {
-        header->write16(spr->getid());
-        header->write16(to16(spr->getx()));
-        header->write16(to16(spr->gety()));
-        header->write8(spr->getByte(0));
-        header->write8(spr->getByte(1));
-        header->write32(spr->getNybbleData(4, 11));
-        header->write32(spr->getNybbleData(12, 19));
-        header->write8(getNextZoneID(spr));
-        header->write8(spr->getLayer());
-        header->write8(spr->getByte(10));
-        header->write8(spr->getByte(11));
-        for (int i = 0; i < 4; i++) header->write8(0);
+        out.write16(spr->getid());
+        out.write16(to16(spr->getx()));
+        out.write16(to16(spr->gety()));
+        out.write8(spr->getByte(0));
+        out.write8(spr->getByte(1));
+        out.write32(spr->getNybbleData(4, 11));
+        out.write32(spr->getNybbleData(12, 19));
+        out.write8(getNextZoneID(spr));
+        out.write8(spr->getLayer());
+        out.write8(spr->getByte(10));
+        out.write8(spr->getByte(11));
+        for (int i = 0; i < 4; i++) out.write8(0);
     }
-    header->write32(0xFFFFFFFF);
+    out.write32(0xFFFFFFFF);
 
     // Block 8: Sprites Used
-    header->seek(blockOffsets[8]);
+    out.seek(blockOffsets[8]);
     foreach (quint16 sprite, spritesUsed)
     {
-        header->write16(sprite);
-        header->write16(0);
+        out.write16(sprite);
+        out.write16(0);
     }
 
     // Block 9: Zones
-    header->seek(blockOffsets[9]);
+    out.seek(blockOffsets[9]);
     for (quint8 i = 0; i < zones.size(); i++)
     {
         Zone* z = zones[i];
-        header->write16(to16(z->getx()));
-        header->write16(to16(z->gety()));
-        header->write16(to16(z->getwidth()));
-        header->write16(to16(z->getheight()));
-        header->write16(z->getUnk1());
-        header->write16(0);
-        header->write8(z->getid());
-        header->write8(z->getBoundingId());
-        for (int j = 0; j < 6; j++) header->write8(0);
-        header->write8(z->getMultiplayerTracking());
-        header->write8(z->getProgPathId());
-        header->write8(z->getMusicId());
-        header->write8(0);
-        header->write8(z->getBackgroundId());
-        header->write8(z->getCameraFlags());
-        for (int j = 0; j < 2; j++) header->write8(0);
+        out.write16(to16(z->getx()));
+        out.write16(to16(z->gety()));
+        out.write16(to16(z->getwidth()));
+        out.write16(to16(z->getheight()));
+        out.write16(z->getUnk1());
+        out.write16(0);
+        out.write8(z->getid());
+        out.write8(z->getBoundingId());
+        for (int j = 0; j < 6; j++) out.write8(0);
+        out.write8(z->getMultiplayerTracking());
+        out.write8(z->getProgPathId());
+        out.write8(z->getMusicId());
+        out.write8(0);
+        out.write8(z->getBackgroundId());
+        out.write8(z->getCameraFlags());
+        for (int j = 0; j < 2; j++) out.write8(0);
     }
 
 
     // Block 10: Locations
-    header->seek(blockOffsets[10]);
+    out.seek(blockOffsets[10]);
     foreach (Location* loc, locations)
     {
-        header->write16(to16(loc->getx()));
-        header->write16(to16(loc->gety()));
-        header->write16(to16(loc->getwidth()));
-        header->write16(to16(loc->getheight()));
-        header->write8(loc->getid());
-        for (int i = 0; i < 3; i++) header->write8(0);
+        out.write16(to16(loc->getx()));
+        out.write16(to16(loc->gety()));
+        out.write16(to16(loc->getwidth()));
+        out.write16(to16(loc->getheight()));
+        out.write8(loc->getid());
+        for (int i = 0; i < 3; i++) out.write8(0);
     }
 
     // Block 11/12: Empty
@@ -704,26 +733,26 @@ qint8 Level::save()
     for (int i = 0; i < paths.size(); i++)
     {
         Path* p = paths[i];
-        header->seek(blockOffsets[13] + i*12);
-        header->write8(p->getid());
-        header->write8(0);
-        header->write16(actualNodeCount1);
-        header->write16(p->getNumberOfNodes());
-        header->write16(p->getLoop());
-        header->write32(0);
+        out.seek(blockOffsets[13] + i*12);
+        out.write8(p->getid());
+        out.write8(0);
+        out.write16(actualNodeCount1);
+        out.write16(p->getNumberOfNodes());
+        out.write16(p->getLoop());
+        out.write32(0);
 
         foreach (PathNode* pNode, p->getNodes())
         {
-            header->seek(blockOffsets[14] + actualNodeCount1*20);
-            header->write16(to16(pNode->getx()));
-            header->write16(to16(pNode->gety()));
-            header->writeFloat(pNode->getSpeed());
-            header->writeFloat(pNode->getAccel());
-            header->write16(pNode->getDelay());
-            header->write16(pNode->getRotation());
-            header->write8(pNode->getVariableField());
-            header->write8(pNode->getNextPathID());
-            header->write16(0);
+            out.seek(blockOffsets[14] + actualNodeCount1*20);
+            out.write16(to16(pNode->getx()));
+            out.write16(to16(pNode->gety()));
+            out.writeFloat(pNode->getSpeed());
+            out.writeFloat(pNode->getAccel());
+            out.write16(pNode->getDelay());
+            out.write16(pNode->getRotation());
+            out.write8(pNode->getVariableField());
+            out.write8(pNode->getNextPathID());
+            out.write16(0);
 
             actualNodeCount1++;
         }
@@ -734,28 +763,38 @@ qint8 Level::save()
     for (int i = 0; i < progressPaths.size(); i++)
     {
         ProgressPath* p = progressPaths[i];
-        header->seek(blockOffsets[15] + i*12);
-        header->write16(p->getid());
-        header->write16(actualNodeCount2);
-        header->write16(p->getNumberOfNodes());
-        for (int j = 0; j < 3; j++) header->write8(0);
-        header->write8(p->getAlternatePathFlag());
-        header->write16(0);
+        out.seek(blockOffsets[15] + i*12);
+        out.write16(p->getid());
+        out.write16(actualNodeCount2);
+        out.write16(p->getNumberOfNodes());
+        for (int j = 0; j < 3; j++) out.write8(0);
+        out.write8(p->getAlternatePathFlag());
+        out.write16(0);
 
         foreach (ProgressPathNode* pNode, p->getNodes())
         {
-            header->seek(blockOffsets[16] + actualNodeCount2*20);
-            header->write16(to16(pNode->getx()));
-            header->write16(to16(pNode->gety()));
-            for (int j = 0; j < 16; j++) header->write8(0);
+            out.seek(blockOffsets[16] + actualNodeCount2*20);
+            out.write16(to16(pNode->getx()));
+            out.write16(to16(pNode->gety()));
+            for (int j = 0; j < 16; j++) out.write8(0);
             actualNodeCount2++;
         }
     }
 
+    QString headerfile = QString("/course/course%1.bin").arg(area);
+    FileBase* header = archive->openFile(headerfile);
+    header->open();
+    header->resize(out.size());
+    header->seek(0);
+    header->writeBlock(out.block());
     header->save();
     header->close();
     delete header;
 
+    // rolled back by someone else's failure meanwhile
+    if (!transaction.commit())
+        return 1;
+
     return 0;
 }
 
@@ -792,22 +831,74 @@ void Level::add(QList<Object *> objs)
 
 void Level::add(Object *obj)
 {
+    if (!is<Zone*>(obj))
+        objectIndex.insert(obj);
+
     if (is<BgdatObject*>(obj))
     {
         BgdatObject* bgdatobj = dynamic_cast<BgdatObject*>(obj);
         objects[bgdatobj->getLayer()].append(bgdatobj);
+        ObjectIndex::setOrder(objects[bgdatobj->getLayer()], objects[bgdatobj->getLayer()].size()-1);
     }
     else if (is<Sprite*>(obj))
+    {
         sprites.append(dynamic_cast<Sprite*>(obj));
+        ObjectIndex::setOrder(sprites, sprites.size()-1);
+    }
     else if (is<Entrance*>(obj))
+    {
         entrances.append(dynamic_cast<Entrance*>(obj));
+        ObjectIndex::setOrder(entrances, entrances.size()-1);
+    }
     else if (is<Zone*>(obj))
         zones.append(dynamic_cast<Zone*>(obj));
     else if (is<Location*>(obj))
+    {
         locations.append(dynamic_cast<Location*>(obj));
+        ObjectIndex::setOrder(locations, locations.size()-1);
+    }
 }
 
 
+// picks the hits of one list out of an index query and puts them in list order
+template <typename T>
+static QList<T*> inListOrder(const QList<Object*>& hits, ObjectType type, int layer = -1)
+{
+    QList<T*> found;
+    foreach (Object* obj, hits)
+    {
+        if (obj->getType() != type)
+            continue;
+        if (layer >= 0 && static_cast<BgdatObject*>(obj)->getLayer() != layer)
+            continue;
+
+        found.append(static_cast<T*>(obj));
+    }
+
+    ObjectIndex::sortByOrder(found);
+    return found;
+}
+
+QList<BgdatObject*> Level::getBgdatObjectsIn(int layer, const QRect& rect)
+{
+    return inListOrder<BgdatObject>(objectIndex.query(rect), ObjectType::BGDATOBJECT, layer);
+}
+
+QList<Sprite*> Level::getSpritesIn(const QRect& rect)
+{
+    return inListOrder<Sprite>(objectIndex.query(rect), ObjectType::SPRITE);
+}
+
+QList<Entrance*> Level::getEntrancesIn(const QRect& rect)
+{
+    return inListOrder<Entrance>(objectIndex.query(rect), ObjectType::ENTRANCE);
+}
+
+QList<Location*> Level::getLocationsIn(const QRect& rect)
+{
+    return inListOrder<Location>(objectIndex.query(rect), ObjectType::LOCATION);
+}
+
 void Level::move(QList<Object*> objs, int deltax, int deltay)
 {
     int minX = 4096*20;
@@ -843,11 +934,13 @@ void Level::raise(Object* obj)
     {
         BgdatObject* bgdat = dynamic_cast<BgdatObject*>(obj);
         objects[bgdat->getLayer()].move(objects[bgdat->getLayer()].indexOf(bgdat), objects[bgdat->getLayer()].size()-1);
+        ObjectIndex::setOrder(objects[bgdat->getLayer()], objects[bgdat->getLayer()].size()-1);
     }
     else if (is<Sprite*>(obj))
     {
         Sprite* spr = dynamic_cast<Sprite*>(obj);
         sprites.move(sprites.indexOf(spr), sprites.size()-1);
+        ObjectIndex::setOrder(sprites, sprites.size()-1);
     }
 }
 
@@ -857,11 +950,13 @@ void Level::lower(Object *obj)
     {
         BgdatObject* bgdat = dynamic_cast<BgdatObject*>(obj);
         objects[bgdat->getLayer()].move(objects[bgdat->getLayer()].indexOf(bgdat), 0);
+        ObjectIndex::setOrder(objects[bgdat->getLayer()], 0);
     }
     else if (is<Sprite*>(obj))
     {
         Sprite* spr = dynamic_cast<Sprite*>(obj);
         sprites.move(sprites.indexOf(spr), 0);
+        ObjectIndex::setOrder(sprites, 0);
     }
 }
 
@@ -874,6 +969,7 @@ void Level::raiseLayer(BgdatObject *obj)
 
     objects[currLayer].removeOne(obj);
     objects[currLayer-1].append(obj);
+    ObjectIndex::setOrder(objects[currLayer-1], objects[currLayer-1].size()-1);
     obj->setLayer(currLayer-1);
 }
 
@@ -886,6 +982,7 @@ void Level::lowerLayer(BgdatObject *obj)
 
     objects[currLayer].removeOne(obj);
     objects[currLayer+1].append(obj);
+    ObjectIndex::setOrder(objects[currLayer+1], objects[currLayer+1].size()-1);
     obj->setLayer(currLayer+1);
 }
 
@@ -21,6 +21,8 @@
 #include "filesystem/filesystem.h"
 #include "tileset.h"
 #include "objects.h"
+#include "objectindex.h"
+#include "leveltilemap.h"
 
 class Game;
 
@@ -55,6 +57,19 @@ public:
     QList<ZoneBounding*> boundings;
     QList<ZoneBackground*> backgrounds;
 
+    // bgdat objects, sprites, entrances and locations by area
+    // whatever adds them to or removes them from the lists above has to do the same here
+    ObjectIndex objectIndex;
+
+    // objects whose bounds touch rect, in the order of their list, the caller does the exact test
+    QList<BgdatObject*> getBgdatObjectsIn(int layer, const QRect& rect);
+    QList<Sprite*> getSpritesIn(const QRect& rect);
+    QList<Entrance*> getEntrancesIn(const QRect& rect);
+    QList<Location*> getLocationsIn(const QRect& rect);
+
+    // the finished tiles of both layers, call update() on it after changing bgdat objects or tilesets
+    LevelTilemap* tilemap;
+
     void getName(QString& name)
     {
         name = QString("%1, Area %2").arg(lvlName).arg(area);
@@ -1,4 +1,5 @@
 #include "levelcommands.h"
+#include "game.h"
 
 namespace Commands::LevelCmd {
 
@@ -34,6 +35,7 @@ void LowerObject::redo() {
 
 SetTileset::SetTileset(Level *level, quint8 tsSlot, Tileset* tileset) :
     level(level),
+    game(level->game),
     tsSlot(tsSlot),
     newTs(tileset),
     oldTs(level->tilesets[tsSlot]) {
@@ -41,10 +43,11 @@ SetTileset::SetTileset(Level *level, quint8 tsSlot, Tileset* tileset) :
 }
 
 SetTileset::~SetTileset() {
+    // the level may be gone by now, only the game is sure to be there
     if (newTsDeletable) {
-        delete newTs;
+        game->releaseTileset(newTs);
     } else {
-        delete oldTs;
+        game->releaseTileset(oldTs);
     }
 }
 
@@ -73,11 +76,14 @@ InsertBgdatObj::~InsertBgdatObj() {
 
 void InsertBgdatObj::undo() {
     level->objects[obj->getLayer()].removeOne(obj);
+    level->objectIndex.remove(obj);
     deletable = true;
 }
 
 void InsertBgdatObj::redo() {
     level->objects[obj->getLayer()].append(obj);
+    ObjectIndex::setOrder(level->objects[obj->getLayer()], level->objects[obj->getLayer()].size()-1);
+    level->objectIndex.insert(obj);
     deletable = false;
 }
 
@@ -97,11 +103,14 @@ DeleteBgdatObject::~DeleteBgdatObject() {
 
 void DeleteBgdatObject::undo() {
     level->objects[obj->getLayer()].insert(oldIndex, obj);
+    ObjectIndex::setOrder(level->objects[obj->getLayer()], oldIndex);
+    level->objectIndex.insert(obj);
     deletable = false;
 }
 
 void DeleteBgdatObject::redo() {
     level->objects[obj->getLayer()].removeOne(obj);
+    level->objectIndex.remove(obj);
     deletable = true;
 }
 
@@ -117,6 +126,7 @@ RaiseBgdatLayer::RaiseBgdatLayer(Level *level, BgdatObject *obj) :
 void RaiseBgdatLayer::undo() {
     level->objects[newLayer].removeOne(obj);
     level->objects[prevLayer].insert(prevIndex, obj);
+    ObjectIndex::setOrder(level->objects[prevLayer], prevIndex);
     obj->setLayer(prevLayer);
 }
 
@@ -137,6 +147,7 @@ LowerBgdatLayer::LowerBgdatLayer(Level *level, BgdatObject *obj) :
 void LowerBgdatLayer::undo() {
     level->objects[newLayer].removeOne(obj);
     level->objects[prevLayer].insert(prevIndex, obj);
+    ObjectIndex::setOrder(level->objects[prevLayer], prevIndex);
     obj->setLayer(prevLayer);
 }
 
@@ -160,6 +171,7 @@ InsertSprite::~InsertSprite() {
 
 void InsertSprite::undo() {
     level->sprites.removeOne(spr);
+    level->objectIndex.remove(spr);
 
     if (level->isCameraLimit(spr)) {
         level->removeCameraLimit(spr);
@@ -170,6 +182,8 @@ void InsertSprite::undo() {
 
 void InsertSprite::redo() {
     level->sprites.append(spr);
+    ObjectIndex::setOrder(level->sprites, level->sprites.size()-1);
+    level->objectIndex.insert(spr);
 
     if (level->isCameraLimit(spr)) {
         level->insertCameraLimit(spr);
@@ -194,6 +208,8 @@ DeleteSprite::~DeleteSprite() {
 
 void DeleteSprite::undo() {
     level->sprites.insert(oldIndex, spr);
+    ObjectIndex::setOrder(level->sprites, oldIndex);
+    level->objectIndex.insert(spr);
 
     if (level->isCameraLimit(spr)) {
         level->insertCameraLimit(spr);
@@ -204,6 +220,7 @@ void DeleteSprite::undo() {
 
 void DeleteSprite::redo() {
     level->sprites.removeOne(spr);
+    level->objectIndex.remove(spr);
 
     if (level->isCameraLimit(spr)) {
         level->removeCameraLimit(spr);
@@ -227,11 +244,14 @@ InsertEntrance::~InsertEntrance() {
 
 void InsertEntrance::undo() {
     level->entrances.removeOne(entr);
+    level->objectIndex.remove(entr);
     deletable = true;
 }
 
 void InsertEntrance::redo() {
     level->entrances.append(entr);
+    ObjectIndex::setOrder(level->entrances, level->entrances.size()-1);
+    level->objectIndex.insert(entr);
     deletable = false;
 }
 
@@ -251,11 +271,14 @@ DeleteEntrance::~DeleteEntrance() {
 
 void DeleteEntrance::undo() {
     level->entrances.insert(oldIndex, entr);
+    ObjectIndex::setOrder(level->entrances, oldIndex);
+    level->objectIndex.insert(entr);
     deletable = false;
 }
 
 void DeleteEntrance::redo() {
     level->entrances.removeOne(entr);
+    level->objectIndex.remove(entr);
     deletable = true;
 }
 
@@ -413,11 +436,14 @@ InsertLocation::~InsertLocation() {
 
 void InsertLocation::undo() {
     level->locations.removeOne(location);
+    level->objectIndex.remove(location);
     deletable = true;
 }
 
 void InsertLocation::redo() {
     level->locations.append(location);
+    ObjectIndex::setOrder(level->locations, level->locations.size()-1);
+    level->objectIndex.insert(location);
     deletable = false;
 }
 
@@ -437,11 +463,14 @@ DeleteLocation::~DeleteLocation() {
 
 void DeleteLocation::undo() {
     level->locations.insert(oldIndex, loc);
+    ObjectIndex::setOrder(level->locations, oldIndex);
+    level->objectIndex.insert(loc);
     deletable = false;
 }
 
 void DeleteLocation::redo() {
     level->locations.removeOne(loc);
+    level->objectIndex.remove(loc);
     deletable = true;
 }
 
@@ -46,6 +46,7 @@ public:
 
 private:
     Level *const level;
+    Game *const game;
     const quint8 tsSlot;
     Tileset *newTs;
     Tileset *oldTs;
@@ -584,11 +584,11 @@ QList<Object*> EditManager::getObjectsAtPos(int x1, int y1, int x2, int y2, bool
     {
         if (!(layerMask & (1 << l)))
             continue;
-        foreach (BgdatObject* bgdat, level->objects[l]) if (bgdat->clickDetection(area)) objects.append(bgdat);
+        foreach (BgdatObject* bgdat, level->getBgdatObjectsIn(l, area)) if (bgdat->clickDetection(area)) objects.append(bgdat);
     }
-    if (locationInteraction) foreach (Location* loc, level->locations) if (loc->clickDetection(area)) objects.append(loc);
-    if (spriteInteraction) foreach (Sprite* spr, level->sprites) if (spr->clickDetection(area)) objects.append(spr);
-    if (entranceInteraction) foreach (Entrance* entr, level->entrances) if (entr->clickDetection(area)) objects.append(entr);
+    if (locationInteraction) foreach (Location* loc, level->getLocationsIn(area)) if (loc->clickDetection(area)) objects.append(loc);
+    if (spriteInteraction) foreach (Sprite* spr, level->getSpritesIn(area)) if (spr->clickDetection(area)) objects.append(spr);
+    if (entranceInteraction) foreach (Entrance* entr, level->getEntrancesIn(area)) if (entr->clickDetection(area)) objects.append(entr);
     if (pathInteraction) foreach (Path* path, level->paths) foreach (PathNode* node, path->getNodes()) if (node->clickDetection(area)) objects.append(node);
     if (pathInteraction) foreach (ProgressPath* path, level->progressPaths) foreach (ProgressPathNode* node, path->getNodes()) if (node->clickDetection(area)) objects.append(node);
 
@@ -173,6 +173,9 @@ LevelEditorWindow::LevelEditorWindow(LevelManager* lvlMgr, int initialArea) :
     loadSettings();
     setStatus(Ready);
 
+    connect(lvlMgr->getArchiveWriter(), &AsyncArchiveWriter::progress, this, &LevelEditorWindow::archiveWriteProgress);
+    connect(lvlMgr->getArchiveWriter(), &AsyncArchiveWriter::finished, this, &LevelEditorWindow::archiveWriteFinished);
+
 #ifdef USE_KDE_BLUR
     if (KWindowEffects::isEffectAvailable(KWindowEffects::BlurBehind))
     {
@@ -190,6 +193,10 @@ LevelEditorWindow::LevelEditorWindow(LevelManager* lvlMgr, int initialArea) :
 
 LevelEditorWindow::~LevelEditorWindow()
 {
+    // commands point into the level, they have to go before it does
+    undoStack->blockSignals(true);
+    undoStack->clear();
+
     if (closeLvlOnClose)
         lvlMgr->closeArea(level);
     if (lvlMgr->getOpenedAreaCount() == 0)
@@ -383,6 +390,10 @@ void LevelEditorWindow::setStatus(EditorStatus newStatus)
         status = SaveFailed;
         statusLabel->setText(tr("Save Failed"));
         break;
+    case EditorStatus::Saving:
+        status = Saving;
+        statusLabel->setText(tr("Saving..."));
+        break;
     case EditorStatus::ChangesSaved:
         status = ChangesSaved;
         statusLabel->setText(tr("Changes Saved"));
@@ -398,8 +409,29 @@ void LevelEditorWindow::on_actionSave_triggered()
         setStatus(SaveFailed);
     }
     else {
-        setStatus(ChangesSaved);
+        // the archive is written to disk in the background, see archiveWriteFinished()
+        setStatus(Saving);
+    }
+}
+
+void LevelEditorWindow::archiveWriteProgress(int percent)
+{
+    if (status == Saving)
+        statusLabel->setText(tr("Saving... %1%").arg(percent));
+}
+
+void LevelEditorWindow::archiveWriteFinished(bool success, QString error)
+{
+    if (!success)
+    {
+        setStatus(SaveFailed);
+        statusLabel->setText(tr("Save Failed: %1").arg(error));
+        return;
     }
+
+    // edits made in the meantime are still unsaved, and a newer snapshot may still be queued
+    if (status == Saving && !lvlMgr->getArchiveWriter()->isBusy())
+        setStatus(ChangesSaved);
 }
 
 void LevelEditorWindow::on_actionCopy_triggered()
@@ -638,7 +670,7 @@ const int LevelEditorWindow::showSaveDialog()
     {
     case QMessageBox::Save:
         levelView->saveLevel();
-        setStatus(ChangesSaved);
+        setStatus(Saving);
         break;
     case QMessageBox::Discard:
         setStatus(Ready);
@@ -664,6 +696,12 @@ void LevelEditorWindow::on_actionAddArea_triggered() {
     }
 
     int seekArea = lvlMgr->addArea(lvlMgr->getAreaCount());
+    if (seekArea < 0)
+    {
+        QMessageBox::warning(this, "CoinKiller", tr("The area could not be added."), QMessageBox::Ok);
+        return;
+    }
+
     loadArea(seekArea);
     updateAreaSelector(seekArea);
 }
@@ -688,8 +726,18 @@ void LevelEditorWindow::on_actionDeleteCurrentArea_triggered()
     if (warning.exec() == QMessageBox::No)
         return;
 
+    int areaId = level->getAreaID();
     int seekArea = lvlMgr->removeArea(level);
 
+    // the level is closed either way, bring the area back
+    if (seekArea < 0)
+    {
+        QMessageBox::warning(this, "CoinKiller", tr("The area could not be deleted."), QMessageBox::Ok);
+        loadArea(areaId, false);
+        updateAreaSelector(areaId);
+        return;
+    }
+
     if (!lvlMgr->hasArea(seekArea))
     {
         closeLvlOnClose = false;
@@ -713,6 +761,10 @@ void LevelEditorWindow::loadArea(int id, bool closeLevel, bool init)
 
     toolboxTabs->blockSignals(true);
 
+    // commands point into the level, they have to go before it does
+    undoStack->blockSignals(true);
+    undoStack->clear();
+
     if (closeLevel)
         lvlMgr->closeArea(level);
 
@@ -727,8 +779,6 @@ void LevelEditorWindow::loadArea(int id, bool closeLevel, bool init)
 
         delete levelView;
         delete miniMap;
-
-        undoStack->blockSignals(true);
     }
 
     level = lvlMgr->openArea(id);
@@ -834,7 +884,6 @@ void LevelEditorWindow::loadArea(int id, bool closeLevel, bool init)
 
     toolboxTabs->blockSignals(false);
 
-    undoStack->clear();
     undoStack->blockSignals(false);
 
     loadSettings();
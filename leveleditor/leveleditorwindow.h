@@ -68,6 +68,9 @@ public slots:
 private slots:
     void toggleLayer(bool toggle);
 
+    void archiveWriteProgress(int percent);
+    void archiveWriteFinished(bool success, QString error);
+
     void toggleSprites(bool toggle);
 
     void toggleEntrances(bool toggle);
@@ -178,6 +181,7 @@ private:
         Ready,
         Unsaved,
         SaveFailed,
+        Saving,
         ChangesSaved
     };
 
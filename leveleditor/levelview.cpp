@@ -21,6 +21,7 @@
 #include "unitsconvert.h"
 #include "objectrenderer.h"
 #include "settingsmanager.h"
+#include "imagecache.h"
 
 #include <QApplication>
 #include <QClipboard>
@@ -43,6 +44,10 @@ LevelView::LevelView(QWidget *parent, Level *level, QUndoStack *undoStack) :
     editManager = new EditManager(level, undoStack);
     connect(editManager, SIGNAL(updateLevelView()), this, SLOT(update()));
 
+    // every change to the level goes through the undo stack
+    tileChunks = new TileChunkCache();
+    connect(undoStack, &QUndoStack::indexChanged, this, [this]() { updateTiles(); });
+
     zoom = 1;
     grid = false;
     checkerboard = false;
@@ -52,6 +57,13 @@ LevelView::LevelView(QWidget *parent, Level *level, QUndoStack *undoStack) :
     render2DTile = true;
     render3DOverlay = true;
 
+    // tileset textures are still being decoded in the background, tiles show as placeholders until then
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t])
+            level->tilesets[t]->whenImageReady(this, [this]() { update(); });
+    }
+
 #ifdef USE_KDE_BLUR
     setBackgroundColor(QColor(0,0,0,0));
 #endif
@@ -59,6 +71,7 @@ LevelView::LevelView(QWidget *parent, Level *level, QUndoStack *undoStack) :
 
 LevelView::~LevelView()
 {
+    delete tileChunks;
     delete editManager;
 }
 
@@ -86,7 +99,6 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
 
     painter.fillRect(drawrect, backgroundColor);
     //painter.fillRect(drawrect, QColor(0,0,0,0));
-    tileGrid.clear();
 
     // Render Checkerboard
     if (checkerboard)
@@ -165,35 +177,38 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
     }
 
     // Render Tiles
+    // zoomed out, the tiles come from a pre-filtered smaller atlas instead of being scaled down every frame
+    int tileLod = Tileset::lodForZoom(zoomLvl);
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t])
+            level->tilesets[t]->setDrawLod(tileLod);
+    }
+
+    // the view keeps rendered chunks, screenshots and tilesets that are still decoding are drawn directly
+    bool useChunks = (zoomLvl == zoom);
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t] && !level->tilesets[t]->isImageReady())
+            useChunks = false;
+    }
+
     for (int l = 1; l >= 0; l--)
     {
         if (!(editManager->getLayerMask() & (1<<l)))
             continue;
 
-        tileGrid[0xFFFFFFFF] = l+1;
-
-        for (int i = level->objects[l].size()-1; i >= 0; i--)
-        {
-            const BgdatObject* obj = level->objects[l].at(i);
-
-            // don't draw shit that is outside of the view
-            // (TODO: also eliminate individual out-of-view tiles)
-            if (!drawrect.intersects(QRect(obj->getx(), obj->gety(), obj->getwidth(), obj->getheight())))
-                continue;
+        if (useChunks)
+            tileChunks->draw(painter, l, drawrect, zoomLvl, [this](QPainter& p, int layer, const QRect& area) { drawTileLayer(p, layer, area); });
+        else
+            drawTileLayer(painter, l, drawrect);
+    }
 
-            quint16 tsid = (obj->getid() >> 12) & 0x3;
-            if (level->tilesets[tsid])
-            {
-                level->tilesets[tsid]->Render2DTiles(render2DTile);
-                level->tilesets[tsid]->Render3DOverlay(render3DOverlay);
-                level->tilesets[tsid]->drawObject(painter, tileGrid, obj->getid()&0x0FFF, obj->getx()/20, obj->gety()/20, obj->getwidth()/20, obj->getheight()/20, 1);
-            }
-            else
-            {
-                // TODO fallback
-                qDebug("attempt to draw obj %04X with non-existing tileset", obj->getid());
-            }
-        }
+    // sprites draw tiles into their own full size images
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t])
+            level->tilesets[t]->setDrawLod(0);
     }
 
     painter.setRenderHint(QPainter::Antialiasing);
@@ -202,10 +217,8 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
     if (editManager->locationInteractionEnabled())
     {
         painter.save();
-        for (int i = 0; i < level->locations.size(); i++)
+        foreach (const Location* loc, level->getLocationsIn(drawrect))
         {
-            const Location* loc = level->locations.at(i);
-
             QRect locrect(loc->getx(), loc->gety(), loc->getwidth(), loc->getheight());
 
             if (!drawrect.intersects(locrect))
@@ -419,10 +432,8 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
         }
 
         // Render Sprites
-        for (int i = 0; i < level->sprites.size(); i++)
+        foreach (Sprite* spr, level->getSpritesIn(drawrect))
         {
-            Sprite* spr = level->sprites.at(i);
-
             if (!spr->doRender(drawrect))
                 continue;
 
@@ -539,10 +550,8 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
     // Render Entrances
     if (editManager->entranceInteractionEnabled())
     {
-        for (int i = 0; i < level->entrances.size(); i++)
+        foreach (const Entrance* entr, level->getEntrancesIn(drawrect))
         {
-            const Entrance* entr = level->entrances.at(i);
-
             QRect entrrect(entr->getx(), entr->gety(), entr->getwidth(), entr->getheight());
 
             if (!drawrect.intersects(entrrect))
@@ -740,6 +749,64 @@ void LevelView::paint(QPainter& painter, QRect rect, float zoomLvl, bool selecti
 }
 
 
+void LevelView::drawTileLayer(QPainter& painter, int layer, const QRect& area)
+{
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t])
+        {
+            level->tilesets[t]->Render2DTiles(render2DTile);
+            level->tilesets[t]->Render3DOverlay(render3DOverlay);
+            level->tilesets[t]->beginBatch();
+        }
+    }
+
+    // cells are already resolved, each one is drawn once
+    int x0 = qMax(0, area.left() / 20), x1 = qMin(LevelTilemap::size-1, area.right() / 20);
+    int y0 = qMax(0, area.top() / 20), y1 = qMin(LevelTilemap::size-1, area.bottom() / 20);
+
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            const LevelTilemap::Cell& cell = level->tilemap->at(layer, x, y);
+            if (cell.isEmpty())
+                continue;
+
+            Tileset* ts = level->tilesets[cell.tileset];
+            if (!ts)
+                continue;
+
+            if (cell.tile == LevelTilemap::errorTile)
+                painter.drawPixmap(QRect(x*20, y*20, 20, 20), ImageCache::getInstance()->get(TileOverride, "error.png"));
+            else
+                ts->drawTile(painter, cell.tile, x, y, 1, cell.item);
+        }
+    }
+
+    for (int t = 0; t < 4; t++)
+    {
+        if (level->tilesets[t])
+            level->tilesets[t]->drawBatch(painter);
+    }
+}
+
+void LevelView::updateTiles()
+{
+    QList<QRect> changed[2];
+    if (level->tilemap->update(changed))
+    {
+        tileChunks->clear();
+        return;
+    }
+
+    for (int l = 0; l < 2; l++)
+    {
+        foreach (const QRect& rect, changed[l])
+            tileChunks->invalidate(l, rect);
+    }
+}
+
 void LevelView::mousePressEvent(QMouseEvent* evt)
 {
     setFocus();
@@ -27,6 +27,7 @@
 #include "level.h"
 #include "tileset.h"
 #include "editmanager.h"
+#include "tilechunkcache.h"
 
 class LevelView : public QWidget
 {
@@ -41,8 +42,8 @@ public:
     void toggleRenderLiquids(bool toggle) { renderLiquids = toggle; update(); }
     void toggleRenderControllers(bool toggle) { renderControllers = toggle; update(); }
     void toggleRenderCameraLimits(bool toggle) { renderCameraLimits = toggle; update(); }
-    void toggle3DOverlay(bool toggle) { render3DOverlay = toggle; update(); }
-    void toggle2DTile(bool toggle) { render2DTile = toggle; update(); }
+    void toggle3DOverlay(bool toggle) { render3DOverlay = toggle; tileChunks->clear(); update(); }
+    void toggle2DTile(bool toggle) { render2DTile = toggle; tileChunks->clear(); update(); }
 
     qint8 saveLevel();
     void copy();
@@ -81,6 +82,8 @@ protected:
 private:
 
     void paint(QPainter& painter, QRect rect, float zoomLvl, bool selections);
+    void drawTileLayer(QPainter& painter, int layer, const QRect& area);
+    void updateTiles();
 
     Level* level;
 
@@ -102,8 +105,8 @@ private:
     bool render2DTile;
     bool render3DOverlay;
 
-    // determines which tiles are already occupied
-    TileGrid tileGrid;
+    // tile layers as rendered chunks, so scrolling and hovering don't redraw every tile
+    TileChunkCache* tileChunks;
 
     QColor backgroundColor;
 
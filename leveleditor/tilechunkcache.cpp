@@ -0,0 +1,81 @@
+#include "tilechunkcache.h"
+
+TileChunkCache::TileChunkCache()
+{
+    // cost is in KiB, enough for a few screens of both layers
+    chunks.setMaxCost(96 * 1024);
+}
+
+void TileChunkCache::draw(QPainter& painter, int layer, const QRect& area, float zoom, const RenderFunc& render)
+{
+    qreal ratio = painter.device()->devicePixelRatioF();
+    if (zoom != this->zoom || ratio != pixelRatio)
+    {
+        chunks.clear();
+        this->zoom = zoom;
+        pixelRatio = ratio;
+    }
+
+    // chunks are placed on whole device pixels, the painter's own translation is kept
+    QTransform world = painter.worldTransform();
+    painter.save();
+    painter.setWorldTransform(QTransform::fromTranslate(world.dx(), world.dy()));
+
+    int x0 = qMax(0, area.left() / chunkSize), x1 = area.right() / chunkSize;
+    int y0 = qMax(0, area.top() / chunkSize), y1 = area.bottom() / chunkSize;
+
+    for (int cy = y0; cy <= y1; cy++)
+    {
+        for (int cx = x0; cx <= x1; cx++)
+        {
+            int left = qRound(cx * chunkSize * zoom);
+            int top = qRound(cy * chunkSize * zoom);
+
+            quint64 key = chunkKey(layer, cx, cy);
+            QPixmap* pix = chunks.object(key);
+            if (pix)
+            {
+                painter.drawPixmap(left, top, *pix);
+                continue;
+            }
+
+            int width = qRound((cx+1) * chunkSize * zoom) - left;
+            int height = qRound((cy+1) * chunkSize * zoom) - top;
+
+            pix = new QPixmap(QSize(width, height) * ratio);
+            pix->setDevicePixelRatio(ratio);
+            pix->fill(Qt::transparent);
+
+            QPainter chunkPainter(pix);
+            chunkPainter.translate(-left, -top);
+            chunkPainter.scale(zoom, zoom);
+            render(chunkPainter, layer, QRect(cx * chunkSize, cy * chunkSize, chunkSize, chunkSize));
+            chunkPainter.end();
+
+            painter.drawPixmap(left, top, *pix);
+
+            // the cache may delete it right away if it doesn't fit
+            chunks.insert(key, pix, qMax<qint64>(1, (qint64)pix->width() * pix->height() * 4 / 1024));
+        }
+    }
+
+    painter.restore();
+}
+
+void TileChunkCache::invalidate(int layer, const QRect& rect)
+{
+    if (rect.isEmpty())
+        return;
+
+    int x0 = qMax(0, rect.left() / chunkSize), x1 = rect.right() / chunkSize;
+    int y0 = qMax(0, rect.top() / chunkSize), y1 = rect.bottom() / chunkSize;
+
+    for (int cy = y0; cy <= y1; cy++)
+        for (int cx = x0; cx <= x1; cx++)
+            chunks.remove(chunkKey(layer, cx, cy));
+}
+
+void TileChunkCache::clear()
+{
+    chunks.clear();
+}
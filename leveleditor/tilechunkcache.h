@@ -0,0 +1,38 @@
+#ifndef TILECHUNKCACHE_H
+#define TILECHUNKCACHE_H
+
+#include <QPainter>
+#include <QPixmap>
+#include <QCache>
+#include <functional>
+
+// Tile layers rendered into fixed size chunks that are kept between paints.
+// After an edit only the chunks under the areas the level's tilemap reports as changed get dropped.
+class TileChunkCache
+{
+public:
+    // 16x16 tiles per chunk, in level coordinates
+    static const int chunkSize = 320;
+
+    // renders the tiles of one layer inside area, the painter is in level coordinates
+    typedef std::function<void(QPainter& painter, int layer, const QRect& area)> RenderFunc;
+
+    TileChunkCache();
+
+    // draws the chunks of layer covering area, rendering missing ones
+    // painter has to be scaled by zoom and may only be translated on top of that
+    void draw(QPainter& painter, int layer, const QRect& area, float zoom, const RenderFunc& render);
+
+    // drops the chunks of layer touching rect, in level coordinates
+    void invalidate(int layer, const QRect& rect);
+    void clear();
+
+private:
+    float zoom = 0;
+    qreal pixelRatio = 0;
+    QCache<quint64, QPixmap> chunks;
+
+    static quint64 chunkKey(int layer, int cx, int cy) { return ((quint64)layer << 40) | ((quint64)cy << 20) | (quint64)cx; }
+};
+
+#endif // TILECHUNKCACHE_H
@@ -176,6 +176,9 @@ void TilesetPalette::loadTileset(int tilesetNbr)
     }
     objectsModel->clear();
 
+    // redraw the previews once the texture is decoded
+    level->tilesets[tilesetNbr]->whenImageReady(this, [this, tilesetNbr]() { loadTileset(tilesetNbr); });
+
     for (int i = 0; i < level->tilesets[tilesetNbr]->getNumObjects(); i++)
     {
         ObjectDef* obj = level->tilesets[tilesetNbr]->getObjectDef(i);
@@ -9,7 +9,15 @@ LevelManager::LevelManager(WindowBase *parentWidget, Game* game, QString lvlPath
     this->lvlPath = lvlPath;
     this->game = game;
 
-    archive = new SarcFilesystem(game->fs->openFile(lvlPath));
+    FileBase* file = game->openArchiveFile(lvlPath);
+    archive = new SarcFilesystem(file);
+
+    writer = new AsyncArchiveWriter(game->getPath() + lvlPath, this);
+    archive->setAsyncWriter(writer);
+
+    LzFile* lzFile = dynamic_cast<LzFile*>(file);
+    if (lzFile)
+        writer->setCompression(lzFile->getSaveFormat());
 }
 
 LevelManager::~LevelManager()
@@ -70,17 +78,14 @@ int LevelManager::addArea(int id)
 
     int newAreaId = id+1;
 
-    for (int i = getAreaCount(); i >= newAreaId; i--)
+    FilesystemTransaction transaction(archive);
+
+    int oldAreaCount = getAreaCount();
+    for (int i = oldAreaCount; i >= newAreaId; i--)
     {
         archive->renameFile(QString("course/course%1.bin").arg(i), QString("course%1.bin").arg(i+1));
         archive->renameFile(QString("course/course%1_bgdatL1.bin").arg(i), QString("course%1_bgdatL1.bin").arg(i+1));
         archive->renameFile(QString("course/course%1_bgdatL2.bin").arg(i), QString("course%1_bgdatL2.bin").arg(i+1));
-
-        foreach (Level* area, openedAreas)
-        {
-            if (area->getAreaID() == i)
-                area->setAreaID(i+1);
-        }
     }
 
     new_course.seek(0);
@@ -99,6 +104,20 @@ int LevelManager::addArea(int id)
     newCourseFile->close();
     delete newCourseFile;
 
+    // rolled back, the areas keep their ids
+    if (!transaction.commit())
+        return -1;
+
+    // only once the archive really has them there
+    for (int i = oldAreaCount; i >= newAreaId; i--)
+    {
+        foreach (Level* area, openedAreas)
+        {
+            if (area->getAreaID() == i)
+                area->setAreaID(i+1);
+        }
+    }
+
     return newAreaId;
 }
 
@@ -113,6 +132,8 @@ int LevelManager::removeArea(Level *level)
 
     int oldAreaCount = getAreaCount();
 
+    FilesystemTransaction transaction(archive);
+
     archive->deleteFile(QString("course/course%1.bin").arg(areaId));
     archive->deleteFile(QString("course/course%1_bgdatL1.bin").arg(areaId));
     archive->deleteFile(QString("course/course%1_bgdatL2.bin").arg(areaId));
@@ -122,7 +143,14 @@ int LevelManager::removeArea(Level *level)
         archive->renameFile(QString("course/course%1.bin").arg(i), QString("course%1.bin").arg(i-1));
         archive->renameFile(QString("course/course%1_bgdatL1.bin").arg(i), QString("course%1_bgdatL1.bin").arg(i-1));
         archive->renameFile(QString("course/course%1_bgdatL2.bin").arg(i), QString("course%1_bgdatL2.bin").arg(i-1));
+    }
 
+    // rolled back, the area is still there
+    if (!transaction.commit())
+        return -1;
+
+    for (int i = areaId+1; i <= oldAreaCount; i++)
+    {
         foreach (Level* area, openedAreas)
         {
             if (area->getAreaID() == i)
@@ -16,6 +16,7 @@ public:
     Level* openArea(int id);
     void closeArea(Level* area);
 
+    // both return -1 if the archive rolled the changes back
     int addArea(int id);
     int removeArea(Level* level);
 
@@ -29,8 +30,12 @@ public:
     WindowBase* getParent();
     Game* getGame();
 
+    // reports when saved changes have actually reached the disk
+    AsyncArchiveWriter* getArchiveWriter() { return writer; }
+
 private:
     SarcFilesystem* archive;
+    AsyncArchiveWriter* writer;
 
     WindowBase* parentWidget;
     Game* game;
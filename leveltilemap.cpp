@@ -0,0 +1,188 @@
+#include "leveltilemap.h"
+#include "objectindex.h"
+#include "objects.h"
+
+#include <algorithm>
+
+const LevelTilemap::Cell LevelTilemap::emptyCell = { 0, 0xFF, 0 };
+
+LevelTilemap::LevelTilemap(ObjectIndex* index, const QList<BgdatObject*>* objects, const Expander& expand, const Revision& revision) :
+    index(index),
+    objects(objects),
+    expand(expand),
+    revision(revision)
+{
+    for (int l = 0; l < 2; l++)
+        std::fill_n(chunks[l], chunksPerSide * chunksPerSide, nullptr);
+
+    // nothing matches these, so the first update builds everything
+    std::fill_n(revisions, 4, ~0ULL);
+
+    index->setChangeListener([this](Object* obj, const QRect& rect)
+    {
+        if (obj->getType() != ObjectType::BGDATOBJECT)
+            return;
+
+        int layer = static_cast<BgdatObject*>(obj)->getLayer();
+        if (layer >= 0 && layer < 2 && !rect.isEmpty())
+            dirty[layer].append(rect);
+    });
+
+    update();
+}
+
+LevelTilemap::~LevelTilemap()
+{
+    index->setChangeListener(nullptr);
+
+    for (int l = 0; l < 2; l++)
+        clearLayer(l);
+}
+
+const LevelTilemap::Cell& LevelTilemap::at(int layer, int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= size || y >= size)
+        return emptyCell;
+
+    const Cell* chunk = chunks[layer][(y >> chunkShift) * chunksPerSide + (x >> chunkShift)];
+    if (!chunk)
+        return emptyCell;
+
+    return chunk[(y & (chunkCells-1)) * chunkCells + (x & (chunkCells-1))];
+}
+
+LevelTilemap::Cell* LevelTilemap::cellAt(int layer, int x, int y, bool create)
+{
+    if (x < 0 || y < 0 || x >= size || y >= size)
+        return nullptr;
+
+    Cell*& chunk = chunks[layer][(y >> chunkShift) * chunksPerSide + (x >> chunkShift)];
+    if (!chunk)
+    {
+        if (!create)
+            return nullptr;
+
+        chunk = new Cell[chunkCells * chunkCells];
+        std::fill_n(chunk, chunkCells * chunkCells, emptyCell);
+    }
+
+    return &chunk[(y & (chunkCells-1)) * chunkCells + (x & (chunkCells-1))];
+}
+
+void LevelTilemap::clearLayer(int layer)
+{
+    for (int i = 0; i < chunksPerSide * chunksPerSide; i++)
+    {
+        delete[] chunks[layer][i];
+        chunks[layer][i] = nullptr;
+    }
+}
+
+bool LevelTilemap::update(QList<QRect>* changed)
+{
+    // a different tileset or an edited object definition can change every tile of its objects
+    bool tilesetsChanged = false;
+    for (int t = 0; t < 4; t++)
+    {
+        quint64 rev = revision(t);
+        if (revisions[t] != rev)
+        {
+            revisions[t] = rev;
+            tilesetsChanged = true;
+        }
+    }
+
+    for (int l = 0; l < 2; l++)
+    {
+        if (tilesetsChanged)
+            rebuildLayer(l);
+        else
+        {
+            foreach (const QRect& rect, dirty[l])
+            {
+                resolve(l, rect);
+                if (changed)
+                    changed[l].append(rect);
+            }
+        }
+
+        dirty[l].clear();
+    }
+
+    return tilesetsChanged;
+}
+
+void LevelTilemap::rebuildLayer(int layer)
+{
+    const QList<BgdatObject*>& objs = objects[layer];
+
+    clearLayer(layer);
+
+    QRect all(0, 0, size, size);
+    for (int i = objs.size()-1; i >= 0; i--)
+        place(layer, objs[i], all);
+}
+
+void LevelTilemap::place(int layer, BgdatObject* obj, const QRect& tiles)
+{
+    int tsid = (obj->getid() >> 12) & 3;
+    if (!revisions[tsid])
+        return;
+
+    auto put = [&](int x, int y, int tile, int item)
+    {
+        if (!tiles.contains(x, y))
+            return;
+
+        Cell* cell = cellAt(layer, x, y, true);
+        if (!cell || !cell->isEmpty())
+            return;
+
+        cell->tile = tile;
+        cell->tileset = tsid;
+        cell->item = item;
+    };
+
+    int num = obj->getid() & 0x0FFF;
+    int x = obj->getx()/20, y = obj->gety()/20;
+    int w = obj->getwidth()/20, h = obj->getheight()/20;
+
+    if (!expand(tsid, num, x, y, w, h, put))
+    {
+        for (int yy = 0; yy < h; yy++)
+            for (int xx = 0; xx < w; xx++)
+                put(x+xx, y+yy, errorTile, 0);
+    }
+}
+
+void LevelTilemap::resolve(int layer, const QRect& rect)
+{
+    int x0 = qMax(0, rect.left() / 20), x1 = qMin(size-1, rect.right() / 20);
+    int y0 = qMax(0, rect.top() / 20), y1 = qMin(size-1, rect.bottom() / 20);
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    QRect tiles(QPoint(x0, y0), QPoint(x1, y1));
+
+    for (int y = y0; y <= y1; y++)
+    {
+        for (int x = x0; x <= x1; x++)
+        {
+            Cell* cell = cellAt(layer, x, y, false);
+            if (cell)
+                *cell = emptyCell;
+        }
+    }
+
+    QList<BgdatObject*> objs;
+    foreach (Object* obj, index->query(QRect(x0*20, y0*20, tiles.width()*20, tiles.height()*20)))
+    {
+        if (obj->getType() == ObjectType::BGDATOBJECT && static_cast<BgdatObject*>(obj)->getLayer() == layer)
+            objs.append(static_cast<BgdatObject*>(obj));
+    }
+
+    // the topmost object wins a cell, so they go in from the top down
+    ObjectIndex::sortByOrder(objs);
+    for (int i = objs.size()-1; i >= 0; i--)
+        place(layer, objs[i], tiles);
+}
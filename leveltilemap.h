@@ -0,0 +1,82 @@
+#ifndef LEVELTILEMAP_H
+#define LEVELTILEMAP_H
+
+#include <QRect>
+#include <QList>
+#include <functional>
+
+class BgdatObject;
+class ObjectIndex;
+
+// The tiles both layers end up showing, resolved from the bgdat objects.
+// Cells are kept in chunks that are only allocated once something covers them.
+// The object index reports every add, remove, move, resize, reorder and id or layer change,
+// only the cells under those areas get resolved again. Editing the objects of a tileset,
+// or swapping it, resolves everything.
+class LevelTilemap
+{
+public:
+    // level size in tiles
+    static const int size = 4096;
+
+    // tile number of cells showing an object the tileset doesn't have
+    static const quint16 errorTile = 0xFFFF;
+
+    struct Cell
+    {
+        quint16 tile;
+        quint8 tileset; // 0xFF if nothing covers the cell
+        quint8 item;
+
+        bool isEmpty() const { return tileset == 0xFF; }
+    };
+
+    typedef std::function<void(int x, int y, int tile, int item)> TileVisitor;
+
+    // visits the tiles of object num of the tileset in slot, false if the tileset has no such object
+    typedef std::function<bool(int slot, int num, int x, int y, int w, int h, const TileVisitor& visit)> Expander;
+
+    // changes whenever the tileset in slot or its objects do, 0 if the slot is empty
+    typedef std::function<quint64(int slot)> Revision;
+
+    // objects are the two bgdat layers, all of them in index
+    LevelTilemap(ObjectIndex* index, const QList<BgdatObject*>* objects, const Expander& expand, const Revision& revision);
+    ~LevelTilemap();
+    LevelTilemap(const LevelTilemap&) = delete;
+    LevelTilemap& operator=(const LevelTilemap&) = delete;
+
+    const Cell& at(int layer, int x, int y) const;
+
+    // resolves the cells changed since the last call
+    // changed areas are added to changed[layer] in level units, returns true if everything changed
+    bool update(QList<QRect>* changed = nullptr);
+
+private:
+    static const int chunkShift = 6; // 64x64 cells
+    static const int chunkCells = 1 << chunkShift;
+    static const int chunksPerSide = size >> chunkShift;
+
+    ObjectIndex* index;
+    const QList<BgdatObject*>* objects;
+    Expander expand;
+    Revision revision;
+
+    Cell* chunks[2][chunksPerSide * chunksPerSide];
+    static const Cell emptyCell;
+
+    quint64 revisions[4];
+    QList<QRect> dirty[2];
+
+    Cell* cellAt(int layer, int x, int y, bool create);
+    void clearLayer(int layer);
+
+    void rebuildLayer(int layer);
+
+    // puts down the tiles of obj inside tiles that no object above it took yet
+    void place(int layer, BgdatObject* obj, const QRect& tiles);
+
+    // resolves the cells touched by rect, in level units
+    void resolve(int layer, const QRect& rect);
+};
+
+#endif // LEVELTILEMAP_H
@@ -32,6 +32,7 @@
 #include "ui_mainwindow.h"
 
 #include "imagecache.h"
+#include "texturecache.h"
 
 #include "tileseteditor/tileseteditorwindow.h"
 #include "sarcexplorerwindow.h"
@@ -54,6 +55,7 @@ MainWindow::MainWindow(WindowBase *parent) :
     }
 
     ImageCache::init();
+    TextureCache::init();
 
     settings->loadTranslations();
     initialiseUi();
@@ -69,6 +71,7 @@ MainWindow::~MainWindow()
             delete game;
 
         delete ImageCache::getInstance();
+        delete TextureCache::getInstance();
     }
     delete SettingsManager::getInstance();
     delete ui;
@@ -83,6 +86,7 @@ void MainWindow::initialiseUi()
     connect(ui->actionShowROMFSDir,      &QAction::triggered, this, &MainWindow::showROMFSDir);
     connect(ui->actionAbout,             &QAction::triggered, this, &MainWindow::showAboutDialog);
     connect(ui->actionSarcExplorer,      &QAction::triggered, this, &MainWindow::openSarcExplorer);
+    connect(ui->actionTextureCache,      &QAction::triggered, this, &MainWindow::showTextureCacheStats);
 
     connect(ui->levelList, &QTreeView::clicked,       this, &MainWindow::levelListSelectedIndexChanged);
     connect(ui->levelList, &QTreeView::doubleClicked, this, &MainWindow::openLevelFromListIndex);
@@ -218,6 +222,28 @@ void MainWindow::showAboutDialog()
     msgBox.exec();
 }
 
+void MainWindow::showTextureCacheStats()
+{
+    TextureCache* cache = TextureCache::getInstance();
+    TextureCache::Statistics stats = cache->getStatistics();
+
+    int lookups = stats.hits + stats.misses;
+    double hitRate = lookups ? (stats.hits * 100.0 / lookups) : 0.0;
+
+    QMessageBox msgBox(this);
+    msgBox.setWindowTitle(tr("Texture Cache"));
+    msgBox.setText(tr("Hits: %1\nMisses: %2\nHit rate: %3%\n\nStored: %4\nEvicted: %5\n\nEntries on disk: %6\nSize on disk: %7 / %8 MiB")
+                   .arg(stats.hits).arg(stats.misses).arg(hitRate, 0, 'f', 1)
+                   .arg(stats.stores).arg(stats.evictions)
+                   .arg(stats.entries).arg(stats.diskSize / (1024.0*1024.0), 0, 'f', 1).arg(stats.maxSize / (1024*1024)));
+    QPushButton* clearButton = msgBox.addButton(tr("Clear Cache"), QMessageBox::ResetRole);
+    msgBox.addButton(QMessageBox::Ok);
+    msgBox.exec();
+
+    if (msgBox.clickedButton() == clearButton)
+        cache->clear();
+}
+
 void MainWindow::loadGame(const QString& path)
 {
     settings->setLastRomFSPath(path);
@@ -287,7 +313,7 @@ void MainWindow::openTilesetFromListIndex(const QModelIndex &index)
 
     QString data = index.data(Qt::UserRole+1).toString();
 
-    TilesetEditorWindow* tsEditor = new TilesetEditorWindow(this, game->getTileset(data));
+    TilesetEditorWindow* tsEditor = new TilesetEditorWindow(this, game->openTileset(data));
     tsEditor->setAttribute(Qt::WA_DeleteOnClose);
     tsEditor->show();
 }
@@ -476,11 +502,13 @@ void MainWindow::addTileset()
     blankTs.copy(settings->getLastRomFSPath() + "/Unit/" + ntd.getName() + ".sarc");
 
     SarcFilesystem sarc(game->fs->openFile("/Unit/" + ntd.getName() + ".sarc"));
+    FilesystemTransaction transaction(&sarc);
     sarc.renameFile("BG_chk/d_bgchk_REPLACE.bin", "d_bgchk_" + ntd.getName() + ".bin");
     sarc.renameFile("BG_tex/REPLACE.ctpk", ntd.getName() + ".ctpk");
     sarc.renameFile("BG_unt/REPLACE.bin", ntd.getName() + ".bin");
     sarc.renameFile("BG_unt/REPLACE_add.bin", ntd.getName() + "_add.bin");
     sarc.renameFile("BG_unt/REPLACE_hd.bin", ntd.getName() + "_hd.bin");
+    transaction.commit();
 
     Tileset ts(game, ntd.getName());
     ts.setSlot(ntd.getSlot());
@@ -504,6 +532,7 @@ void MainWindow::removeTileset()
             return;
 
         game->fs->deleteFile("/Unit/" + selTsName + ".sarc");
+        game->invalidateTileset(selTsName);
         loadTilesetList();
 
         ui->removeTilesetBtn->setDisabled(true);
@@ -659,7 +688,7 @@ void MainWindow::openTilesetFromConextMenu()
 
     QString path = ui->tilesetList->indexAt(pos).data(Qt::UserRole+1).toString();
 
-    TilesetEditorWindow* tsEditor = new TilesetEditorWindow(this, game->getTileset(path));
+    TilesetEditorWindow* tsEditor = new TilesetEditorWindow(this, game->openTileset(path));
     tsEditor->setAttribute(Qt::WA_DeleteOnClose);
     tsEditor->show();
 }
@@ -42,6 +42,7 @@ private slots:
     void showROMFSDir();
     void showAboutDialog();
     void openSarcExplorer();
+    void showTextureCacheStats();
 
     void levelListSelectedIndexChanged();
     void openLevelFromListIndex(const QModelIndex &index);
@@ -0,0 +1,186 @@
+#include "objectindex.h"
+#include "objects.h"
+
+#include <QSet>
+
+QRect ObjectIndex::bounds(const Object* obj)
+{
+    // views test some objects without their offset, so both count
+    QRect rect(obj->getx() + obj->getOffsetX(), obj->gety() + obj->getOffsetY(), obj->getwidth(), obj->getheight());
+    rect |= QRect(obj->getx(), obj->gety(), obj->getwidth(), obj->getheight());
+
+    if (obj->getType() == ObjectType::SPRITE)
+    {
+        const Sprite* spr = static_cast<const Sprite*>(obj);
+        rect |= spr->getRenderRect();
+
+        foreach (const QRect& r, *spr->getSelectionRects())
+            rect |= r.translated(obj->getx(), obj->gety());
+    }
+
+    return rect;
+}
+
+qint64 ObjectIndex::orderKey(const Object* obj)
+{
+    return obj->orderKey;
+}
+
+void ObjectIndex::setOrderKey(Object* obj, qint64 key)
+{
+    obj->orderKey = key;
+}
+
+void ObjectIndex::reordered(Object* obj)
+{
+    if (obj->spatialIndex)
+        obj->spatialIndex->changed(obj);
+}
+
+void ObjectIndex::changed(Object* obj)
+{
+    if (!listener)
+        return;
+
+    auto it = entries.constFind(obj);
+    if (it != entries.constEnd())
+        listener(obj, *it);
+}
+
+bool ObjectIndex::isLarge(const QRect& rect)
+{
+    qint64 w = (rect.right() >> cellShift) - (rect.left() >> cellShift) + 1;
+    qint64 h = (rect.bottom() >> cellShift) - (rect.top() >> cellShift) + 1;
+    return w * h > maxCells;
+}
+
+void ObjectIndex::removeFrom(QList<Entry>& list, Object* obj)
+{
+    for (int i = 0; i < list.size(); i++)
+    {
+        if (list[i].obj == obj)
+        {
+            list.removeAt(i);
+            return;
+        }
+    }
+}
+
+void ObjectIndex::insert(Object* obj)
+{
+    if (entries.contains(obj))
+        return;
+
+    Entry entry = { obj, bounds(obj) };
+    entries.insert(obj, entry.rect);
+    obj->spatialIndex = this;
+
+    if (listener)
+        listener(obj, entry.rect);
+
+    // nothing to draw or click, it only needs to be known for later updates
+    if (entry.rect.isEmpty())
+        return;
+
+    if (isLarge(entry.rect))
+    {
+        large.append(entry);
+        return;
+    }
+
+    for (int cy = entry.rect.top() >> cellShift; cy <= entry.rect.bottom() >> cellShift; cy++)
+        for (int cx = entry.rect.left() >> cellShift; cx <= entry.rect.right() >> cellShift; cx++)
+            cells[cellKey(cx, cy)].append(entry);
+}
+
+void ObjectIndex::remove(Object* obj)
+{
+    auto it = entries.find(obj);
+    if (it == entries.end())
+        return;
+
+    QRect rect = *it;
+    entries.erase(it);
+    obj->spatialIndex = nullptr;
+
+    if (listener)
+        listener(obj, rect);
+
+    if (rect.isEmpty())
+        return;
+
+    if (isLarge(rect))
+    {
+        removeFrom(large, obj);
+        return;
+    }
+
+    for (int cy = rect.top() >> cellShift; cy <= rect.bottom() >> cellShift; cy++)
+    {
+        for (int cx = rect.left() >> cellShift; cx <= rect.right() >> cellShift; cx++)
+        {
+            auto cell = cells.find(cellKey(cx, cy));
+            if (cell == cells.end())
+                continue;
+
+            removeFrom(*cell, obj);
+            if (cell->isEmpty())
+                cells.erase(cell);
+        }
+    }
+}
+
+void ObjectIndex::update(Object* obj)
+{
+    auto it = entries.constFind(obj);
+    if (it == entries.constEnd() || *it == bounds(obj))
+        return;
+
+    remove(obj);
+    insert(obj);
+}
+
+QList<Object*> ObjectIndex::query(const QRect& rect) const
+{
+    QList<Object*> found;
+
+    int x0 = rect.left() >> cellShift, x1 = rect.right() >> cellShift;
+    int y0 = rect.top() >> cellShift, y1 = rect.bottom() >> cellShift;
+
+    // objects spanning several cells show up once per cell
+    bool singleCell = (x0 == x1 && y0 == y1);
+    QSet<Object*> seen;
+
+    for (int cy = y0; cy <= y1; cy++)
+    {
+        for (int cx = x0; cx <= x1; cx++)
+        {
+            auto cell = cells.constFind(cellKey(cx, cy));
+            if (cell == cells.constEnd())
+                continue;
+
+            foreach (const Entry& entry, *cell)
+            {
+                if (!entry.rect.intersects(rect))
+                    continue;
+
+                if (!singleCell)
+                {
+                    if (seen.contains(entry.obj))
+                        continue;
+                    seen.insert(entry.obj);
+                }
+
+                found.append(entry.obj);
+            }
+        }
+    }
+
+    foreach (const Entry& entry, large)
+    {
+        if (entry.rect.intersects(rect))
+            found.append(entry.obj);
+    }
+
+    return found;
+}
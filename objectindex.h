@@ -0,0 +1,111 @@
+#ifndef OBJECTINDEX_H
+#define OBJECTINDEX_H
+
+#include <QRect>
+#include <QList>
+#include <QHash>
+#include <algorithm>
+#include <functional>
+
+class Object;
+
+// Uniform grid over level objects, keyed by the area they can be drawn or clicked in.
+// Indexed objects report their own moves and resizes, so it never has to be rebuilt.
+// Objects spanning many cells are kept in one list that every query checks.
+class ObjectIndex
+{
+public:
+    ObjectIndex() {}
+    ObjectIndex(const ObjectIndex&) = delete;
+    ObjectIndex& operator=(const ObjectIndex&) = delete;
+
+    void insert(Object* obj);
+    void remove(Object* obj);
+    void update(Object* obj);
+
+    // gets the area of an indexed object whenever it's added, removed, moved, resized,
+    // reordered or changed in a way that doesn't show in its bounds (both areas on a move)
+    typedef std::function<void(Object* obj, const QRect& rect)> ChangeListener;
+    void setChangeListener(const ChangeListener& listener) { this->listener = listener; }
+    void changed(Object* obj);
+
+    // objects whose bounds touch rect, unordered, the caller still does the exact test
+    QList<Object*> query(const QRect& rect) const;
+
+    // every object also has a key that sorts like its position in its level list,
+    // so hits can be put in list order without looking for them in the list.
+    // call setOrder() after putting obj at list[pos] or moving it there, keys of other lists don't matter
+    template <typename T> static void setOrder(const QList<T*>& list, int pos);
+    template <typename T> static void renumber(const QList<T*>& list);
+    template <typename T> static void sortByOrder(QList<T*>& objs);
+
+    // everything the object can draw or be clicked in
+    static QRect bounds(const Object* obj);
+
+private:
+    static const int cellShift = 9; // 512 units, a bit over 25 tiles
+    static const int maxCells = 64;
+
+    struct Entry
+    {
+        Object* obj;
+        QRect rect;
+    };
+
+    QHash<quint32, QList<Entry>> cells;
+    QList<Entry> large;
+    QHash<Object*, QRect> entries;
+    ChangeListener listener;
+
+    // room between neighbouring keys, a list only gets renumbered once a spot runs out of it
+    static const qint64 orderSpacing = 1 << 20;
+    static qint64 orderKey(const Object* obj);
+    static void setOrderKey(Object* obj, qint64 key);
+    static void reordered(Object* obj);
+
+    static quint32 cellKey(int cx, int cy) { return ((quint32)(quint16)cy << 16) | (quint16)cx; }
+    static bool isLarge(const QRect& rect);
+    static void removeFrom(QList<Entry>& list, Object* obj);
+};
+
+template <typename T>
+void ObjectIndex::setOrder(const QList<T*>& list, int pos)
+{
+    if (pos == list.size() - 1)
+    {
+        setOrderKey(list[pos], (pos > 0 ? orderKey(list[pos-1]) : 0) + orderSpacing);
+        reordered(list[pos]);
+        return;
+    }
+
+    if (pos == 0)
+    {
+        setOrderKey(list[pos], orderKey(list[1]) - orderSpacing);
+        reordered(list[pos]);
+        return;
+    }
+
+    qint64 prev = orderKey(list[pos-1]);
+    qint64 next = orderKey(list[pos+1]);
+    if (next - prev < 2)
+        renumber(list);
+    else
+        setOrderKey(list[pos], prev + (next - prev) / 2);
+
+    reordered(list[pos]);
+}
+
+template <typename T>
+void ObjectIndex::renumber(const QList<T*>& list)
+{
+    for (int i = 0; i < list.size(); i++)
+        setOrderKey(list[i], (i + 1) * orderSpacing);
+}
+
+template <typename T>
+void ObjectIndex::sortByOrder(QList<T*>& objs)
+{
+    std::sort(objs.begin(), objs.end(), [](const T* a, const T* b) { return orderKey(a) < orderKey(b); });
+}
+
+#endif // OBJECTINDEX_H
@@ -17,6 +17,7 @@
 
 #include "objects.h"
 #include "unitsconvert.h"
+#include "objectindex.h"
 
 #include <QPainter>
 
@@ -34,6 +35,7 @@ void Object::setPosition(qint32 x, qint32 y)
 {
     this->x = x;
     this->y = y;
+    boundsChanged();
 }
 
 void Object::increasePosition(qint32 deltax, qint32 deltay, qint32 snap)
@@ -46,12 +48,15 @@ void Object::increasePosition(qint32 deltax, qint32 deltay, qint32 snap)
         x = toNext10(x);
         y = toNext10(y);
     }
+
+    boundsChanged();
 }
 
 void Object::resize(qint32 width, qint32 height)
 {
     this->width = width;
     this->height = height;
+    boundsChanged();
 }
 
 void Object::increaseSize(qint32 deltax, qint32 deltay, qint32 snap)
@@ -64,6 +69,20 @@ void Object::increaseSize(qint32 deltax, qint32 deltay, qint32 snap)
         width = toNext10(width + x) - x;
         height = toNext10(height + y) - y;
     }
+
+    boundsChanged();
+}
+
+void Object::boundsChanged()
+{
+    if (spatialIndex)
+        spatialIndex->update(this);
+}
+
+void Object::contentChanged()
+{
+    if (spatialIndex)
+        spatialIndex->changed(this);
 }
 
 bool Object::clickDetection(qint32 xcheck, qint32 ycheck)
@@ -106,6 +125,7 @@ qint32 BgdatObject::getLayer() const { return layer; }
 void BgdatObject::setTsID(qint32 tsID)
 {
     id = (id & 0xFFF) | (tsID << 12);
+    contentChanged();
 }
 
 qint32 BgdatObject::getTsID() const
@@ -116,6 +136,15 @@ qint32 BgdatObject::getTsID() const
 void BgdatObject::setObjID(qint32 objID)
 {
     id = (id & 0xF000) | objID;
+    contentChanged();
+}
+
+void BgdatObject::setLayer(qint32 layer)
+{
+    // gone from one layer and there in the other
+    contentChanged();
+    this->layer = layer;
+    contentChanged();
 }
 
 qint32 BgdatObject::getObjID() const
@@ -2968,6 +2997,8 @@ void Sprite::setRect()
         offsetx = 0;
         offsety = 0;
     }
+
+    boundsChanged();
 }
 
 qint16 Sprite::getid() const { return id; }
@@ -3133,6 +3164,8 @@ void Entrance::setRect()
         offsety = 0;
         break;
     }
+
+    boundsChanged();
 }
 
 // Format: 2:ID:Type:X:Y:DestArea:DestEntr:CamX:CamY:Settings
@@ -22,6 +22,8 @@
 #include <QPainter>
 #include <QList>
 
+class ObjectIndex;
+
 enum ObjectType
 {
     INVALID,
@@ -64,6 +66,13 @@ protected:
     qint32 offsetx, offsety;
     qint32 dragX, dragY;
     qint32 resizeX, resizeY;
+
+    // set while the object is in a level's index, which has to follow every move and resize
+    friend class ObjectIndex;
+    ObjectIndex* spatialIndex = nullptr;
+    qint64 orderKey = 0; // position in its level list, see ObjectIndex::setOrder()
+    void boundsChanged();
+    void contentChanged();
 };
 
 // Bgdat Object
@@ -82,7 +91,7 @@ public:
     qint32 getObjID() const;
     qint32 getLayer() const;
     QString toString(qint32 xOffset, qint32 yOffset) const;
-    void setLayer(qint32 layer) { this->layer = layer; }
+    void setLayer(qint32 layer);
 protected:
     qint32 id;
     qint32 layer;
@@ -99,7 +108,8 @@ public:
     Sprite(qint32 x, qint32 y, qint16 id);
     ObjectType getType() const { return ObjectType::SPRITE; }
     bool isResizable() const { return false; }
-    virtual bool doRender(QRect r) { return r.intersects(QRect(x + offsetx + renderOffsetX, y + offsety + renderOffsetY, width + renderOffsetW, height + renderOffsetH)); }
+    virtual bool doRender(QRect r) { return r.intersects(getRenderRect()); }
+    QRect getRenderRect() const { return QRect(x + offsetx + renderOffsetX, y + offsety + renderOffsetY, width + renderOffsetW, height + renderOffsetH); }
     qint16 getid() const;
     void setid(qint16 id) { this->id = id; this->setRect(); }
     void setByte(qint32 id, quint8 nbr);
@@ -124,10 +134,10 @@ public:
 protected:
     qint16 id;
     quint8 spriteData[12] = {0,0,0,0,0,0,0,0,0,0,0,0};
-    qint32 renderOffsetX;
-    qint32 renderOffsetY;
-    qint32 renderOffsetW;
-    qint32 renderOffsetH;
+    qint32 renderOffsetX = 0;
+    qint32 renderOffsetY = 0;
+    qint32 renderOffsetW = 0;
+    qint32 renderOffsetH = 0;
     quint8 layer = 0;
 
     QList<QRect>* selectionRects;
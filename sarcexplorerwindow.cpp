@@ -1,5 +1,6 @@
 #include "sarcexplorerwindow.h"
 #include "ui_sarcexplorerwindow.h"
+#include "ctpk.h"
 
 #include <QMessageBox>
 #include <QFileDialog>
@@ -36,6 +37,7 @@ SarcExplorerWindow::SarcExplorerWindow(WindowBase *parent, QString path, Setting
     ui->insertButton->setEnabled(false);
     ui->deleteButton->setEnabled(false);
     ui->insertFolderButton->setEnabled(false);
+    ui->previewLabel->hide();
 
     fileTree.sort(Qt::DisplayRole, Qt::AscendingOrder);
 
@@ -561,6 +563,9 @@ void SarcExplorerWindow::selectedFileChanged()
         ui->insertButton->setEnabled(true);
         ui->deleteButton->setEnabled(true);
         ui->insertFolderButton->setEnabled(true);
+
+        showPreview(currentItem->data().toString().remove(0, 1));
+        return;
     }
     else
     {
@@ -571,6 +576,39 @@ void SarcExplorerWindow::selectedFileChanged()
         ui->insertFolderButton->setEnabled(false);
     }
 
+    ui->previewLabel->hide();
+}
+
+void SarcExplorerWindow::showPreview(QString path)
+{
+    ui->previewLabel->hide();
+
+    if (!path.endsWith(".ctpk"))
+        return;
+
+    QImage img;
+    try
+    {
+        Ctpk ctpk(sarc->openFile(path), SettingsManager::getInstance()->get("premultiplyAlpha", true).toBool());
+        if (ctpk.getNumEntries() == 0)
+            return;
+
+        img = ctpk.getTexture((quint32)0);
+    }
+    catch (const std::exception& e)
+    {
+        ui->previewLabel->setText(tr("No preview: %1").arg(e.what()));
+        ui->previewLabel->show();
+        return;
+    }
+
+    QPixmap preview = QPixmap::fromImage(img);
+    if (preview.width() > 256 || preview.height() > 256)
+        preview = preview.scaled(256, 256, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    ui->previewLabel->setPixmap(preview);
+    ui->previewLabel->setToolTip(QString("%1x%2").arg(img.width()).arg(img.height()));
+    ui->previewLabel->show();
 }
 
 
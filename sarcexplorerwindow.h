@@ -42,6 +42,7 @@ private:
     void changeDirectory(QStandardItem* node);
     void deleteFile(QStandardItem* node);
     void deleteFolder(QStandardItem* node);
+    void showPreview(QString path);
 
 private slots:
     void itemChanged(QStandardItem* node);
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+TARGET = tst_alphakernels
+
+SOURCES += \
+    tst_alphakernels.cpp \
+    ../../alphakernels.cpp
+
+HEADERS += \
+    ../../alphakernels.h
@@ -0,0 +1,242 @@
+#include <QtTest>
+#include <cmath>
+#include <cstring>
+
+#include "alphakernels.h"
+
+class TestAlphaKernels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void premultiplyAllValues();
+    void premultiplySpeed_data();
+    void premultiplySpeed();
+    void vectorMatchesScalar();
+    void unpremultiplyAllValues();
+    void roundTrip();
+    void images();
+
+private:
+    // one pixel for every colour value and alpha, colour channels differ so mixed up lanes show
+    static QByteArray allPixels();
+
+    // what the decoders did per pixel before, truncating (x*a)/255
+    static void premultiplyOld(quint8* rgba, quint64 count);
+};
+
+QByteArray TestAlphaKernels::allPixels()
+{
+    QByteArray buf(256*256*4, Qt::Uninitialized);
+    quint8* px = (quint8*)buf.data();
+
+    for (int a = 0; a < 256; a++)
+    {
+        for (int x = 0; x < 256; x++, px += 4)
+        {
+            px[0] = x;
+            px[1] = 255 - x;
+            px[2] = (x * 7) & 0xFF;
+            px[3] = a;
+        }
+    }
+    return buf;
+}
+
+void TestAlphaKernels::premultiplyAllValues()
+{
+    QByteArray src = allPixels();
+
+    QByteArray vec = src;
+    AlphaKernels::premultiply((quint8*)vec.data(), 256*256);
+
+    QByteArray scalar = src;
+    AlphaKernels::premultiplyScalar((quint8*)scalar.data(), 256*256);
+
+    const quint8* in = (const quint8*)src.constData();
+    const quint8* out = (const quint8*)vec.constData();
+    for (int i = 0; i < 256*256*4; i += 4)
+    {
+        quint32 a = in[i+3];
+        for (int c = 0; c < 3; c++)
+        {
+            if (out[i+c] != (in[i+c]*a + 127) / 255)
+                QFAIL(qPrintable(QString("x=%1 a=%2 gives %3").arg(in[i+c]).arg(a).arg(out[i+c])));
+        }
+        QCOMPARE(out[i+3], (quint8)a);
+    }
+
+    QVERIFY(vec == scalar);
+}
+
+void TestAlphaKernels::premultiplyOld(quint8* rgba, quint64 count)
+{
+    for (quint64 i = 0; i < count; i++, rgba += 4)
+    {
+        quint32 a = rgba[3];
+        rgba[0] = (rgba[0] * a) / 255;
+        rgba[1] = (rgba[1] * a) / 255;
+        rgba[2] = (rgba[2] * a) / 255;
+    }
+}
+
+void TestAlphaKernels::premultiplySpeed_data()
+{
+    QTest::addColumn<int>("path");
+
+    QTest::newRow("old per-pixel loop") << 0;
+    QTest::newRow("scalar") << 1;
+    QTest::newRow("vectorized") << 2;
+}
+
+// a 1024x1024 RGBA8888 texture, premultiplied over and over in place,
+// none of the paths take longer for some values than for others
+void TestAlphaKernels::premultiplySpeed()
+{
+    QFETCH(int, path);
+
+    // every colour and alpha value, 16 times over
+    QByteArray pixels = allPixels();
+    QImage img(1024, 1024, QImage::Format_RGBA8888);
+    quint8* data = img.bits();
+    quint64 count = (quint64)img.width() * img.height();
+    for (int i = 0; i < 16; i++)
+        memcpy(data + i*pixels.size(), pixels.constData(), pixels.size());
+
+    QBENCHMARK
+    {
+        if (path == 0)
+            premultiplyOld(data, count);
+        else if (path == 1)
+            AlphaKernels::premultiplyScalar(data, count);
+        else
+            AlphaKernels::premultiply(data, count);
+    }
+}
+
+void TestAlphaKernels::vectorMatchesScalar()
+{
+    QByteArray src = allPixels();
+
+    // every start offset and length around the vector widths, so the tails get covered
+    for (int start = 0; start < 20; start++)
+    {
+        for (int count = 0; count < 70; count++)
+        {
+            QByteArray vec = src;
+            QByteArray scalar = src;
+            AlphaKernels::premultiply((quint8*)vec.data() + (37*256 + start)*4, count);
+            AlphaKernels::premultiplyScalar((quint8*)scalar.data() + (37*256 + start)*4, count);
+
+            if (vec != scalar)
+                QFAIL(qPrintable(QString("start %1 count %2").arg(start).arg(count)));
+        }
+    }
+}
+
+void TestAlphaKernels::unpremultiplyAllValues()
+{
+    QByteArray buf = allPixels();
+    QByteArray src = buf;
+    AlphaKernels::unpremultiply((quint8*)buf.data(), 256*256);
+
+    const quint8* in = (const quint8*)src.constData();
+    const quint8* out = (const quint8*)buf.constData();
+    for (int i = 0; i < 256*256*4; i += 4)
+    {
+        quint32 a = in[i+3];
+        QCOMPARE(out[i+3], (quint8)a);
+
+        for (int c = 0; c < 3; c++)
+        {
+            int expected;
+            if (a == 0)
+                expected = 0;
+            else if (a == 255)
+                expected = in[i+c];
+            else
+                expected = qMin<quint32>(255, (in[i+c]*255 + a/2) / a);
+
+            // the reciprocal table may round the other way
+            if (qAbs(out[i+c] - expected) > ((a == 255) ? 0 : 1))
+                QFAIL(qPrintable(QString("p=%1 a=%2 gives %3, expected %4").arg(in[i+c]).arg(a).arg(out[i+c]).arg(expected)));
+        }
+    }
+}
+
+void TestAlphaKernels::roundTrip()
+{
+    QByteArray src = allPixels();
+
+    // straight -> premultiplied -> straight only loses what premultiplying rounds away
+    QByteArray buf = src;
+    AlphaKernels::premultiply((quint8*)buf.data(), 256*256);
+    AlphaKernels::unpremultiply((quint8*)buf.data(), 256*256);
+
+    const quint8* in = (const quint8*)src.constData();
+    const quint8* out = (const quint8*)buf.constData();
+    for (int i = 0; i < 256*256*4; i += 4)
+    {
+        int a = in[i+3];
+        if (a == 0)
+            continue;
+
+        int tolerance = (int)std::ceil(255.0 / (2*a));
+        if (a == 255)
+            tolerance = 0;
+
+        for (int c = 0; c < 3; c++)
+        {
+            if (qAbs(out[i+c] - in[i+c]) > tolerance)
+                QFAIL(qPrintable(QString("x=%1 a=%2 comes back as %3").arg(in[i+c]).arg(a).arg(out[i+c])));
+        }
+    }
+
+    // premultiplied -> straight -> premultiplied is exact for every valid pixel
+    for (int a = 0; a < 256; a++)
+    {
+        QByteArray px;
+        for (int p = 0; p <= a; p++)
+            px.append((char)p).append((char)(a - p)).append((char)(p / 2)).append((char)a);
+
+        QByteArray orig = px;
+        AlphaKernels::unpremultiply((quint8*)px.data(), a + 1);
+        AlphaKernels::premultiply((quint8*)px.data(), a + 1);
+
+        if (px != orig)
+            QFAIL(qPrintable(QString("alpha %1 doesn't survive").arg(a)));
+    }
+}
+
+void TestAlphaKernels::images()
+{
+    QByteArray src = allPixels();
+    QImage img((const uchar*)src.constData(), 256, 256, QImage::Format_RGBA8888);
+    img = img.copy();
+
+    QImage premul = img;
+    AlphaKernels::premultiply(&premul);
+    QCOMPARE(premul.format(), QImage::Format_RGBA8888_Premultiplied);
+
+    QByteArray expected = src;
+    AlphaKernels::premultiplyScalar((quint8*)expected.data(), 256*256);
+    for (int y = 0; y < 256; y++)
+        QVERIFY(memcmp(premul.constScanLine(y), expected.constData() + y*256*4, 256*4) == 0);
+
+    // the original shares no data with it anymore
+    QVERIFY(memcmp(img.constScanLine(0), src.constData(), 256*4) == 0);
+
+    AlphaKernels::unpremultiply(&premul);
+    QCOMPARE(premul.format(), QImage::Format_RGBA8888);
+
+    // anything else is left alone
+    QImage argb(4, 4, QImage::Format_ARGB32);
+    argb.fill(0x80FF0000);
+    QImage before = argb;
+    AlphaKernels::premultiply(&argb);
+    QCOMPARE(argb.format(), QImage::Format_ARGB32);
+    QCOMPARE(argb, before);
+}
+
+QTEST_APPLESS_MAIN(TestAlphaKernels)
+#include "tst_alphakernels.moc"
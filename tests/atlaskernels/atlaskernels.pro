@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+TARGET = tst_atlaskernels
+
+SOURCES += \
+    tst_atlaskernels.cpp \
+    ../../atlaskernels.cpp
+
+HEADERS += \
+    ../../atlaskernels.h
@@ -0,0 +1,259 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include <QPainter>
+#include <cstring>
+
+#include "atlaskernels.h"
+
+class TestAtlasKernels : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void borders();
+    void clearsUnusedArea();
+    void downscaleKeepsTilesApart_data();
+    void downscaleKeepsTilesApart();
+
+    void padSpeed_data();
+    void padSpeed();
+    void unpadSpeed_data();
+    void unpadSpeed();
+
+private:
+    static QImage noise(int width, int height, QImage::Format format, quint32 seed);
+
+    // how Tileset and the tileset editor did it before, one drawImage() per tile and border piece
+    static void padPainter(const QImage& img, QImage& ret);
+    static void unpadPainter(const QImage& img, QImage& ret);
+    static void addSpeedRows();
+};
+
+QImage TestAtlasKernels::noise(int width, int height, QImage::Format format, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+
+    QImage img(width, height, format);
+    for (int y = 0; y < height; y++)
+    {
+        quint32* line = (quint32*)img.scanLine(y);
+        for (int x = 0; x < width; x++)
+            line[x] = rng.generate();
+    }
+    return img;
+}
+
+void TestAtlasKernels::roundTrip_data()
+{
+    QTest::addColumn<int>("format");
+    QTest::addColumn<int>("tiles");
+
+    QTest::newRow("rgba8888 full") << (int)QImage::Format_RGBA8888 << 21;
+    QTest::newRow("argb32 full") << (int)QImage::Format_ARGB32 << 21;
+    QTest::newRow("rgba8888 partial") << (int)QImage::Format_RGBA8888 << 5;
+}
+
+void TestAtlasKernels::roundTrip()
+{
+    QFETCH(int, format);
+    QFETCH(int, tiles);
+
+    QImage tileset = noise(tiles*20, tiles*20, (QImage::Format)format, 0x5EED + tiles);
+
+    QImage padded(512, 512, (QImage::Format)format);
+    AtlasKernels::pad(tileset, padded);
+
+    QImage unpadded(tiles*20, tiles*20, (QImage::Format)format);
+    AtlasKernels::unpad(padded, unpadded);
+
+    // every pixel has to come back unchanged, not just look the same
+    for (int y = 0; y < tileset.height(); y++)
+    {
+        if (memcmp(tileset.constScanLine(y), unpadded.constScanLine(y), tileset.width() * 4) != 0)
+            QFAIL(qPrintable(QString("row %1 differs").arg(y)));
+    }
+
+    // the default sizes as used for import and export
+    if (tiles == 21 && format == QImage::Format_RGBA8888)
+        QCOMPARE(AtlasKernels::unpad(AtlasKernels::pad(tileset)), tileset);
+}
+
+void TestAtlasKernels::borders()
+{
+    QImage tileset = noise(420, 420, QImage::Format_RGBA8888, 1234);
+    QImage padded = AtlasKernels::pad(tileset);
+
+    for (int ty = 0; ty < 21; ty++)
+    {
+        for (int tx = 0; tx < 21; tx++)
+        {
+            for (int py = -2; py < 22; py++)
+            {
+                for (int px = -2; px < 22; px++)
+                {
+                    // border pixels repeat the nearest edge pixel of the tile
+                    QRgb expected = tileset.pixel(tx*20 + qBound(0, px, 19), ty*20 + qBound(0, py, 19));
+                    QRgb actual = padded.pixel(tx*24 + 2 + px, ty*24 + 2 + py);
+                    if (expected != actual)
+                        QFAIL(qPrintable(QString("tile %1,%2 pixel %3,%4").arg(tx).arg(ty).arg(px).arg(py)));
+                }
+            }
+        }
+    }
+}
+
+void TestAtlasKernels::clearsUnusedArea()
+{
+    QImage padded(512, 512, QImage::Format_RGBA8888);
+    padded.fill(Qt::white);
+    AtlasKernels::pad(noise(420, 420, QImage::Format_RGBA8888, 99), padded);
+
+    // 21 tiles take up 504 pixels, the rest has to be transparent black
+    for (int y = 0; y < 512; y++)
+    {
+        for (int x = (y < 504) ? 504 : 0; x < 512; x++)
+            QCOMPARE(padded.pixel(x, y), (QRgb)0);
+    }
+}
+
+void TestAtlasKernels::downscaleKeepsTilesApart_data()
+{
+    QTest::addColumn<int>("lod");
+
+    QTest::newRow("lod 1") << 1;
+    QTest::newRow("lod 2") << 2;
+    QTest::newRow("lod 3") << 3;
+}
+
+void TestAtlasKernels::downscaleKeepsTilesApart()
+{
+    QFETCH(int, lod);
+
+    // every tile one solid colour, so any pixel from a neighbour shows
+    QImage tileset(420, 420, QImage::Format_RGBA8888);
+    for (int t = 0; t < 21*21; t++)
+    {
+        QRgb color = qRgba((t * 37) & 0xFF, (t * 91) & 0xFF, t & 0xFF, 255);
+        for (int y = 0; y < 20; y++)
+        {
+            for (int x = 0; x < 20; x++)
+                tileset.setPixel((t%21)*20 + x, (t/21)*20 + y, color);
+        }
+    }
+
+    QImage small = AtlasKernels::downscale(AtlasKernels::pad(tileset), lod);
+    int cell = AtlasKernels::cellSize(lod);
+    QCOMPARE(small.width(), 21*cell);
+    QCOMPARE(small.height(), 21*cell);
+
+    // the whole cell, border included
+    for (int y = 0; y < small.height(); y++)
+    {
+        for (int x = 0; x < small.width(); x++)
+        {
+            // filtering a flat colour may round it by a step, a neighbour would be far off
+            QRgb expected = tileset.pixel((x/cell)*20, (y/cell)*20);
+            QRgb actual = small.pixel(x, y);
+            if (qAbs(qRed(actual) - qRed(expected)) > 1 || qAbs(qGreen(actual) - qGreen(expected)) > 1 ||
+                qAbs(qBlue(actual) - qBlue(expected)) > 1 || qAbs(qAlpha(actual) - qAlpha(expected)) > 1)
+                QFAIL(qPrintable(QString("pixel %1,%2 of tile %3,%4").arg(x%cell).arg(y%cell).arg(x/cell).arg(y/cell)));
+        }
+    }
+}
+
+void TestAtlasKernels::padPainter(const QImage& img, QImage& ret)
+{
+    ret.fill(Qt::transparent);
+    QPainter painter(&ret);
+    quint32 tilew = img.width() / 20;
+    quint32 tileh = img.height() / 20;
+    quint32 tilenum = tilew * tileh;
+    for (quint32 i = 0; i < tilenum; i++)
+    {
+        // Margins
+        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 2, 20), img.copy(i%tilew*20, i/tilew*20, 1, 20));               // Left
+        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 2, 20), img.copy(19 + i%tilew*20, i/tilew*20, 1, 20));     // Right
+        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 20, 2), img.copy(i%tilew*20, i/tilew*20, 20, 1));               // Top
+        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 20, 2), img.copy(i%tilew*20, 19 + i/tilew*20, 20, 1));     // Bottom
+        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 2, 2), img.copy(i%tilew*20, i/tilew*20, 1, 1));                     // Top-Left
+        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 2, 2), img.copy(19 + i%tilew*20, i/tilew*20, 1, 1));           // Top-Right
+        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 2, 2), img.copy(i%tilew*20, 19 + i/tilew*20, 1, 1));           // Bottom-Left
+        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 2, 2), img.copy(19 + i%tilew*20, 19 + i/tilew*20, 1, 1)); // Bottom-Right
+
+        // Core Tiles
+        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 20, 20), img.copy(i%tilew*20, i/tilew*20, 20, 20));
+    }
+}
+
+void TestAtlasKernels::unpadPainter(const QImage& img, QImage& ret)
+{
+    ret.fill(QColor(0,0,0,0));
+    QPainter painter;
+    painter.begin(&ret);
+
+    for (int x = 0; x < 21; x++)
+    {
+        for (int y = 0; y < 21; y++)
+        {
+            painter.drawImage(x*20, y*20, img, x*20 + x*4 + 2, y*20 + y*4 + 2, 20, 20, Qt::AutoColor);
+        }
+    }
+
+    painter.end();
+}
+
+void TestAtlasKernels::addSpeedRows()
+{
+    QTest::addColumn<bool>("painter");
+
+    QTest::newRow("QPainter") << true;
+    QTest::newRow("scanlines") << false;
+}
+
+void TestAtlasKernels::padSpeed_data()
+{
+    addSpeedRows();
+}
+
+// a whole 21x21 tileset, like every import and every tileset load
+void TestAtlasKernels::padSpeed()
+{
+    QFETCH(bool, painter);
+
+    QImage tileset = noise(420, 420, QImage::Format_RGBA8888, 5);
+    QImage padded(512, 512, QImage::Format_RGBA8888);
+
+    QBENCHMARK
+    {
+        if (painter)
+            padPainter(tileset, padded);
+        else
+            AtlasKernels::pad(tileset, padded);
+    }
+}
+
+void TestAtlasKernels::unpadSpeed_data()
+{
+    addSpeedRows();
+}
+
+void TestAtlasKernels::unpadSpeed()
+{
+    QFETCH(bool, painter);
+
+    QImage padded = AtlasKernels::pad(noise(420, 420, QImage::Format_RGBA8888, 6));
+    QImage tileset(420, 420, QImage::Format_RGBA8888);
+
+    QBENCHMARK
+    {
+        if (painter)
+            unpadPainter(padded, tileset);
+        else
+            AtlasKernels::unpad(padded, tileset);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestAtlasKernels)
+#include "tst_atlaskernels.moc"
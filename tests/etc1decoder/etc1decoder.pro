@@ -0,0 +1,18 @@
+include(../tests.pri)
+
+TARGET = tst_etc1decoder
+
+SOURCES += \
+    tst_etc1decoder.cpp \
+    ../../etc1decoder.cpp \
+    ../../filesystem/externalfile.cpp \
+    ../../filesystem/filebase.cpp \
+    ../../filesystem/fileblock.cpp \
+    ../../filesystem/memoryfile.cpp
+
+HEADERS += \
+    ../../etc1decoder.h \
+    ../../filesystem/externalfile.h \
+    ../../filesystem/filebase.h \
+    ../../filesystem/fileblock.h \
+    ../../filesystem/memoryfile.h
@@ -0,0 +1,24 @@
+include(../tests.pri)
+
+TARGET = tst_filesystem
+
+SOURCES += \
+    tst_filesystem.cpp \
+    ../../filesystem/asyncarchivewriter.cpp \
+    ../../filesystem/externalfile.cpp \
+    ../../filesystem/filebase.cpp \
+    ../../filesystem/fileblock.cpp \
+    ../../filesystem/lz11.cpp \
+    ../../filesystem/lzfile.cpp \
+    ../../filesystem/memoryfile.cpp \
+    ../../filesystem/sarcfilesystem.cpp
+
+HEADERS += \
+    ../../filesystem/asyncarchivewriter.h \
+    ../../filesystem/fileblock.h \
+    ../../filesystem/filebase.h \
+    ../../filesystem/externalfile.h \
+    ../../filesystem/lz11.h \
+    ../../filesystem/lzfile.h \
+    ../../filesystem/memoryfile.h \
+    ../../filesystem/sarcfilesystem.h
@@ -0,0 +1,524 @@
+#include <QtTest>
+#include <QThread>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+
+#include "filesystem/filesystem.h"
+
+class TestFilesystem : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void copyOnWrite();
+    void peekOutlivesFile();
+    void peekOutlivesOtherWriter();
+    void concurrentReadWrite_data();
+    void concurrentReadWrite();
+    void lzHeaderSizeCapped();
+    void concurrentSarcAccess();
+
+private:
+    static quint8 pattern(int gen, quint64 pos) { return (quint8)(gen*31 + pos*7 + (pos >> 8)); }
+    static void fill(FileBase* file, int gen, quint64 size);
+    static bool check(const quint8* data, quint64 len, int gen, quint64 start);
+
+    static QByteArray contents(int gen, int size);
+    static SarcFilesystem* buildSarc(const QMap<QString, QByteArray>& files);
+};
+
+QByteArray TestFilesystem::contents(int gen, int size)
+{
+    QByteArray ret(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i++)
+        ret[i] = pattern(gen, i);
+    return ret;
+}
+
+// a SARC with nothing loaded yet, like one just opened from the game
+SarcFilesystem* TestFilesystem::buildSarc(const QMap<QString, QByteArray>& files)
+{
+    const quint32 hashMult = 0x65;
+
+    QList<QPair<quint32, QString>> nodes;
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        quint32 hash = 0;
+        foreach (QChar c, it.key())
+            hash = hash * hashMult + c.toLatin1();
+        nodes.append(qMakePair(hash, it.key()));
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    QByteArray names;
+    QList<quint32> nameOffsets;
+    foreach (const auto& node, nodes)
+    {
+        nameOffsets.append(names.size());
+        names.append(node.second.toLatin1());
+        names.append('\0');
+        while (names.size() & 3)
+            names.append('\0');
+    }
+
+    quint32 dataOffset = (0x14 + 0xC + nodes.size()*0x10 + 8 + names.size() + 0xF) & ~0xF;
+
+    QByteArray data;
+    QList<quint32> dataOffsets;
+    foreach (const auto& node, nodes)
+    {
+        while (data.size() & 0xF)
+            data.append('\0');
+        dataOffsets.append(data.size());
+        data.append(files[node.second]);
+    }
+
+    BinaryWriter<> out(dataOffset + data.size());
+    out.write32(0x43524153);
+    out.write16(0x14);
+    out.write16(0xFEFF);
+    out.write32(dataOffset + data.size());
+    out.write32(dataOffset);
+    out.write32(0x100);
+
+    out.write32(0x54414653);
+    out.write16(0xC);
+    out.write16(nodes.size());
+    out.write32(hashMult);
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        out.write32(nodes[i].first);
+        out.write32(0x01000000 | (nameOffsets[i] / 4));
+        out.write32(dataOffsets[i]);
+        out.write32(dataOffsets[i] + files[nodes[i].second].size());
+    }
+
+    out.write32(0x544E4653);
+    out.write16(0x8);
+    out.write16(0);
+    out.writeData((const quint8*)names.constData(), names.size());
+
+    out.seek(dataOffset);
+    out.writeData((const quint8*)data.constData(), data.size());
+
+    QByteArray block = out.block();
+    quint8* buf = new quint8[block.size()];
+    memcpy(buf, block.constData(), block.size());
+    return new SarcFilesystem(new MemoryFile(NULL, buf, block.size()));
+}
+
+void TestFilesystem::fill(FileBase* file, int gen, quint64 size)
+{
+    QByteArray buf(size, Qt::Uninitialized);
+    for (quint64 i = 0; i < size; i++)
+        buf[i] = pattern(gen, i);
+
+    file->seek(0);
+    file->writeBlock(buf);
+}
+
+bool TestFilesystem::check(const quint8* data, quint64 len, int gen, quint64 start)
+{
+    for (quint64 i = 0; i < len; i++)
+    {
+        if (data[i] != pattern(gen, start+i))
+            return false;
+    }
+    return true;
+}
+
+void TestFilesystem::copyOnWrite()
+{
+    MemoryFile source(NULL, 4096);
+    fill(&source, 1, 4096);
+
+    FileBase* view = source.getSubfile(NULL, 1000, 500);
+    FileBytes peeked = source.peekAt(0, 4096);
+
+    // writing the source leaves both alone
+    fill(&source, 2, 4096);
+    QVERIFY(check(peeked.data(), 4096, 1, 0));
+
+    QByteArray viewData(500, Qt::Uninitialized);
+    QCOMPARE(view->readAt(0, (quint8*)viewData.data(), 500), (quint64)500);
+    QVERIFY(check((const quint8*)viewData.constData(), 500, 1, 1000));
+
+    // and writing the view leaves the source and the peek alone
+    view->seek(0);
+    view->write32(0xDEADBEEF);
+    QVERIFY(check(peeked.data(), 4096, 1, 0));
+
+    QByteArray sourceData(4096, Qt::Uninitialized);
+    source.readAt(0, (quint8*)sourceData.data(), 4096);
+    QVERIFY(check((const quint8*)sourceData.constData(), 4096, 2, 0));
+
+    delete view;
+}
+
+void TestFilesystem::peekOutlivesFile()
+{
+    FileBytes peeked;
+    {
+        ExternalFile file(NULL);
+        file.open();
+        fill(&file, 3, 100000);
+        file.close();
+
+        file.open(); // mapped from here on
+        peeked = file.peekAt(50000, 20000);
+        QVERIFY(!peeked.isNull());
+
+        // rewriting and truncating the file underneath the peek
+        fill(&file, 4, 100000);
+        file.resize(10);
+        file.close();
+    }
+
+    QCOMPARE(peeked.size(), (quint64)20000);
+    QVERIFY(check(peeked.data(), peeked.size(), 3, 50000));
+}
+
+void TestFilesystem::peekOutlivesOtherWriter()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString path = dir.filePath("file.bin");
+
+    ExternalFile writer(NULL, path);
+    writer.open();
+    fill(&writer, 5, 100000);
+    writer.close();
+
+    // its own handle and mapping of the same file
+    ExternalFile reader(NULL, path);
+    reader.open();
+    FileBytes peeked = reader.peekAt(0, 100000);
+    QVERIFY(!peeked.isNull());
+    reader.close();
+
+    // truncating under a mapping someone else made faults on the pages past the end
+    writer.open();
+    writer.resize(10);
+    fill(&writer, 6, 50000);
+    writer.close();
+
+    QCOMPARE(peeked.size(), (quint64)100000);
+    QVERIFY(check(peeked.data(), peeked.size(), 5, 0));
+
+    // while a new open sees the new contents
+    ExternalFile later(NULL, path);
+    later.open();
+    QCOMPARE(later.size(), (quint64)50000);
+    FileBytes current = later.peekAt(0, 50000);
+    QVERIFY(check(current.data(), current.size(), 6, 0));
+    later.close();
+}
+
+void TestFilesystem::concurrentReadWrite_data()
+{
+    QTest::addColumn<bool>("external");
+
+    QTest::newRow("memory") << false;
+    QTest::newRow("external") << true;
+}
+
+// readers keep going over views and peeks of the source while it gets rewritten, resized and remapped
+void TestFilesystem::concurrentReadWrite()
+{
+    QFETCH(bool, external);
+
+    const quint64 size = 1024*1024;
+    const int rounds = 200;
+    const int numReaders = 4;
+
+    FileBase* source = external ? (FileBase*)new ExternalFile(NULL) : (FileBase*)new MemoryFile(NULL, size);
+    source->open();
+    fill(source, 0, size);
+    source->close();
+    source->open();
+
+    struct Snapshot
+    {
+        int gen;
+        quint64 offset;
+        QSharedPointer<FileBase> view;
+        FileBytes peeked;
+    };
+
+    QMutex lock;
+    QList<Snapshot> snapshots;
+    QAtomicInt stop(0);
+    QAtomicInt failures(0);
+    QAtomicInt checks(0);
+
+    QList<QThread*> readers;
+    for (int r = 0; r < numReaders; r++)
+    {
+        readers.append(QThread::create([&, r]()
+        {
+            QRandomGenerator rng(r);
+            QByteArray buf(64*1024, Qt::Uninitialized);
+
+            while (!stop.loadAcquire())
+            {
+                lock.lock();
+                if (snapshots.isEmpty())
+                {
+                    lock.unlock();
+                    QThread::yieldCurrentThread();
+                    continue;
+                }
+                Snapshot snap = snapshots[rng.bounded(snapshots.size())];
+                lock.unlock();
+
+                if (!check(snap.peeked.data(), snap.peeked.size(), snap.gen, snap.offset))
+                    failures.ref();
+
+                quint64 len = snap.view->size();
+                for (quint64 pos = 0; pos < len; pos += buf.size())
+                {
+                    quint64 got = snap.view->readAt(pos, (quint8*)buf.data(), buf.size());
+                    if (!check((const quint8*)buf.constData(), got, snap.gen, snap.offset + pos))
+                        failures.ref();
+                }
+
+                checks.ref();
+            }
+        }));
+        readers.last()->start();
+    }
+
+    QRandomGenerator rng(1234);
+    for (int gen = 0; gen < rounds; gen++)
+    {
+        if (gen > 0)
+        {
+            // every write has to leave what the readers hold alone
+            fill(source, gen, size);
+
+            if (external && (gen % 5) == 0)
+            {
+                source->resize(size/3);
+                source->resize(size);
+                fill(source, gen, size);
+            }
+
+            // picks up a new mapping
+            source->close();
+            source->open();
+        }
+
+        quint64 offset = rng.bounded((quint32)(size/2));
+        quint64 len = rng.bounded((quint32)(size/2));
+
+        Snapshot snap;
+        snap.gen = gen;
+        snap.offset = offset;
+        snap.view = QSharedPointer<FileBase>(source->getSubfile(NULL, offset, len));
+        snap.peeked = source->peekAt(offset, len);
+
+        lock.lock();
+        snapshots.append(snap);
+        if (snapshots.size() > 8)
+            snapshots.removeFirst(); // some of them get freed on the reader threads
+        lock.unlock();
+    }
+
+    // let the readers get through the last ones too
+    QElapsedTimer timer;
+    timer.start();
+    while (checks.loadAcquire() < rounds && !timer.hasExpired(10000))
+        QThread::msleep(10);
+
+    stop.storeRelease(1);
+    foreach (QThread* reader, readers)
+    {
+        reader->wait();
+        delete reader;
+    }
+
+    snapshots.clear();
+    source->close();
+    delete source;
+
+    QCOMPARE(failures.loadAcquire(), 0);
+}
+
+void TestFilesystem::lzHeaderSizeCapped()
+{
+    // a real one gets unpacked
+    QByteArray plain(100000, 'c');
+    QByteArray packed = Lz11::compress((const quint8*)plain.constData(), plain.size());
+
+    quint8* data = new quint8[packed.size()];
+    memcpy(data, packed.constData(), packed.size());
+    FileBase* raw = new MemoryFile(NULL, data, packed.size());
+
+    FileBase* file = LzFile::wrap(raw);
+    QVERIFY(file != raw);
+    QCOMPARE(file->size(), (quint64)plain.size());
+    delete file;
+
+    // headers claiming far more than the rest of the file can hold are taken as plain data,
+    // nothing gets allocated for them
+    const char* liars[] =
+    {
+        "\x11\xFF\xFF\xFF\x00\x00\x00\x00", // 16M from 8 bytes
+        "\x11\x00\x00\x00\xF0\xFF\xFF\xFF", // 4G
+        "\x13\x00\x00\x00\x11\x00\x00\x00\x00\x00\x00\x80", // 2G behind an LZ13 header
+    };
+
+    for (int i = 0; i < 3; i++)
+    {
+        int len = (i == 2) ? 12 : 8;
+        QByteArray bytes(liars[i], len);
+        bytes.append(64, '\0');
+
+        quint8* buf = new quint8[bytes.size()];
+        memcpy(buf, bytes.constData(), bytes.size());
+        raw = new MemoryFile(NULL, buf, bytes.size());
+
+        file = LzFile::wrap(raw);
+        QVERIFY(file == raw);
+        delete raw;
+    }
+}
+
+// readers open, read and list files of one archive while a writer keeps repacking it under them
+void TestFilesystem::concurrentSarcAccess()
+{
+    const int numFiles = 40;
+    const int numReaders = 4;
+    const int writes = 300;
+
+    QMap<QString, QByteArray> files;
+    for (int i = 0; i < numFiles; i++)
+        files.insert(QString("r/d%1/f%2.bin").arg(i % 4).arg(i), contents(100 + i, 1 + (i * 997) % 20000));
+
+    SarcFilesystem* sarc = buildSarc(files);
+
+    QAtomicInt stop(0);
+    QAtomicInt failures(0);
+    QAtomicInt checks(0);
+
+    QList<QThread*> readers;
+    for (int r = 0; r < numReaders; r++)
+    {
+        readers.append(QThread::create([&, r]()
+        {
+            QRandomGenerator rng(r);
+            QList<QString> paths = files.keys();
+
+            while (!stop.loadAcquire())
+            {
+                QString path = paths[rng.bounded(paths.size())];
+                QByteArray expected = files.value(path);
+
+                if (rng.bounded(4) == 0)
+                {
+                    // the readers are the first to need the names, so they load them concurrently
+                    QList<QString> listing;
+                    QString dir = path.section('/', 0, 1);
+                    sarc->directoryContents(dir, QDir::Files, listing);
+                    if (!listing.contains(path.section('/', 2)) || !sarc->directoryExists(dir))
+                        failures.ref();
+                }
+
+                if (!sarc->fileExists(path))
+                    failures.ref();
+
+                FileBase* file = sarc->openFile(path);
+                file->open();
+                QByteArray got(file->size(), Qt::Uninitialized);
+                file->readAt(0, (quint8*)got.data(), got.size());
+                file->close();
+                delete file;
+
+                if (got != expected)
+                    failures.ref();
+
+                checks.ref();
+            }
+        }));
+        readers.last()->start();
+    }
+
+    // grows, shrinks, copies, renames and deletes files next to the ones being read, every change repacks
+    QMap<QString, QByteArray> written;
+    QThread* writer = QThread::create([&]()
+    {
+        QRandomGenerator rng(77);
+
+        for (int w = 0; w < writes; w++)
+        {
+            QString path = QString("w/f%1.bin").arg(rng.bounded(8));
+
+            switch (rng.bounded(4))
+            {
+            case 0:
+            case 1:
+            {
+                QByteArray data = contents(w, 1 + rng.bounded(30000));
+                MemoryFile* file = new MemoryFile(sarc, (quint32)data.size());
+                file->setIdPath(path);
+                file->writeBlock(data);
+                file->save();
+                delete file;
+                written[path] = data;
+                break;
+            }
+            case 2:
+            {
+                QString source = files.keys()[rng.bounded(numFiles)];
+                sarc->deleteFile(path);
+                sarc->copyFile(source, path);
+                written[path] = files.value(source);
+                break;
+            }
+            case 3:
+                sarc->deleteFile(path);
+                written.remove(path);
+                break;
+            }
+        }
+    });
+    writer->start();
+    writer->wait();
+    delete writer;
+
+    // let the readers see the final archive too
+    int seen = checks.loadAcquire();
+    QElapsedTimer timer;
+    timer.start();
+    while (checks.loadAcquire() < seen + 100 && !timer.hasExpired(10000))
+        QThread::msleep(10);
+
+    stop.storeRelease(1);
+    foreach (QThread* reader, readers)
+    {
+        reader->wait();
+        delete reader;
+    }
+
+    QCOMPARE(failures.loadAcquire(), 0);
+
+    for (auto it = written.constBegin(); it != written.constEnd(); ++it)
+    {
+        FileBase* file = sarc->openFile(it.key());
+        file->open();
+        QByteArray got(file->size(), Qt::Uninitialized);
+        file->readAt(0, (quint8*)got.data(), got.size());
+        file->close();
+        delete file;
+        QCOMPARE(got, it.value());
+    }
+
+    delete sarc;
+}
+
+QTEST_APPLESS_MAIN(TestFilesystem)
+#include "tst_filesystem.moc"
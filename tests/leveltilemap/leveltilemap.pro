@@ -0,0 +1,16 @@
+include(../tests.pri)
+
+TARGET = tst_leveltilemap
+
+SOURCES += \
+    tst_leveltilemap.cpp \
+    ../../leveltilemap.cpp \
+    ../../objectindex.cpp \
+    ../../objects.cpp \
+    ../../unitsconvert.cpp
+
+HEADERS += \
+    ../../leveltilemap.h \
+    ../../objectindex.h \
+    ../../objects.h \
+    ../../unitsconvert.h
@@ -0,0 +1,243 @@
+#include <QtTest>
+#include <QRandomGenerator>
+
+#include "leveltilemap.h"
+#include "objectindex.h"
+#include "objects.h"
+
+// Random edits the way the level editor makes them, after each round the tilemap
+// has to match resolving every object again from scratch.
+class TestLevelTilemap : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void matchesFullResolve();
+
+private:
+    // stands in for a tileset, every object fills its area with tiles made from seed
+    struct FakeTileset
+    {
+        int numObjects;
+        int seed;
+        quint64 revision; // 0 for an empty slot
+    };
+
+    FakeTileset tilesets[4];
+    quint64 lastRevision;
+
+    QList<BgdatObject*> objects[2];
+
+    // the area objects stay in, in tiles
+    static const int areaWidth = 160;
+    static const int areaHeight = 100;
+
+    bool expand(int slot, int num, int x, int y, int w, int h, const LevelTilemap::TileVisitor& visit);
+    QList<LevelTilemap::Cell> fullResolve(int layer);
+    BgdatObject* randomObject(QRandomGenerator& rng, int layer);
+};
+
+bool TestLevelTilemap::expand(int slot, int num, int x, int y, int w, int h, const LevelTilemap::TileVisitor& visit)
+{
+    const FakeTileset& ts = tilesets[slot];
+    if (num >= ts.numObjects)
+        return false;
+
+    for (int yy = 0; yy < h; yy++)
+        for (int xx = 0; xx < w; xx++)
+            visit(x+xx, y+yy, (ts.seed + num*31 + xx*7 + yy*13) % 441, num & 7);
+
+    return true;
+}
+
+QList<LevelTilemap::Cell> TestLevelTilemap::fullResolve(int layer)
+{
+    LevelTilemap::Cell empty = { 0, 0xFF, 0 };
+    QList<LevelTilemap::Cell> cells(areaWidth * areaHeight, empty);
+
+    const QList<BgdatObject*>& objs = objects[layer];
+    for (int i = objs.size()-1; i >= 0; i--)
+    {
+        BgdatObject* obj = objs[i];
+        int slot = (obj->getid() >> 12) & 3;
+        if (!tilesets[slot].revision)
+            continue;
+
+        int num = obj->getid() & 0x0FFF;
+        auto put = [&](int x, int y, int tile, int item)
+        {
+            if (x < 0 || y < 0 || x >= areaWidth || y >= areaHeight)
+                return;
+
+            LevelTilemap::Cell& cell = cells[y*areaWidth + x];
+            if (!cell.isEmpty())
+                return;
+
+            cell.tile = tile;
+            cell.tileset = slot;
+            cell.item = item;
+        };
+
+        int x = obj->getx()/20, y = obj->gety()/20, w = obj->getwidth()/20, h = obj->getheight()/20;
+        if (!expand(slot, num, x, y, w, h, put))
+        {
+            for (int yy = 0; yy < h; yy++)
+                for (int xx = 0; xx < w; xx++)
+                    put(x+xx, y+yy, LevelTilemap::errorTile, 0);
+        }
+    }
+
+    return cells;
+}
+
+BgdatObject* TestLevelTilemap::randomObject(QRandomGenerator& rng, int layer)
+{
+    // a few numbers past what the tilesets have, those show as error tiles
+    int id = (rng.bounded(4) << 12) | rng.bounded(48);
+    return new BgdatObject(rng.bounded(areaWidth - 10) * 20, rng.bounded(areaHeight - 10) * 20, (1 + rng.bounded(10)) * 20, (1 + rng.bounded(10)) * 20, id, layer);
+}
+
+void TestLevelTilemap::matchesFullResolve()
+{
+    QRandomGenerator rng(0x7E57);
+    ObjectIndex index;
+    QList<BgdatObject*> removed;
+
+    lastRevision = 0;
+    for (int t = 0; t < 4; t++)
+    {
+        tilesets[t].numObjects = 40;
+        tilesets[t].seed = t * 100;
+        tilesets[t].revision = (t == 3) ? 0 : ++lastRevision;
+    }
+
+    // loaded like Level does it, into the index before the tilemap exists
+    for (int l = 0; l < 2; l++)
+    {
+        for (int i = 0; i < 300; i++)
+        {
+            objects[l].append(randomObject(rng, l));
+            index.insert(objects[l].last());
+        }
+        ObjectIndex::renumber(objects[l]);
+    }
+
+    LevelTilemap tilemap(&index, objects,
+        [this](int slot, int num, int x, int y, int w, int h, const LevelTilemap::TileVisitor& visit) { return expand(slot, num, x, y, w, h, visit); },
+        [this](int slot) { return tilesets[slot].revision; });
+
+    QList<LevelTilemap::Cell> before[2] = { fullResolve(0), fullResolve(1) };
+
+    for (int round = 0; round < 300; round++)
+    {
+        int edits = 1 + rng.bounded(4);
+        for (int e = 0; e < edits; e++)
+        {
+            int l = rng.bounded(2);
+            QList<BgdatObject*>& list = objects[l];
+            BgdatObject* obj = list.isEmpty() ? nullptr : list[rng.bounded(list.size())];
+
+            switch (rng.bounded(obj ? 12 : 1))
+            {
+            case 0: // inserted
+                list.append(randomObject(rng, l));
+                index.insert(list.last());
+                ObjectIndex::setOrder(list, list.size()-1);
+                break;
+            case 1: // deleted
+                list.removeOne(obj);
+                index.remove(obj);
+                removed.append(obj);
+                break;
+            case 2: // deleted and brought back by undo
+            {
+                int pos = list.indexOf(obj);
+                list.removeOne(obj);
+                index.remove(obj);
+                list.insert(pos, obj);
+                index.insert(obj);
+                ObjectIndex::setOrder(list, pos);
+                break;
+            }
+            case 3: case 4: // moved
+                obj->setPosition(rng.bounded(areaWidth - 10) * 20, rng.bounded(areaHeight - 10) * 20);
+                break;
+            case 5: // resized
+                obj->resize((1 + rng.bounded(10)) * 20, (1 + rng.bounded(10)) * 20);
+                break;
+            case 6: // other object
+                obj->setObjID(rng.bounded(48));
+                break;
+            case 7: // other tileset
+                obj->setTsID(rng.bounded(4));
+                break;
+            case 8: // raised
+                list.move(list.indexOf(obj), list.size()-1);
+                ObjectIndex::setOrder(list, list.size()-1);
+                break;
+            case 9: // lowered
+                list.move(list.indexOf(obj), 0);
+                ObjectIndex::setOrder(list, 0);
+                break;
+            case 10: // to the other layer
+                list.removeOne(obj);
+                objects[1-l].append(obj);
+                ObjectIndex::setOrder(objects[1-l], objects[1-l].size()-1);
+                obj->setLayer(1-l);
+                break;
+            case 11: // objects of a tileset edited, or the tileset swapped
+            {
+                int t = rng.bounded(4);
+                if (t == 3)
+                    tilesets[t].revision = tilesets[t].revision ? 0 : ++lastRevision;
+                else
+                {
+                    tilesets[t].seed++;
+                    tilesets[t].revision = ++lastRevision;
+                }
+                break;
+            }
+            }
+        }
+
+        QList<QRect> changed[2];
+        bool all = tilemap.update(changed);
+
+        for (int l = 0; l < 2; l++)
+        {
+            QList<LevelTilemap::Cell> expected = fullResolve(l);
+
+            for (int y = 0; y < areaHeight; y++)
+            {
+                for (int x = 0; x < areaWidth; x++)
+                {
+                    const LevelTilemap::Cell& want = expected[y*areaWidth + x];
+                    const LevelTilemap::Cell& got = tilemap.at(l, x, y);
+
+                    if (got.tileset != want.tileset || (!want.isEmpty() && (got.tile != want.tile || got.item != want.item)))
+                        QFAIL(qPrintable(QString("round %1, layer %2, cell %3,%4").arg(round).arg(l).arg(x).arg(y)));
+
+                    // the view only redraws what's reported, so every changed cell has to be in there
+                    const LevelTilemap::Cell& old = before[l][y*areaWidth + x];
+                    if (all || (old.tileset == want.tileset && old.tile == want.tile && old.item == want.item))
+                        continue;
+
+                    bool reported = false;
+                    foreach (const QRect& rect, changed[l])
+                        reported |= rect.intersects(QRect(x*20, y*20, 20, 20));
+                    if (!reported)
+                        QFAIL(qPrintable(QString("round %1, layer %2, cell %3,%4 changed unreported").arg(round).arg(l).arg(x).arg(y)));
+                }
+            }
+
+            before[l] = expected;
+        }
+    }
+
+    for (int l = 0; l < 2; l++)
+        qDeleteAll(objects[l]);
+    qDeleteAll(removed);
+}
+
+QTEST_APPLESS_MAIN(TestLevelTilemap)
+#include "tst_leveltilemap.moc"
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+TARGET = tst_lz11
+
+SOURCES += \
+    tst_lz11.cpp \
+    ../../filesystem/lz11.cpp
+
+HEADERS += \
+    ../../filesystem/lz11.h
@@ -0,0 +1,183 @@
+#include <QtTest>
+#include <QRandomGenerator>
+
+#include "filesystem/lz11.h"
+
+class TestLz11 : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip_data();
+    void roundTrip();
+    void corruptData();
+    void sizeBound();
+
+    void compressSpeed_data();
+    void compressSpeed();
+    void decompressSpeed_data();
+    void decompressSpeed();
+
+private:
+    // random bytes, copies of earlier runs and runs of one byte mixed, like level and tileset data
+    static QByteArray noise(int size, quint32 seed);
+    static QByteArray mixed(int size, quint32 seed);
+    static void addSpeedRows();
+};
+
+QByteArray TestLz11::noise(int size, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+    QByteArray ret(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i++)
+        ret[i] = (char)rng.bounded(256);
+    return ret;
+}
+
+QByteArray TestLz11::mixed(int size, quint32 seed)
+{
+    QRandomGenerator rng(seed);
+    QByteArray ret;
+    ret.reserve(size);
+
+    while (ret.size() < size)
+    {
+        int len = qMin<int>(rng.bounded(1, 300), size - ret.size());
+        switch (rng.bounded(3))
+        {
+        case 0:
+            for (int i = 0; i < len; i++)
+                ret.append((char)rng.bounded(256));
+            break;
+        case 1:
+            if (ret.size() > 0)
+            {
+                int from = rng.bounded(qMax(0, ret.size() - 0x1000), ret.size());
+                for (int i = 0; i < len; i++)
+                    ret.append(ret[from + i]);
+                break;
+            }
+            Q_FALLTHROUGH();
+        default:
+            ret.append(len, (char)rng.bounded(256));
+            break;
+        }
+    }
+    return ret;
+}
+
+void TestLz11::roundTrip_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("format");
+
+    for (int f = Lz11::LZ11; f <= Lz11::LZ13; f++)
+    {
+        const char* name = (f == Lz11::LZ11) ? "lz11" : "lz13";
+
+        QTest::newRow(qPrintable(QString("%1 one byte").arg(name))) << QByteArray(1, 'x') << f;
+        QTest::newRow(qPrintable(QString("%1 short").arg(name))) << QByteArray("abcabcabcabcabcd") << f;
+        QTest::newRow(qPrintable(QString("%1 zeroes").arg(name))) << QByteArray(1024*1024, '\0') << f;
+        QTest::newRow(qPrintable(QString("%1 random").arg(name))) << noise(64*1024, 1) << f;
+        QTest::newRow(qPrintable(QString("%1 mixed").arg(name))) << mixed(300000, 2) << f;
+        // big enough to be split across threads, long runs cross the chunk borders
+        QTest::newRow(qPrintable(QString("%1 mixed big").arg(name))) << mixed(3*1024*1024 + 17, 3) << f;
+    }
+
+    // needs the 4 byte size in the header
+    QTest::newRow("lz11 past 16M") << QByteArray(0x1000000 + 5, 'z') << (int)Lz11::LZ11;
+}
+
+void TestLz11::roundTrip()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, format);
+
+    QByteArray packed = Lz11::compress((const quint8*)data.constData(), data.size(), (Lz11::Format)format);
+
+    quint32 size = 0;
+    QCOMPARE((int)Lz11::detect((const quint8*)packed.constData(), packed.size(), &size), format);
+    QCOMPARE(size, (quint32)data.size());
+    QVERIFY(size <= Lz11::maxDecompressedSize(packed.size()));
+
+    QByteArray unpacked(size, Qt::Uninitialized);
+    QVERIFY(Lz11::decompress((const quint8*)packed.constData(), packed.size(), (quint8*)unpacked.data(), size));
+    QVERIFY(unpacked == data);
+}
+
+void TestLz11::corruptData()
+{
+    QByteArray data = mixed(100000, 4);
+    QByteArray packed = Lz11::compress((const quint8*)data.constData(), data.size());
+    QByteArray out(data.size(), Qt::Uninitialized);
+
+    // cut short
+    QVERIFY(!Lz11::decompress((const quint8*)packed.constData(), packed.size() / 2, (quint8*)out.data(), out.size()));
+
+    // a match reaching back before the start
+    QByteArray bad("\x11\x10\x00\x00\x80\x20\x00", 7);
+    QVERIFY(!Lz11::decompress((const quint8*)bad.constData(), bad.size(), (quint8*)out.data(), 16));
+
+    QVERIFY(Lz11::detect((const quint8*)"\x11\x00\x00\x00\x00\x00\x00\x00", 8) == Lz11::None);
+    QVERIFY(Lz11::detect((const quint8*)"\x10\x10\x00\x00", 4) == Lz11::None);
+}
+
+void TestLz11::sizeBound()
+{
+    // nothing packs better than one long match after another
+    QByteArray zeroes(8*1024*1024, '\0');
+    QByteArray packed = Lz11::compress((const quint8*)zeroes.constData(), zeroes.size());
+    QVERIFY((quint64)zeroes.size() <= Lz11::maxDecompressedSize(packed.size()));
+
+    // but a handful of bytes can't be gigabytes
+    QVERIFY(Lz11::maxDecompressedSize(8) < 0x1000000);
+    QCOMPARE(Lz11::maxDecompressedSize(0xFFFFFFFFULL), (quint64)Lz11::maxOutputSize);
+}
+
+void TestLz11::addSpeedRows()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("mixed 8M") << mixed(8*1024*1024, 5);
+    QTest::newRow("zeroes 8M") << QByteArray(8*1024*1024, '\0');
+}
+
+void TestLz11::compressSpeed_data()
+{
+    addSpeedRows();
+}
+
+// divide the size by the time per iteration for the throughput
+void TestLz11::compressSpeed()
+{
+    QFETCH(QByteArray, data);
+
+    QBENCHMARK
+    {
+        QByteArray packed = Lz11::compress((const quint8*)data.constData(), data.size());
+        Q_UNUSED(packed);
+    }
+}
+
+void TestLz11::decompressSpeed_data()
+{
+    addSpeedRows();
+}
+
+void TestLz11::decompressSpeed()
+{
+    QFETCH(QByteArray, data);
+
+    QByteArray packed = Lz11::compress((const quint8*)data.constData(), data.size());
+    QByteArray out(data.size(), Qt::Uninitialized);
+
+    QBENCHMARK
+    {
+        Lz11::decompress((const quint8*)packed.constData(), packed.size(), (quint8*)out.data(), out.size());
+    }
+
+    QVERIFY(out == data);
+}
+
+QTEST_APPLESS_MAIN(TestLz11)
+#include "tst_lz11.moc"
@@ -0,0 +1,14 @@
+include(../tests.pri)
+
+TARGET = tst_objectindex
+
+SOURCES += \
+    tst_objectindex.cpp \
+    ../../objectindex.cpp \
+    ../../objects.cpp \
+    ../../unitsconvert.cpp
+
+HEADERS += \
+    ../../objectindex.h \
+    ../../objects.h \
+    ../../unitsconvert.h
@@ -0,0 +1,139 @@
+#include <QtTest>
+#include <QRandomGenerator>
+
+#include "objectindex.h"
+#include "objects.h"
+
+class TestObjectIndex : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void listOrder();
+    void queryLargeLevel();
+
+private:
+    static BgdatObject* randomObject(QRandomGenerator& rng, int levelWidth);
+    static bool matchesList(const ObjectIndex& index, const QList<BgdatObject*>& list, const QRect& rect);
+};
+
+BgdatObject* TestObjectIndex::randomObject(QRandomGenerator& rng, int levelWidth)
+{
+    return new BgdatObject(rng.bounded(levelWidth / 20) * 20, rng.bounded(512) * 20, (1 + rng.bounded(8)) * 20, (1 + rng.bounded(4)) * 20, rng.bounded(256), 0);
+}
+
+// what the index gives, sorted by key, has to be what a walk over the list gives
+bool TestObjectIndex::matchesList(const ObjectIndex& index, const QList<BgdatObject*>& list, const QRect& rect)
+{
+    QList<BgdatObject*> hits;
+    foreach (Object* obj, index.query(rect))
+        hits.append(static_cast<BgdatObject*>(obj));
+    ObjectIndex::sortByOrder(hits);
+
+    QSet<BgdatObject*> hitSet(hits.begin(), hits.end());
+    QList<BgdatObject*> expected;
+    foreach (BgdatObject* obj, list)
+    {
+        if (hitSet.contains(obj))
+            expected.append(obj);
+    }
+
+    return hits == expected;
+}
+
+void TestObjectIndex::listOrder()
+{
+    QRandomGenerator rng(0x0BD1);
+    ObjectIndex index;
+    QList<BgdatObject*> list;
+
+    for (int i = 0; i < 2000; i++)
+    {
+        list.append(randomObject(rng, 4096));
+        index.insert(list.last());
+    }
+    ObjectIndex::renumber(list);
+
+    for (int op = 0; op < 5000; op++)
+    {
+        switch (rng.bounded(5))
+        {
+        case 0: // added at the end, like Level::add()
+            list.append(randomObject(rng, 4096));
+            index.insert(list.last());
+            ObjectIndex::setOrder(list, list.size()-1);
+            break;
+        case 1: // deleted, and put back where it was by undo
+        {
+            int pos = rng.bounded(list.size());
+            BgdatObject* obj = list.takeAt(pos);
+            index.remove(obj);
+            list.insert(pos, obj);
+            index.insert(obj);
+            ObjectIndex::setOrder(list, pos);
+            break;
+        }
+        case 2: // raised
+            list.move(rng.bounded(list.size()), list.size()-1);
+            ObjectIndex::setOrder(list, list.size()-1);
+            break;
+        case 3: // lowered
+            list.move(rng.bounded(list.size()), 0);
+            ObjectIndex::setOrder(list, 0);
+            break;
+        case 4: // moved around
+            list[rng.bounded(list.size())]->increasePosition(rng.bounded(-200, 200), rng.bounded(-200, 200));
+            break;
+        }
+    }
+
+    // the same spot over and over runs out of room between two keys
+    for (int i = 0; i < 64; i++)
+    {
+        list.insert(1, randomObject(rng, 4096));
+        index.insert(list[1]);
+        ObjectIndex::setOrder(list, 1);
+    }
+
+    for (int i = 0; i < 200; i++)
+    {
+        QRect rect(rng.bounded(4096), rng.bounded(512*20), 1 + rng.bounded(2000), 1 + rng.bounded(2000));
+        if (!matchesList(index, list, rect))
+            QFAIL(qPrintable(QString("query %1 out of order").arg(i)));
+    }
+
+    QVERIFY(matchesList(index, list, QRect(0, 0, 4096*20, 512*20)));
+
+    qDeleteAll(list);
+}
+
+void TestObjectIndex::queryLargeLevel()
+{
+    QRandomGenerator rng(0x1A46E);
+    ObjectIndex index;
+    QList<BgdatObject*> list;
+
+    // a lot more than any real level has, across the whole width
+    for (int i = 0; i < 100000; i++)
+    {
+        list.append(randomObject(rng, 4096*20));
+        index.insert(list.last());
+    }
+    ObjectIndex::renumber(list);
+
+    QRect screen(40000, 4000, 1920, 1080);
+    QVERIFY(matchesList(index, list, screen));
+
+    QBENCHMARK
+    {
+        QList<BgdatObject*> hits;
+        foreach (Object* obj, index.query(screen))
+            hits.append(static_cast<BgdatObject*>(obj));
+        ObjectIndex::sortByOrder(hits);
+    }
+
+    qDeleteAll(list);
+}
+
+QTEST_APPLESS_MAIN(TestObjectIndex)
+#include "tst_objectindex.moc"
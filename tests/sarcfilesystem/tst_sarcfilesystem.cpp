@@ -0,0 +1,381 @@
+#include <QtTest>
+
+#include "filesystem/filesystem.h"
+
+class TestSarcFilesystem : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void repackRoundTrip();
+    void rollbackRestoresArchive();
+    void nestedRollbackFailsCommit();
+    void dedupedCopiesDiverge();
+
+private:
+    typedef QMap<QString, QByteArray> Files;
+
+    // an entry as it is in the SFAT, offsets relative to the data
+    struct Node
+    {
+        quint32 start, end;
+    };
+
+    static QByteArray contents(int gen, int size);
+
+    // payloads go in the reverse of the SFAT order, so the first repack
+    // has to swap them around and run into cycles of overlapping moves
+    static QByteArray buildSarc(const Files& files);
+
+    static SarcFilesystem* open(const QByteArray& archive, MemoryFile** file);
+    static QByteArray archiveBytes(MemoryFile* file);
+    static QMap<QString, Node> readNodes(const QByteArray& archive, quint32* dataOffset = nullptr);
+
+    static void save(SarcFilesystem* sarc, const QString& path, const QByteArray& data);
+    static QByteArray read(SarcFilesystem* sarc, const QString& path);
+
+    // both through the filesystem and straight from the archive bytes
+    static void verify(SarcFilesystem* sarc, MemoryFile* file, const Files& files);
+};
+
+QByteArray TestSarcFilesystem::contents(int gen, int size)
+{
+    QByteArray ret(size, Qt::Uninitialized);
+    for (int i = 0; i < size; i++)
+        ret[i] = (char)(gen*31 + i*7 + (i >> 8));
+    return ret;
+}
+
+QByteArray TestSarcFilesystem::buildSarc(const Files& files)
+{
+    const quint32 hashMult = 0x65;
+
+    QList<QPair<quint32, QString>> nodes;
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        quint32 hash = 0;
+        foreach (QChar c, it.key())
+            hash = hash * hashMult + c.toLatin1();
+        nodes.append(qMakePair(hash, it.key()));
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    QByteArray names;
+    QList<quint32> nameOffsets;
+    foreach (const auto& node, nodes)
+    {
+        nameOffsets.append(names.size());
+        names.append(node.second.toLatin1());
+        names.append('\0');
+        while (names.size() & 3)
+            names.append('\0');
+    }
+
+    quint32 dataOffset = (0x14 + 0xC + nodes.size()*0x10 + 8 + names.size() + 0xF) & ~0xF;
+
+    QByteArray data;
+    QList<quint32> dataOffsets;
+    for (int i = 0; i < nodes.size(); i++)
+        dataOffsets.append(0);
+    for (int i = nodes.size() - 1; i >= 0; i--)
+    {
+        while (data.size() & 0xF)
+            data.append('\0');
+        dataOffsets[i] = data.size();
+        data.append(files[nodes[i].second]);
+    }
+
+    BinaryWriter<> out(dataOffset + data.size());
+    out.write32(0x43524153);
+    out.write16(0x14);
+    out.write16(0xFEFF);
+    out.write32(dataOffset + data.size());
+    out.write32(dataOffset);
+    out.write32(0x100);
+
+    out.write32(0x54414653);
+    out.write16(0xC);
+    out.write16(nodes.size());
+    out.write32(hashMult);
+    for (int i = 0; i < nodes.size(); i++)
+    {
+        out.write32(nodes[i].first);
+        out.write32(0x01000000 | (nameOffsets[i] / 4));
+        out.write32(dataOffsets[i]);
+        out.write32(dataOffsets[i] + files[nodes[i].second].size());
+    }
+
+    out.write32(0x544E4653);
+    out.write16(0x8);
+    out.write16(0);
+    out.writeData((const quint8*)names.constData(), names.size());
+
+    out.seek(dataOffset);
+    out.writeData((const quint8*)data.constData(), data.size());
+
+    return out.block();
+}
+
+SarcFilesystem* TestSarcFilesystem::open(const QByteArray& archive, MemoryFile** file)
+{
+    quint8* buf = new quint8[archive.size()];
+    memcpy(buf, archive.constData(), archive.size());
+    *file = new MemoryFile(NULL, buf, archive.size());
+    return new SarcFilesystem(*file);
+}
+
+QByteArray TestSarcFilesystem::archiveBytes(MemoryFile* file)
+{
+    QByteArray ret(file->size(), Qt::Uninitialized);
+    file->readAt(0, (quint8*)ret.data(), ret.size());
+    return ret;
+}
+
+QMap<QString, TestSarcFilesystem::Node> TestSarcFilesystem::readNodes(const QByteArray& archive, quint32* dataOffset)
+{
+    QMap<QString, Node> ret;
+
+    BinaryCursor<> in(archive);
+    if (in.read32() != 0x43524153)
+        return ret;
+
+    in.skip(4);
+    if (in.read32() != (quint32)archive.size())
+        return ret;
+
+    quint32 dataStart = in.read32();
+    if (dataOffset)
+        *dataOffset = dataStart;
+
+    in.seek(0x14 + 6);
+    quint32 count = in.read16();
+    quint32 namesStart = 0x14 + 0xC + count*0x10 + 8;
+
+    in.seek(0x14 + 0xC);
+    for (quint32 i = 0; i < count; i++)
+    {
+        in.skip(4);
+        quint32 nameOffset = (in.read32() & 0x00FFFFFF) << 2;
+
+        Node node;
+        node.start = in.read32();
+        node.end = in.read32();
+
+        BinaryCursor<> name(archive);
+        name.seek(namesStart + nameOffset);
+        QString path;
+        name.readStringASCII(path);
+
+        ret.insert(path, node);
+    }
+
+    return ret;
+}
+
+void TestSarcFilesystem::save(SarcFilesystem* sarc, const QString& path, const QByteArray& data)
+{
+    MemoryFile* file = new MemoryFile(sarc, (quint32)data.size());
+    file->setIdPath(path);
+    file->writeBlock(data);
+    file->save();
+    delete file;
+}
+
+QByteArray TestSarcFilesystem::read(SarcFilesystem* sarc, const QString& path)
+{
+    FileBase* file = sarc->openFile(path);
+    file->open();
+    QByteArray ret(file->size(), Qt::Uninitialized);
+    file->readAt(0, (quint8*)ret.data(), ret.size());
+    file->close();
+    delete file;
+    return ret;
+}
+
+void TestSarcFilesystem::verify(SarcFilesystem* sarc, MemoryFile* file, const Files& files)
+{
+    QByteArray archive = archiveBytes(file);
+
+    quint32 dataOffset;
+    QMap<QString, Node> nodes = readNodes(archive, &dataOffset);
+    QCOMPARE(nodes.keys(), files.keys());
+
+    for (auto it = files.constBegin(); it != files.constEnd(); ++it)
+    {
+        Node node = nodes[it.key()];
+        QCOMPARE(node.end - node.start, (quint32)it.value().size());
+        QVERIFY2(archive.mid(dataOffset + node.start, node.end - node.start) == it.value(), qPrintable(it.key()));
+
+        QVERIFY2(sarc->fileExists(it.key()), qPrintable(it.key()));
+        QVERIFY2(read(sarc, it.key()) == it.value(), qPrintable(it.key()));
+    }
+}
+
+
+void TestSarcFilesystem::repackRoundTrip()
+{
+    // a few over the chunk size payloads get moved in
+    Files files;
+    files["a/big0.bin"] = contents(1, 0x18000);
+    files["a/big1.bin"] = contents(2, 0x18000);
+    files["b/small.bin"] = contents(3, 0x30);
+    files["b/mid.bin"] = contents(4, 0x1234);
+    files["c/tiny.bin"] = contents(5, 1);
+    files["c/edit.bin"] = contents(6, 0x800);
+
+    MemoryFile* file;
+    SarcFilesystem* sarc = open(buildSarc(files), &file);
+    verify(sarc, file, files);
+
+    // same size, everything else gets swapped around into hash order
+    files["c/edit.bin"] = contents(7, 0x800);
+    save(sarc, "c/edit.bin", files["c/edit.bin"]);
+    verify(sarc, file, files);
+
+    // payloads behind it move up
+    files["b/small.bin"] = contents(8, 0x12345);
+    save(sarc, "b/small.bin", files["b/small.bin"]);
+    verify(sarc, file, files);
+
+    // and back down
+    files["a/big0.bin"] = contents(9, 0x20);
+    save(sarc, "a/big0.bin", files["a/big0.bin"]);
+    verify(sarc, file, files);
+
+    // two files trading contents in one repack
+    {
+        FilesystemTransaction transaction(sarc);
+        save(sarc, "a/big1.bin", files["b/mid.bin"]);
+        save(sarc, "b/mid.bin", files["a/big1.bin"]);
+        QVERIFY(transaction.commit());
+    }
+    qSwap(files["a/big1.bin"], files["b/mid.bin"]);
+    verify(sarc, file, files);
+
+    // a new entry shifts all the data behind the bigger tables
+    files["d/new.bin"] = contents(10, 0x4321);
+    save(sarc, "d/new.bin", files["d/new.bin"]);
+    verify(sarc, file, files);
+
+    files.remove("a/big0.bin");
+    QVERIFY(sarc->deleteFile("a/big0.bin"));
+    verify(sarc, file, files);
+
+    // what got written opens as a fresh archive too
+    MemoryFile* reopenedFile;
+    SarcFilesystem* reopened = open(archiveBytes(file), &reopenedFile);
+    verify(reopened, reopenedFile, files);
+
+    delete reopened;
+    delete sarc;
+}
+
+void TestSarcFilesystem::rollbackRestoresArchive()
+{
+    Files files;
+    files["a.bin"] = contents(1, 0x3000);
+    files["dir/b.bin"] = contents(2, 0x40);
+    files["dir/c.bin"] = contents(3, 0x11111);
+
+    MemoryFile* file;
+    SarcFilesystem* sarc = open(buildSarc(files), &file);
+    QByteArray original = archiveBytes(file);
+
+    {
+        FilesystemTransaction transaction(sarc);
+        save(sarc, "a.bin", contents(4, 0x100));
+        save(sarc, "new.bin", contents(5, 0x2000));
+        QVERIFY(sarc->deleteFile("dir/b.bin"));
+        QVERIFY(sarc->copyFile("dir/c.bin", "copy.bin"));
+        QVERIFY(sarc->renameFile("dir/c.bin", "d.bin"));
+
+        // staged, nothing reached the archive yet
+        QVERIFY(read(sarc, "a.bin") == contents(4, 0x100));
+        QVERIFY(archiveBytes(file) == original);
+    }
+
+    QVERIFY(archiveBytes(file) == original);
+    QVERIFY(!sarc->fileExists("new.bin"));
+    QVERIFY(!sarc->fileExists("copy.bin"));
+    QVERIFY(!sarc->fileExists("dir/d.bin"));
+    verify(sarc, file, files);
+
+    // the restored entries still point at the right data
+    files["e.bin"] = contents(6, 0x500);
+    save(sarc, "e.bin", files["e.bin"]);
+    verify(sarc, file, files);
+
+    delete sarc;
+}
+
+void TestSarcFilesystem::nestedRollbackFailsCommit()
+{
+    Files files;
+    files["a.bin"] = contents(1, 0x200);
+    files["b.bin"] = contents(2, 0x20000);
+
+    MemoryFile* file;
+    SarcFilesystem* sarc = open(buildSarc(files), &file);
+    QByteArray original = archiveBytes(file);
+
+    {
+        FilesystemTransaction outer(sarc);
+        save(sarc, "a.bin", contents(3, 0x300));
+
+        {
+            FilesystemTransaction inner(sarc);
+            save(sarc, "b.bin", contents(4, 0x10));
+        }
+
+        QVERIFY(!outer.commit());
+    }
+
+    QVERIFY(archiveBytes(file) == original);
+    verify(sarc, file, files);
+
+    delete sarc;
+}
+
+void TestSarcFilesystem::dedupedCopiesDiverge()
+{
+    Files files;
+    files["a.bin"] = contents(1, 0x1800);
+    files["b.bin"] = contents(2, 0x900);
+
+    MemoryFile* file;
+    SarcFilesystem* sarc = open(buildSarc(files), &file);
+
+    QVERIFY(sarc->copyFile("a.bin", "copy.bin"));
+    files["copy.bin"] = files["a.bin"];
+
+    // same contents as b, saved separately
+    save(sarc, "same.bin", files["b.bin"]);
+    files["same.bin"] = files["b.bin"];
+
+    verify(sarc, file, files);
+
+    QMap<QString, Node> nodes = readNodes(archiveBytes(file));
+    QCOMPARE(nodes["copy.bin"].start, nodes["a.bin"].start);
+    QCOMPARE(nodes["same.bin"].start, nodes["b.bin"].start);
+
+    // only the two payloads are stored
+    quint32 dataOffset;
+    readNodes(archiveBytes(file), &dataOffset);
+    QCOMPARE(file->size(), (quint64)dataOffset + 0x1800 + 0x900);
+
+    // writing one of them leaves the other alone
+    files["copy.bin"] = contents(3, 0x1800);
+    save(sarc, "copy.bin", files["copy.bin"]);
+    files["b.bin"] = contents(4, 0x700);
+    save(sarc, "b.bin", files["b.bin"]);
+    verify(sarc, file, files);
+
+    nodes = readNodes(archiveBytes(file));
+    QVERIFY(nodes["copy.bin"].start != nodes["a.bin"].start);
+    QVERIFY(nodes["same.bin"].start != nodes["b.bin"].start);
+
+    delete sarc;
+}
+
+QTEST_APPLESS_MAIN(TestSarcFilesystem)
+#include "tst_sarcfilesystem.moc"
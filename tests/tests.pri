@@ -0,0 +1,11 @@
+# shared by all test programs
+
+TEMPLATE = app
+
+QT += testlib gui
+QT -= widgets
+
+CONFIG += testcase console c++17
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/..
@@ -0,0 +1,15 @@
+# Unit tests, run with "qmake && make check" from this directory.
+# Each test builds just the sources it covers, so none of them need a game dump.
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    alphakernels \
+    atlaskernels \
+    etc1decoder \
+    filesystem \
+    leveltilemap \
+    lz11 \
+    objectindex \
+    sarcfilesystem \
+    tilebatch
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+TARGET = tst_tilebatch
+
+SOURCES += \
+    tst_tilebatch.cpp \
+    ../../atlaskernels.cpp
+
+HEADERS += \
+    ../../atlaskernels.h
@@ -0,0 +1,142 @@
+#include <QtTest>
+#include <QGuiApplication>
+#include <QPainter>
+#include <QPixmap>
+#include <QRandomGenerator>
+
+#include "atlaskernels.h"
+
+// The tile pass of the level view, on a screen full of tiles:
+// one drawImage per tile from the RGBA atlas as it used to be, against one drawPixmapFragments per tileset.
+class TestTileBatch : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void sameResult();
+    void paintTiles_data();
+    void paintTiles();
+
+private:
+    enum Mode { ImagePerTile, PixmapPerTile, PixmapFragments };
+
+    QImage atlas;
+    QList<int> tiles; // two full layers of 1920x1080 at zoom 1
+
+    static const int tilesX = 96;
+    static const int tilesY = 54;
+
+    void paint(QImage& target, Mode mode, float zoom, const QImage& img, const QPixmap& pixmap, int lod);
+};
+
+void TestTileBatch::initTestCase()
+{
+    QRandomGenerator rng(0x711E);
+
+    QImage tileset(420, 420, QImage::Format_RGBA8888);
+    for (int y = 0; y < tileset.height(); y++)
+    {
+        quint32* line = (quint32*)tileset.scanLine(y);
+        for (int x = 0; x < tileset.width(); x++)
+            line[x] = rng.generate() | 0xFF000000;
+    }
+    atlas = AtlasKernels::pad(tileset);
+
+    for (int i = 0; i < 2*tilesX*tilesY; i++)
+        tiles.append(rng.bounded(21*21));
+}
+
+void TestTileBatch::paint(QImage& target, Mode mode, float zoom, const QImage& img, const QPixmap& pixmap, int lod)
+{
+    int tileSize = AtlasKernels::tileSize(lod);
+    int border = AtlasKernels::borderSize(lod);
+    int cell = AtlasKernels::cellSize(lod);
+    int tsize = (int)(20*zoom);
+
+    QPainter painter(&target);
+    QList<QPainter::PixmapFragment> batch;
+
+    for (int l = 1; l >= 0; l--)
+    {
+        for (int i = 0; i < tilesX*tilesY; i++)
+        {
+            int num = tiles[l*tilesX*tilesY + i];
+            QRect dst((i % tilesX) * tsize, (i / tilesX) * tsize, tsize, tsize);
+            QRectF src(border + (num%21)*cell, border + (num/21)*cell, tileSize, tileSize);
+
+            if (mode == ImagePerTile)
+                painter.drawImage(dst, img, src);
+            else if (mode == PixmapPerTile)
+                painter.drawPixmap(dst, pixmap, src);
+            else
+                batch.append(QPainter::PixmapFragment::create(QRectF(dst).center(), src, dst.width() / src.width(), dst.height() / src.height()));
+        }
+
+        if (mode == PixmapFragments)
+        {
+            painter.drawPixmapFragments(batch.constData(), batch.size(), pixmap);
+            batch.clear();
+        }
+    }
+}
+
+void TestTileBatch::sameResult()
+{
+    QPixmap pixmap = QPixmap::fromImage(atlas);
+
+    QImage single(tilesX*20, tilesY*20, QImage::Format_ARGB32_Premultiplied);
+    QImage batched(tilesX*20, tilesY*20, QImage::Format_ARGB32_Premultiplied);
+    single.fill(0);
+    batched.fill(0);
+
+    paint(single, PixmapPerTile, 1, atlas, pixmap, 0);
+    paint(batched, PixmapFragments, 1, atlas, pixmap, 0);
+
+    QCOMPARE(batched, single);
+}
+
+void TestTileBatch::paintTiles_data()
+{
+    QTest::addColumn<int>("mode");
+    QTest::addColumn<float>("zoom");
+
+    QTest::newRow("image per tile, zoom 1") << (int)ImagePerTile << 1.0f;
+    QTest::newRow("pixmap per tile, zoom 1") << (int)PixmapPerTile << 1.0f;
+    QTest::newRow("pixmap fragments, zoom 1") << (int)PixmapFragments << 1.0f;
+    QTest::newRow("image per tile, zoom 0.25") << (int)ImagePerTile << 0.25f;
+    QTest::newRow("pixmap per tile, zoom 0.25") << (int)PixmapPerTile << 0.25f;
+    QTest::newRow("pixmap fragments, zoom 0.25") << (int)PixmapFragments << 0.25f;
+}
+
+void TestTileBatch::paintTiles()
+{
+    QFETCH(int, mode);
+    QFETCH(float, zoom);
+
+    // drawing a lod atlas when zoomed out is part of the batched path, the old one always used the full size image
+    int lod = (mode == ImagePerTile) ? 0 : (zoom < 0.5f ? 2 : 0);
+    QImage img = lod ? AtlasKernels::downscale(atlas, lod) : atlas;
+    QPixmap pixmap = QPixmap::fromImage(img);
+
+    QImage target(tilesX*20, tilesY*20, QImage::Format_ARGB32_Premultiplied);
+
+    QBENCHMARK
+    {
+        target.fill(0);
+        paint(target, (Mode)mode, zoom, img, pixmap, lod);
+    }
+}
+
+// QPixmap needs a gui application, the offscreen platform does when there is no display
+int main(int argc, char** argv)
+{
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QGuiApplication app(argc, argv);
+    TestTileBatch test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_tilebatch.moc"
@@ -0,0 +1,256 @@
+#include "texturecache.h"
+#include "settingsmanager.h"
+#include "filesystem/filesystem.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDir>
+#include <stdexcept>
+
+TextureCache* TextureCache::instance = NULL;
+
+TextureCache* TextureCache::init()
+{
+    if (instance != NULL)
+        throw std::runtime_error("TextureCache is already inited.");
+
+    instance = new TextureCache();
+    return instance;
+}
+
+TextureCache* TextureCache::getInstance()
+{
+    if (instance == NULL)
+        throw std::runtime_error("TextureCache is not inited.");
+
+    return instance;
+}
+
+TextureCache::TextureCache()
+{
+    path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/textures/";
+    QDir().mkpath(path);
+
+    maxSize = (qint64)SettingsManager::getInstance()->get("textureCacheSize", 256).toInt() * 1024 * 1024;
+
+    useCounter = 0;
+    totalSize = 0;
+    loadIndex();
+}
+
+TextureCache::~TextureCache()
+{
+    instance = NULL;
+}
+
+QByteArray TextureCache::makeKey(const QByteArray& texData, quint32 format, quint32 width, quint32 height, bool premultiply)
+{
+    BinaryWriter<> layout(20);
+    layout.write32(version);
+    layout.write32(format);
+    layout.write32(width);
+    layout.write32(height);
+    layout.write32(premultiply ? 1 : 0);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(layout.block());
+    hash.addData(texData);
+    return hash.result().toHex();
+}
+
+QString TextureCache::entryPath(const QByteArray& key)
+{
+    return path + QString::fromLatin1(key) + ".tex";
+}
+
+void TextureCache::loadIndex()
+{
+    // oldest first, hits touch the files so this is the use order of the last session
+    QFileInfoList files = QDir(path).entryInfoList(QStringList() << "*.tex", QDir::Files, QDir::Time | QDir::Reversed);
+
+    foreach (const QFileInfo& info, files)
+        touch(info.completeBaseName().toLatin1(), info.size());
+}
+
+// makes the entry the most recently used one, adds it if it's new
+void TextureCache::touch(const QByteArray& key, qint64 size)
+{
+    QHash<QByteArray,Entry>::iterator it = entries.find(key);
+    if (it != entries.end())
+    {
+        useOrder.remove(it->lastUse);
+        totalSize -= it->size;
+    }
+
+    Entry entry;
+    entry.size = size;
+    entry.lastUse = useCounter++;
+
+    entries.insert(key, entry);
+    useOrder.insert(entry.lastUse, key);
+    totalSize += size;
+}
+
+// cleanup for images on a mapped cache file
+static void closeCacheFile(void* info)
+{
+    delete (QFile*)info;
+}
+
+QImage TextureCache::load(const QByteArray& key)
+{
+    QFile* file = new QFile(entryPath(key));
+
+    if (!file->open(QIODevice::ReadOnly) || file->size() < headerSize)
+    {
+        delete file;
+        misses.ref();
+        return QImage();
+    }
+
+    const uchar* data = file->map(0, file->size());
+    if (!data)
+    {
+        delete file;
+        misses.ref();
+        return QImage();
+    }
+
+    BinaryCursor<> in(data, headerSize);
+
+    QString magic;
+    in.readStringASCII(magic, 4);
+    quint32 fileVersion = in.read32();
+    quint32 width = in.read32();
+    quint32 height = in.read32();
+    quint32 format = in.read32();
+    quint32 bytesPerLine = in.read32();
+    quint32 dataSize = in.read32();
+
+    // a damaged entry could make QImage read past the mapping
+    quint32 bpp = bytesPerPixel(format);
+
+    if (magic != "CKTX" || fileVersion != version || bpp == 0 || width == 0 || height == 0 ||
+        (quint64)bytesPerLine < (quint64)width * bpp || (quint64)bytesPerLine * height != dataSize ||
+        (quint64)file->size() < headerSize + dataSize)
+    {
+        delete file;
+        misses.ref();
+        return QImage();
+    }
+
+    // the modification time keeps the use order for the next session
+    file->setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+
+    indexLock.lock();
+    touch(key, file->size());
+    indexLock.unlock();
+
+    hits.ref();
+
+    // the file stays open until the image and all its copies are gone
+    return QImage(data + headerSize, width, height, bytesPerLine, (QImage::Format)format, closeCacheFile, file);
+}
+
+void TextureCache::store(const QByteArray& key, const QImage& img)
+{
+    if (img.isNull() || bytesPerPixel(img.format()) == 0)
+        return;
+
+    BinaryWriter<> header(headerSize);
+    header.writeStringASCII("CKTX", 4);
+    header.write32(version);
+    header.write32(img.width());
+    header.write32(img.height());
+    header.write32(img.format());
+    header.write32(img.bytesPerLine());
+    header.write32(img.sizeInBytes());
+
+    QSaveFile file(entryPath(key));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    if (file.write(header.block()) != (qint64)headerSize ||
+        file.write((const char*)img.constBits(), img.sizeInBytes()) != img.sizeInBytes())
+    {
+        file.cancelWriting();
+        return;
+    }
+
+    if (!file.commit())
+        return;
+
+    stores.ref();
+
+    QMutexLocker locker(&indexLock);
+    touch(key, headerSize + img.sizeInBytes());
+    evict();
+}
+
+quint32 TextureCache::bytesPerPixel(quint32 format)
+{
+    switch (format)
+    {
+        case QImage::Format_RGB888:
+            return 3;
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBA8888_Premultiplied:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// indexLock must be held
+void TextureCache::evict()
+{
+    QMap<quint64,QByteArray>::iterator it = useOrder.begin();
+    while (totalSize > maxSize && it != useOrder.end())
+    {
+        QString file = entryPath(it.value());
+
+        if (QFile::remove(file))
+            evictions.ref();
+        else if (QFile::exists(file))
+        {
+            // still mapped on some platforms, those just stay around
+            ++it;
+            continue;
+        }
+
+        totalSize -= entries.take(it.value()).size;
+        it = useOrder.erase(it);
+    }
+}
+
+void TextureCache::clear()
+{
+    QMutexLocker locker(&indexLock);
+
+    foreach (const QFileInfo& info, QDir(path).entryInfoList(QStringList() << "*.tex", QDir::Files))
+        QFile::remove(info.absoluteFilePath());
+
+    // whatever couldn't be removed is still there
+    entries.clear();
+    useOrder.clear();
+    totalSize = 0;
+    loadIndex();
+}
+
+TextureCache::Statistics TextureCache::getStatistics()
+{
+    Statistics stats;
+    stats.hits = hits.loadRelaxed();
+    stats.misses = misses.loadRelaxed();
+    stats.stores = stores.loadRelaxed();
+    stats.evictions = evictions.loadRelaxed();
+    stats.maxSize = maxSize;
+
+    QMutexLocker locker(&indexLock);
+    stats.entries = entries.size();
+    stats.diskSize = totalSize;
+
+    return stats;
+}
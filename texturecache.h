@@ -0,0 +1,84 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QImage>
+#include <QByteArray>
+#include <QString>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMap>
+
+// On-disk cache of decoded textures, in the user's cache directory.
+// Every entry is a small header followed by the raw pixels, so a hit just maps the file.
+// Entries are written to a temp file and renamed into place, readers never see half a file.
+// Files are touched on every hit and the least recently used ones go once the size cap is hit.
+// Sizes and use order are kept in memory, the directory is only listed once at startup.
+class TextureCache
+{
+public:
+    static TextureCache* init();
+    static TextureCache* getInstance();
+    ~TextureCache();
+
+    struct Statistics
+    {
+        int hits;
+        int misses;
+        int stores;
+        int evictions;
+        int entries;
+        qint64 diskSize;
+        qint64 maxSize;
+    };
+
+    // the encoded data, its layout and the premultiply setting all go into the key
+    static QByteArray makeKey(const QByteArray& texData, quint32 format, quint32 width, quint32 height, bool premultiply);
+
+    // null image on a miss, otherwise the image is backed by the mapped cache file
+    QImage load(const QByteArray& key);
+    void store(const QByteArray& key, const QImage& img);
+
+    void clear();
+    Statistics getStatistics();
+
+protected:
+    TextureCache();
+
+private:
+    static TextureCache* instance;
+
+    static constexpr quint32 version = 2;
+    static constexpr quint32 headerSize = 0x20;
+
+    QString path;
+    qint64 maxSize;
+
+    QAtomicInt hits;
+    QAtomicInt misses;
+    QAtomicInt stores;
+    QAtomicInt evictions;
+
+    struct Entry
+    {
+        qint64 size;
+        quint64 lastUse;
+    };
+
+    // guards everything below
+    QMutex indexLock;
+
+    QHash<QByteArray,Entry> entries;
+    QMap<quint64,QByteArray> useOrder; // oldest first
+    quint64 useCounter;
+    qint64 totalSize;
+
+    QString entryPath(const QByteArray& key);
+    // 0 for formats the decoders don't produce, those are never cached
+    static quint32 bytesPerPixel(quint32 format);
+    void loadIndex();
+    void touch(const QByteArray& key, qint64 size);
+    void evict();
+};
+
+#endif // TEXTURECACHE_H
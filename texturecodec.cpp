@@ -0,0 +1,353 @@
+#include "texturecodec.h"
+
+#include <QtEndian>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURECODEC_SSE2
+#endif
+
+const quint8 TextureCodec::mortonToLinear[64] =
+{
+     0,  1,  8,  9,  2,  3, 10, 11,
+    16, 17, 24, 25, 18, 19, 26, 27,
+     4,  5, 12, 13,  6,  7, 14, 15,
+    20, 21, 28, 29, 22, 23, 30, 31,
+    32, 33, 40, 41, 34, 35, 42, 43,
+    48, 49, 56, 57, 50, 51, 58, 59,
+    36, 37, 44, 45, 38, 39, 46, 47,
+    52, 53, 60, 61, 54, 55, 62, 63,
+};
+
+// n bit channel to 8 bits, the top bits get repeated into the bottom ones
+static inline quint32 expandBits(quint32 x, int bits)
+{
+    return (x << (8 - bits)) | (x >> (2*bits - 8));
+}
+
+// 8 bits to n bits, rounded
+static inline quint32 reduceBits(quint32 x, int bits)
+{
+    return (x * ((1 << bits) - 1) + 127) / 255;
+}
+
+static inline quint32 luminance(const quint8* rgba)
+{
+    return (rgba[0]*77 + rgba[1]*150 + rgba[2]*29 + 128) >> 8;
+}
+
+#ifdef TEXTURECODEC_SSE2
+// one channel of 8 packed 16 bit pixels, expanded to 8 bits in each 16 bit lane
+static inline __m128i channel16(__m128i v, int shift, int bits)
+{
+    __m128i x = _mm_and_si128(_mm_srl_epi16(v, _mm_cvtsi32_si128(shift)), _mm_set1_epi16((1 << bits) - 1));
+    return _mm_or_si128(_mm_sll_epi16(x, _mm_cvtsi32_si128(8 - bits)), _mm_srl_epi16(x, _mm_cvtsi32_si128(2*bits - 8)));
+}
+
+static inline void storeRgba(__m128i r, __m128i g, __m128i b, __m128i a, quint8* out)
+{
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(rg, ba));
+}
+#endif
+
+bool TextureCodec::isSupported(Ctpk::TextrueFormat format)
+{
+    return format >= Ctpk::RGBA8888 && format <= Ctpk::A4;
+}
+
+void TextureCodec::decodeSpan(Ctpk::TextrueFormat format, const quint8* src, quint32 count, quint8* rgba)
+{
+    quint32 i = 0;
+
+    switch (format)
+    {
+    case Ctpk::RGBA8888:
+        for (; i < count; i++, src += 4, rgba += 4)
+        {
+            rgba[0] = src[3];
+            rgba[1] = src[2];
+            rgba[2] = src[1];
+            rgba[3] = src[0];
+        }
+        break;
+
+    case Ctpk::RGB888:
+        for (; i < count; i++, src += 3, rgba += 4)
+        {
+            rgba[0] = src[2];
+            rgba[1] = src[1];
+            rgba[2] = src[0];
+            rgba[3] = 0xFF;
+        }
+        break;
+
+    case Ctpk::RGBA5551:
+#ifdef TEXTURECODEC_SSE2
+        for (; i + 8 <= count; i += 8, src += 16, rgba += 32)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            __m128i a = _mm_and_si128(_mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi16(1))), _mm_set1_epi16(0xFF));
+            storeRgba(channel16(v, 11, 5), channel16(v, 6, 5), channel16(v, 1, 5), a, rgba);
+        }
+#endif
+        for (; i < count; i++, src += 2, rgba += 4)
+        {
+            quint16 v = qFromLittleEndian<quint16>(src);
+            rgba[0] = expandBits((v >> 11) & 0x1F, 5);
+            rgba[1] = expandBits((v >> 6) & 0x1F, 5);
+            rgba[2] = expandBits((v >> 1) & 0x1F, 5);
+            rgba[3] = (v & 1) ? 0xFF : 0;
+        }
+        break;
+
+    case Ctpk::RGB565:
+#ifdef TEXTURECODEC_SSE2
+        for (; i + 8 <= count; i += 8, src += 16, rgba += 32)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            storeRgba(channel16(v, 11, 5), channel16(v, 5, 6), channel16(v, 0, 5), _mm_set1_epi16(0xFF), rgba);
+        }
+#endif
+        for (; i < count; i++, src += 2, rgba += 4)
+        {
+            quint16 v = qFromLittleEndian<quint16>(src);
+            rgba[0] = expandBits((v >> 11) & 0x1F, 5);
+            rgba[1] = expandBits((v >> 5) & 0x3F, 6);
+            rgba[2] = expandBits(v & 0x1F, 5);
+            rgba[3] = 0xFF;
+        }
+        break;
+
+    case Ctpk::RGBA4444:
+#ifdef TEXTURECODEC_SSE2
+        for (; i + 8 <= count; i += 8, src += 16, rgba += 32)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            storeRgba(channel16(v, 12, 4), channel16(v, 8, 4), channel16(v, 4, 4), channel16(v, 0, 4), rgba);
+        }
+#endif
+        for (; i < count; i++, src += 2, rgba += 4)
+        {
+            quint16 v = qFromLittleEndian<quint16>(src);
+            rgba[0] = expandBits((v >> 12) & 0xF, 4);
+            rgba[1] = expandBits((v >> 8) & 0xF, 4);
+            rgba[2] = expandBits((v >> 4) & 0xF, 4);
+            rgba[3] = expandBits(v & 0xF, 4);
+        }
+        break;
+
+    case Ctpk::LA88:
+        for (; i < count; i++, src += 2, rgba += 4)
+        {
+            rgba[0] = rgba[1] = rgba[2] = src[1];
+            rgba[3] = src[0];
+        }
+        break;
+
+    case Ctpk::HL8:
+        for (; i < count; i++, src += 2, rgba += 4)
+        {
+            rgba[0] = src[1];
+            rgba[1] = src[0];
+            rgba[2] = 0;
+            rgba[3] = 0xFF;
+        }
+        break;
+
+    case Ctpk::L8:
+        for (; i < count; i++, src++, rgba += 4)
+        {
+            rgba[0] = rgba[1] = rgba[2] = src[0];
+            rgba[3] = 0xFF;
+        }
+        break;
+
+    case Ctpk::A8:
+        for (; i < count; i++, src++, rgba += 4)
+        {
+            rgba[0] = rgba[1] = rgba[2] = 0xFF;
+            rgba[3] = src[0];
+        }
+        break;
+
+    case Ctpk::LA44:
+        for (; i < count; i++, src++, rgba += 4)
+        {
+            rgba[0] = rgba[1] = rgba[2] = expandBits(src[0] >> 4, 4);
+            rgba[3] = expandBits(src[0] & 0xF, 4);
+        }
+        break;
+
+    // 4 bit formats have the first pixel in the low nibble
+    case Ctpk::L4:
+        for (; i < count; i++, rgba += 4)
+        {
+            quint8 l = expandBits((src[i >> 1] >> ((i & 1) * 4)) & 0xF, 4);
+            rgba[0] = rgba[1] = rgba[2] = l;
+            rgba[3] = 0xFF;
+        }
+        break;
+
+    case Ctpk::A4:
+        for (; i < count; i++, rgba += 4)
+        {
+            rgba[0] = rgba[1] = rgba[2] = 0xFF;
+            rgba[3] = expandBits((src[i >> 1] >> ((i & 1) * 4)) & 0xF, 4);
+        }
+        break;
+
+    default:
+        throw std::runtime_error("CTPK: Unsupported Texture Format");
+    }
+}
+
+void TextureCodec::encodeSpan(Ctpk::TextrueFormat format, const quint8* rgba, quint32 count, quint8* dst)
+{
+    switch (format)
+    {
+    case Ctpk::RGBA8888:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 4)
+        {
+            dst[0] = rgba[3];
+            dst[1] = rgba[2];
+            dst[2] = rgba[1];
+            dst[3] = rgba[0];
+        }
+        break;
+
+    case Ctpk::RGB888:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 3)
+        {
+            dst[0] = rgba[2];
+            dst[1] = rgba[1];
+            dst[2] = rgba[0];
+        }
+        break;
+
+    case Ctpk::RGBA5551:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 2)
+            qToLittleEndian<quint16>((reduceBits(rgba[0], 5) << 11) | (reduceBits(rgba[1], 5) << 6) | (reduceBits(rgba[2], 5) << 1) | (rgba[3] >= 0x80 ? 1 : 0), dst);
+        break;
+
+    case Ctpk::RGB565:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 2)
+            qToLittleEndian<quint16>((reduceBits(rgba[0], 5) << 11) | (reduceBits(rgba[1], 6) << 5) | reduceBits(rgba[2], 5), dst);
+        break;
+
+    case Ctpk::RGBA4444:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 2)
+            qToLittleEndian<quint16>((reduceBits(rgba[0], 4) << 12) | (reduceBits(rgba[1], 4) << 8) | (reduceBits(rgba[2], 4) << 4) | reduceBits(rgba[3], 4), dst);
+        break;
+
+    case Ctpk::LA88:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 2)
+        {
+            dst[0] = rgba[3];
+            dst[1] = luminance(rgba);
+        }
+        break;
+
+    case Ctpk::HL8:
+        for (quint32 i = 0; i < count; i++, rgba += 4, dst += 2)
+        {
+            dst[0] = rgba[1];
+            dst[1] = rgba[0];
+        }
+        break;
+
+    case Ctpk::L8:
+        for (quint32 i = 0; i < count; i++, rgba += 4)
+            *dst++ = luminance(rgba);
+        break;
+
+    case Ctpk::A8:
+        for (quint32 i = 0; i < count; i++, rgba += 4)
+            *dst++ = rgba[3];
+        break;
+
+    case Ctpk::LA44:
+        for (quint32 i = 0; i < count; i++, rgba += 4)
+            *dst++ = (reduceBits(luminance(rgba), 4) << 4) | reduceBits(rgba[3], 4);
+        break;
+
+    case Ctpk::L4:
+        for (quint32 i = 0; i < count; i += 2, rgba += 8)
+            *dst++ = reduceBits(luminance(rgba), 4) | (reduceBits(luminance(rgba + 4), 4) << 4);
+        break;
+
+    case Ctpk::A4:
+        for (quint32 i = 0; i < count; i += 2, rgba += 8)
+            *dst++ = reduceBits(rgba[3], 4) | (reduceBits(rgba[7], 4) << 4);
+        break;
+
+    default:
+        throw std::runtime_error("CTPK: Unsupported Texture Format");
+    }
+}
+
+void TextureCodec::decode(Ctpk::TextrueFormat format, const quint8* src, quint32 width, quint32 height, QImage* dst)
+{
+    bool alpha = (dst->format() != QImage::Format_RGB888);
+    quint32 bpp = alpha ? 4 : 3;
+    quint32 tileBytes = 64 * Ctpk::bitsPerPixel(format) / 8;
+
+    quint8 tile[64*4];
+    quint8* rows[8];
+
+    for (quint32 y = 0; y < height; y += 8)
+    {
+        for (quint32 r = 0; r < 8; r++)
+            rows[r] = dst->scanLine(y + r);
+
+        for (quint32 x = 0; x < width; x += 8, src += tileBytes)
+        {
+            decodeSpan(format, src, 64, tile);
+
+            for (quint32 i = 0; i < 64; i++)
+            {
+                quint32 lin = mortonToLinear[i];
+                const quint8* col = tile + i*4;
+                quint8* out = rows[lin >> 3] + (x + (lin & 7)) * bpp;
+
+                out[0] = col[0];
+                out[1] = col[1];
+                out[2] = col[2];
+
+                if (alpha)
+                    out[3] = col[3];
+            }
+        }
+    }
+}
+
+QByteArray TextureCodec::encode(const QImage& img, Ctpk::TextrueFormat format)
+{
+    QImage src = img.convertToFormat(QImage::Format_RGBA8888);
+
+    quint32 tileBytes = 64 * Ctpk::bitsPerPixel(format) / 8;
+    QByteArray ret((src.width()/8) * (src.height()/8) * tileBytes, '\0');
+    quint8* dst = (quint8*)ret.data();
+
+    quint8 tile[64*4];
+
+    for (int y = 0; y < src.height(); y += 8)
+    {
+        for (int x = 0; x < src.width(); x += 8, dst += tileBytes)
+        {
+            for (quint32 i = 0; i < 64; i++)
+            {
+                quint32 lin = mortonToLinear[i];
+                const quint8* col = src.constScanLine(y + (lin >> 3)) + (x + (lin & 7)) * 4;
+                memcpy(tile + i*4, col, 4);
+            }
+
+            encodeSpan(format, tile, 64, dst);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,30 @@
+#ifndef TEXTURECODEC_H
+#define TEXTURECODEC_H
+
+#include "ctpk.h"
+
+#include <QImage>
+#include <QByteArray>
+
+// Decoders and encoders for the uncompressed CTPK formats.
+// Textures are made of 8x8 tiles in row order, the pixels of a tile are in morton order.
+class TextureCodec
+{
+public:
+    // morton index inside a tile -> y*8 + x
+    static const quint8 mortonToLinear[64];
+
+    static bool isSupported(Ctpk::TextrueFormat format);
+
+    // dst has to be width x height, RGBA8888 or RGB888, alpha comes out straight
+    static void decode(Ctpk::TextrueFormat format, const quint8* src, quint32 width, quint32 height, QImage* dst);
+
+    static QByteArray encode(const QImage& img, Ctpk::TextrueFormat format);
+
+private:
+    // one run of pixels to and from straight RGBA, count is a multiple of 8
+    static void decodeSpan(Ctpk::TextrueFormat format, const quint8* src, quint32 count, quint8* rgba);
+    static void encodeSpan(Ctpk::TextrueFormat format, const quint8* rgba, quint32 count, quint8* dst);
+};
+
+#endif // TEXTURECODEC_H
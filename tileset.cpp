@@ -18,18 +18,61 @@
 #include "tileset.h"
 #include "game.h"
 #include "imagecache.h"
+#include "settingsmanager.h"
+
+#include <QPromise>
+#include <QThreadPool>
+#include <memory>
 
 Tileset::Tileset(Game *game, QString name)
 {
     this->game = game;
     this->name = name;
+    objectsChanged();
 
     //qDebug("LOAD TILESET %s", name.toStdString().c_str());
 
-    archive = new SarcFilesystem(game->fs->openFile("/Unit/"+name+".sarc"));
-    ctpk = new Ctpk(archive->openFile("/BG_tex/"+name+".ctpk"));
+    FileBase* file = game->openArchiveFile("/Unit/"+name+".sarc");
+    archive = new SarcFilesystem(file);
+
+    LzFile* lzFile = dynamic_cast<LzFile*>(file);
+    archiveFormat = lzFile ? lzFile->getSaveFormat() : Lz11::None;
+    // the setting is read here, the decode below runs on a pool thread
+    bool premultiply = SettingsManager::getInstance()->get("premultiplyAlpha", true).toBool();
+    ctpk = new Ctpk(archive->openFile("/BG_tex/"+name+".ctpk"), premultiply);
+
+    // decoding can take a while, the course data gets parsed meanwhile
+    auto promise = std::make_shared<QPromise<QImage>>();
+    texFuture = promise->future();
+    promise->start();
+
+    // the encoded data is taken here, the task never touches the CTPK or the archive
+    // so saving or importing an image doesn't have to wait for it
+    Ctpk::EncodedLevel level;
+    bool levelOk = true;
+    try
+    {
+        level = ctpk->getEncodedLevel(0);
+    }
+    catch (const std::exception& e)
+    {
+        qDebug() << "tileset texture unusable:" << e.what();
+        levelOk = false;
+    }
 
-    texImage = ctpk->getTexture((quint32)0);
+    QThreadPool::globalInstance()->start(QRunnable::create([promise, level, levelOk]()
+    {
+        try
+        {
+            promise->addResult(levelOk ? Ctpk::decode(level) : QImage());
+        }
+        catch (const std::exception& e)
+        {
+            qDebug() << "tileset texture decode failed:" << e.what();
+            promise->addResult(QImage());
+        }
+        promise->finish();
+    }));
 
     if (name.startsWith("J_"))
         drawOverrides = true;
@@ -41,16 +84,22 @@ Tileset::Tileset(Game *game, QString name)
 
     FileBase* objdata = archive->openFile("/BG_unt/"+name+".bin");
     objdata->open();
+    objdata->seek(0);
+
+    FileBytes indexData = objindex->peek(objindex->size());
+    FileBytes objData = objdata->peek(objdata->size());
+    BinaryCursor<> indexIn(indexData);
+    BinaryCursor<> dataIn(objData);
 
     int numObjects = objindex->size() / 6;
 
     for (int o = 0; o < numObjects; o++)
     {
-        quint16 offset = objindex->read16();
-        quint8 width = objindex->read8();
-        quint8 height = objindex->read8();
-        quint8 randomisation = objindex->read8();
-        quint8 crap = objindex->read8();
+        quint16 offset = indexIn.read16();
+        quint8 width = indexIn.read8();
+        quint8 height = indexIn.read8();
+        quint8 randomisation = indexIn.read8();
+        quint8 crap = indexIn.read8();
 
         //qDebug("OBJECT %d -- %04X %dx%d %02X %02X", o, offset, width, height, crap1, crap2);
 
@@ -80,7 +129,7 @@ Tileset::Tileset(Game *game, QString name)
         // 04 -> slope thing (used for slope second row)
 
         quint8 b;
-        objdata->seek(offset);
+        dataIn.seek(offset);
 
         int curx = 0, cury = 0;
 
@@ -93,7 +142,7 @@ Tileset::Tileset(Game *game, QString name)
 
         for (;;)
         {
-            b = objdata->read8();
+            b = dataIn.atEnd() ? 0xFF : dataIn.read8();
             if (b == 0xFF) // end
             {
                 delete row;
@@ -122,7 +171,7 @@ Tileset::Tileset(Game *game, QString name)
                     obj->slopeY = cury;
 
                 row->slopeFlags = b;
-                b = objdata->read8();
+                b = dataIn.read8();
             }
 
 
@@ -173,10 +222,10 @@ Tileset::Tileset(Game *game, QString name)
 
             row->data.append(b); // repeat/etc flags
 
-            b = objdata->read8();
+            b = dataIn.read8();
             row->data.append(b); // tile #
 
-            b = objdata->read8(); // item (0XXX X000) / slot (0000 0XX0)
+            b = dataIn.read8(); // item (0XXX X000) / slot (0000 0XX0)
             row->data.append(b);
 
             curx++;
@@ -198,11 +247,7 @@ Tileset::Tileset(Game *game, QString name)
     FileBase* behaviorsFile = archive->openFile("BG_chk/d_bgchk_" + name + ".bin");
     behaviorsFile->open();
     behaviorsFile->seek(0);
-    for (int i = 0; i < 441; i++) // TODO ensure the file has the right size!
-    {
-        for (int j = 0; j < 8; j++)
-            behaviors[i][j] = behaviorsFile->read8();
-    }
+    behaviorsFile->readData(&behaviors[0][0], sizeof(behaviors)); // TODO ensure the file has the right size!
     behaviorsFile->close();
     delete behaviorsFile;
 
@@ -212,9 +257,11 @@ Tileset::Tileset(Game *game, QString name)
         FileBase* overlaysFile = archive->openFile("BG_unt/" + name + "_add.bin");
         overlaysFile->open();
         overlaysFile->seek(0);
+        FileBytes overlaysData = overlaysFile->peek(441*2);
+        BinaryCursor<> overlaysIn(overlaysData);
         for (int i = 0; i < 441; i++) // TODO ensure the file has the right size!
         {
-            overlays3D[i] = overlaysFile->read16();
+            overlays3D[i] = overlaysIn.read16();
         }
         overlaysFile->close();
         delete overlaysFile;
@@ -223,20 +270,81 @@ Tileset::Tileset(Game *game, QString name)
 
 Tileset::~Tileset()
 {
+    texFuture.waitForFinished();
     delete ctpk;
     delete archive;
+    delete archiveWriter;
     qDeleteAll(objectDefs);
 }
 
+AsyncArchiveWriter* Tileset::getArchiveWriter()
+{
+    if (!archiveWriter)
+    {
+        archiveWriter = new AsyncArchiveWriter(game->getPath() + "/Unit/" + name + ".sarc");
+        archiveWriter->setCompression(archiveFormat);
+        archive->setAsyncWriter(archiveWriter);
+    }
+
+    return archiveWriter;
+}
+
 
 // x and y in tile coords
+void Tileset::drawAtlasTile(QPainter& painter, const QRectF& dst, const QRectF& src)
+{
+    if (batching)
+        batchTiles.append(QPainter::PixmapFragment::create(dst.center(), src, dst.width() / src.width(), dst.height() / src.height()));
+    else
+        painter.drawPixmap(dst, getAtlas(drawLod), src);
+}
+
+void Tileset::drawIcon(QPainter& painter, const QRect& dst, const QPixmap& icon)
+{
+    // icons go on top of the tile below them, so they have to wait for the batched tiles
+    if (batching)
+        batchIcons.append(qMakePair(dst, icon));
+    else
+        painter.drawPixmap(dst, icon);
+}
+
+void Tileset::beginBatch()
+{
+    batchTiles.clear();
+    batchIcons.clear();
+    batching = true;
+}
+
+void Tileset::drawBatch(QPainter& painter)
+{
+    batching = false;
+
+    // tiles of one layer never overlap, so the order within the batch doesn't matter
+    if (!batchTiles.isEmpty())
+        painter.drawPixmapFragments(batchTiles.constData(), batchTiles.size(), getAtlas(drawLod));
+
+    typedef QPair<QRect, QPixmap> BatchIcon;
+    foreach (const BatchIcon& icon, batchIcons)
+        painter.drawPixmap(icon.first, icon.second);
+
+    batchTiles.clear();
+    batchIcons.clear();
+}
+
 void Tileset::drawTile(QPainter& painter, TileGrid& grid, int num, int x, int y, float zoom, int item)
 {
     quint32 gridid = x | (y<<16);
     if (grid[gridid] == grid[0xFFFFFFFF])
         return;
 
+    grid[gridid] = grid[0xFFFFFFFF];
+    drawTile(painter, num, x, y, zoom, item);
+}
+
+void Tileset::drawTile(QPainter& painter, int num, int x, int y, float zoom, int item)
+{
     int tsize = (int)(20*zoom);
+    bool oddTile = (x + y) & 1;
     x *= tsize;
     y *= tsize;
 
@@ -247,46 +355,57 @@ void Tileset::drawTile(QPainter& painter, TileGrid& grid, int num, int x, int y,
         int xx = num % 21;
         int yy = num / 21;
 
-        if (xx == 15 && yy == 0) { painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverride, "coin.png")); return; }
-        if (xx == 16 && yy == 0) { painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverride, "blue_coin.png")); return; }
-        if (xx == 10 && yy == 3) { painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverride, "vine.png")); return; }
-        if (xx == 11 && yy == 0) { painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverride, "solid.png")); return; }
+        if (xx == 15 && yy == 0) { drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverride, "coin.png")); return; }
+        if (xx == 16 && yy == 0) { drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverride, "blue_coin.png")); return; }
+        if (xx == 10 && yy == 3) { drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverride, "vine.png")); return; }
+        if (xx == 11 && yy == 0) { drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverride, "solid.png")); return; }
     }
 
+    // still decoding, draw something cheap and let the view repaint later
+    if (!isImageReady())
+    {
+        if (draw2D)
+            painter.fillRect(rdst, oddTile ? QColor(128,128,128,96) : QColor(160,160,160,96));
+
+        return;
+    }
+
+    int tileSize = AtlasKernels::tileSize(drawLod);
+    int border = AtlasKernels::borderSize(drawLod);
+    int cell = AtlasKernels::cellSize(drawLod);
+
     if (draw2D)
     {
-        QRect rsrc(2 + ((num%21)*24), 2 + ((num/21)*24), 20, 20);
-        painter.drawImage(rdst, texImage, rsrc);
+        QRectF rsrc(border + (num%21)*cell, border + (num/21)*cell, tileSize, tileSize);
+        drawAtlasTile(painter, rdst, rsrc);
     }
 
     if (draw3D && (getOverlayTile(num) !=0))
     {
-        QRect overlaysrc(2 + ((getOverlayTile(num)%21)*24), 2 + ((getOverlayTile(num)/21)*24), 20, 20);
-        painter.drawImage(rdst, texImage, overlaysrc);
+        QRectF overlaysrc(border + (getOverlayTile(num)%21)*cell, border + (getOverlayTile(num)/21)*cell, tileSize, tileSize);
+        drawAtlasTile(painter, rdst, overlaysrc);
     }
 
-    grid[gridid] = grid[0xFFFFFFFF];
-
     // Draw Overlays
     if (behaviors[num][0] == 0 && behaviors[num][2] == 1) // Beanstalk Stopper
-        painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk_stopper.png"));
+        drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk_stopper.png"));
 
     if (behaviors[num][0] == 6) // Brick Block
     {
         switch (item)
         {
-            case 1: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "coin.png")); break;
-            case 2: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "10_coins.png")); break;
-            case 3: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower.png")); break;
-            case 4: case 9: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_star.png")); break;
-            case 5: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom.png")); break;
-            case 6: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk.png")); break;
-            case 7: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom.png")); break;
-            case 8: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "coin_super_mushroom.png")); break;
-            case 10: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf.png")); break;
-            case 11: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "trampoline.png")); break;
-            case 12: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower.png")); break;
-            case 13: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "pow_coin.png")); break;
+            case 1: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "coin.png")); break;
+            case 2: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "10_coins.png")); break;
+            case 3: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower.png")); break;
+            case 4: case 9: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_star.png")); break;
+            case 5: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom.png")); break;
+            case 6: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk.png")); break;
+            case 7: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom.png")); break;
+            case 8: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "coin_super_mushroom.png")); break;
+            case 10: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf.png")); break;
+            case 11: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "trampoline.png")); break;
+            case 12: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower.png")); break;
+            case 13: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "pow_coin.png")); break;
             default: break;
         }
     }
@@ -294,17 +413,17 @@ void Tileset::drawTile(QPainter& painter, TileGrid& grid, int num, int x, int y,
     {
         switch (item)
         {
-            case 0: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "coin.png")); break;
-            case 1: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower.png")); break;
-            case 2: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_star.png")); break;
-            case 3: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom.png")); break;
-            case 4: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk.png")); break;
-            case 5: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "trampoline.png")); break;
-            case 6: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom.png")); break;
-            case 7: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "coin_super_mushroom.png")); break;
-            case 8: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "mega_mushroom.png")); break;
-            case 9: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf.png")); break;
-            case 10: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower.png")); break;
+            case 0: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "coin.png")); break;
+            case 1: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower.png")); break;
+            case 2: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_star.png")); break;
+            case 3: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom.png")); break;
+            case 4: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk.png")); break;
+            case 5: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "trampoline.png")); break;
+            case 6: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom.png")); break;
+            case 7: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "coin_super_mushroom.png")); break;
+            case 8: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "mega_mushroom.png")); break;
+            case 9: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf.png")); break;
+            case 10: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower.png")); break;
             default: break;
         }
     }
@@ -312,20 +431,20 @@ void Tileset::drawTile(QPainter& painter, TileGrid& grid, int num, int x, int y,
     {
         switch (behaviors[num][2])
         {
-            case 0: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower_invisible.png")); break;
-            case 1: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_star_invisible.png")); break;
-            case 2: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "coin_invisible.png")); break;
-            case 3: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk_invisible.png")); break;
-            case 4: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom_invisible.png")); break;
-            case 5: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom_invisible.png")); break;
-            case 6: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf_invisible.png")); break;
-            case 7: painter.drawPixmap(rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower_invisible.png")); break;
+            case 0: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "fire_flower_invisible.png")); break;
+            case 1: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_star_invisible.png")); break;
+            case 2: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "coin_invisible.png")); break;
+            case 3: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "beanstalk_invisible.png")); break;
+            case 4: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "1up_mushroom_invisible.png")); break;
+            case 5: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "mini_mushroom_invisible.png")); break;
+            case 6: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "super_leaf_invisible.png")); break;
+            case 7: drawIcon(painter, rdst, ImageCache::getInstance()->get(TileOverlay, "gold_flower_invisible.png")); break;
             default: break;
         }
     }
 }
 
-void Tileset::drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectRow& row, int x, int y, int w, float zoom)
+void Tileset::expandRow(ObjectDef& def, ObjectRow& row, int x, int y, int w, const TileVisitor& visit)
 {
     int sx = 0, dx = 0;
     int end = row.data.length()/3;
@@ -340,7 +459,7 @@ void Tileset::drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectR
         while (dx < rstart)
         {
             if (row.data[sx*3 + 1] || (row.data[sx*3 + 2] & 6) >> 1) // Lame work arround
-                drawTile(painter, grid, row.data[sx*3 + 1], x+dx, y, zoom, (row.data[sx*3 + 2] & 120) >> 3);
+                visit(x+dx, y, row.data[sx*3 + 1], (row.data[sx*3 + 2] & 120) >> 3);
 
             dx++;
             sx++;
@@ -352,7 +471,7 @@ void Tileset::drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectR
         while (dx < rend)
         {
             if (row.data[sx*3 + 1] || (row.data[sx*3 + 2] & 6) >> 1) // Lame work arround
-                drawTile(painter, grid, row.data[sx*3 + 1], x+dx, y, zoom, (row.data[sx*3 + 2] & 120) >> 3);
+                visit(x+dx, y, row.data[sx*3 + 1], (row.data[sx*3 + 2] & 120) >> 3);
 
             dx++;
             sx++;
@@ -364,7 +483,7 @@ void Tileset::drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectR
         while (dx < w)
         {
             if (row.data[sx*3 + 1] || (row.data[sx*3 + 2] & 6) >> 1) // Lame work arround
-                drawTile(painter, grid, row.data[sx*3 + 1], x+dx, y, zoom, (row.data[sx*3 + 2] & 120) >> 3);
+                visit(x+dx, y, row.data[sx*3 + 1], (row.data[sx*3 + 2] & 120) >> 3);
 
             dx++;
             sx++;
@@ -380,7 +499,7 @@ void Tileset::drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectR
         while (dx < w)
         {
             if (row.data[sx*3 + 1] || (row.data[sx*3 + 2] & 6) >> 1) // Lame work arround
-                drawTile(painter, grid, row.data[sx*3 + 1], x+dx, y, zoom, (row.data[sx*3 + 2] & 120) >> 3);
+                visit(x+dx, y, row.data[sx*3 + 1], (row.data[sx*3 + 2] & 120) >> 3);
 
             dx++;
             sx++;
@@ -401,6 +520,17 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
         return;
     }
 
+    expandObject(num, x, y, w, h, [&](int tx, int ty, int tile, int item)
+    {
+        drawTile(painter, grid, tile, tx, ty, zoom, item);
+    });
+}
+
+void Tileset::expandObject(int num, int x, int y, int w, int h, const TileVisitor& visit)
+{
+    if (num >= objectDefs.size())
+        return;
+
     ObjectDef& def = *objectDefs[num];
 
     //qDebug("RENDER OBJ %d | %d %d | %d,%d %d,%d\n", num, def.rows.length(), 4646445, x, y, w, h);
@@ -446,7 +576,7 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
                 if (tiley < 0 || tiley >= h)
                     break;
 
-                drawRow(painter, grid, def, row, x+curx, y+tiley, def.width, zoom);
+                expandRow(def, row, x+curx, y+tiley, def.width, visit);
             }
 
             curx += def.width;
@@ -470,7 +600,7 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
         while (dy < rstart)
         {
             ObjectRow& row = def.rows[sy];
-            drawRow(painter, grid, def, row, x, y+dy, w, zoom);
+            expandRow(def, row, x, y+dy, w, visit);
 
             dy++;
             sy++;
@@ -482,7 +612,7 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
         while (dy < rend)
         {
             ObjectRow& row = def.rows[sy];
-            drawRow(painter, grid, def, row, x, y+dy, w, zoom);
+            expandRow(def, row, x, y+dy, w, visit);
 
             dy++;
             sy++;
@@ -494,7 +624,7 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
         while (dy < h)
         {
             ObjectRow& row = def.rows[sy];
-            drawRow(painter, grid, def, row, x, y+dy, w, zoom);
+            expandRow(def, row, x, y+dy, w, visit);
 
             dy++;
             sy++;
@@ -510,7 +640,7 @@ void Tileset::drawObject(QPainter& painter, TileGrid& grid, int num, int x, int
         while (dy < h)
         {
             ObjectRow& row = def.rows[sy];
-            drawRow(painter, grid, def, row, x, y+dy, w, zoom);
+            expandRow(def, row, x, y+dy, w, visit);
 
             dy++;
             sy++;
@@ -537,33 +667,172 @@ quint8 Tileset::getData(int objNbr, int x, int y, int byte)
     return def.rows[y].data[x*3 + byte];
 }
 
+void Tileset::objectsChanged()
+{
+    static quint64 lastRevision = 0;
+    objectRevision = ++lastRevision;
+}
+
 void Tileset::setData(int objNbr, int x, int y, int byte, int value)
 {
+    objectsChanged();
     objectDefs[objNbr]->rows[y].data[x*3 + byte] = value;
 }
 
-QImage& Tileset::getImage()
+void Tileset::waitForImage()
+{
+    if (imageLoaded)
+        return;
+
+    texImage = texFuture.result();
+    imageLoaded = true;
+}
+
+void Tileset::whenImageReady(QObject* context, std::function<void()> callback)
+{
+    if (isImageReady())
+        return;
+
+    texFuture.then(context, [callback](const QImage&) { callback(); });
+}
+
+QImage& Tileset::getImage(int lod)
+{
+    waitForImage();
+
+    lod = qBound(0, lod, maxLod);
+    if (lod == 0)
+        return texImage;
+
+    // mip levels from the CTPK are used as they are, missing ones get filtered down from the previous level
+    while (mipImages.size() < lod)
+    {
+        int level = mipImages.size() + 1;
+
+        QImage mip;
+        if ((quint32)level < ctpk->getMipCount(0))
+        {
+            try
+            {
+                mip = ctpk->getTexture((quint32)0, level);
+            }
+            catch (const std::exception& e)
+            {
+                qDebug() << "tileset mip level" << level << "unusable:" << e.what();
+            }
+        }
+
+        if (mip.isNull())
+        {
+            const QImage& prev = (level == 1) ? texImage : mipImages.last();
+            mip = prev.scaled(prev.width() / 2, prev.height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+
+        mipImages.append(mip);
+    }
+
+    return mipImages[lod - 1];
+}
+
+const QPixmap& Tileset::getAtlas(int lod)
 {
-    return texImage;
+    lod = qBound(0, lod, maxLod);
+
+    if (atlasPixmaps.isEmpty())
+        atlasPixmaps.resize(maxLod + 1);
+
+    // QPixmap picks the format the paint engine draws fastest, converting once here instead of per tile
+    // lod 1 still has a whole border pixel around every tile, further down the halved texture
+    // mixes neighbouring tiles, so those are scaled down tile by tile
+    if (atlasPixmaps[lod].isNull())
+        atlasPixmaps[lod] = QPixmap::fromImage(lod <= 1 ? getImage(lod) : AtlasKernels::downscale(getImage(), lod));
+
+    return atlasPixmaps[lod];
+}
+
+int Tileset::lodForZoom(float zoom)
+{
+    int lod = 0;
+    while (lod < maxLod && zoom <= 0.5f / (1 << lod))
+        lod++;
+    return lod;
 }
 
 void Tileset::setImage(QImage &img, uint quality, bool dither)
 {
-    ctpk->setTextureEtc1(0, img, true, quality, dither);
+    waitForImage();
+    Etc1Encoder* encoder = createImageEncoder(img, quality, dither);
+    encoder->encode();
+    setEncodedImage(encoder);
+    delete encoder;
+}
+
+void Tileset::setEncodedImage(Etc1Encoder* encoder)
+{
+    waitForImage();
+
+    const QImage& source = encoder->getSource();
+    Ctpk::TextrueFormat format = encoder->hasAlpha() ? Ctpk::ETC1_A4 : Ctpk::ETC1;
+
+    // the same mip chain the texture had, the encoder only did the full size level
+    quint8 mipCount = Ctpk::clampMipCount(source.width(), source.height(), ctpk->getMipCount(0));
+    QByteArray data = encoder->result();
+    if (mipCount > 1)
+    {
+        QImage half = source.scaled(source.width() / 2, source.height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        data.append(Ctpk::encodeTexture(half, format, mipCount - 1, encoder->getQuality(), encoder->getDither()));
+    }
+
+    // rebuilds the CTPK if the old texture had a different layout
+    ctpk->setTextureData(0, format, source.width(), source.height(), mipCount, data);
     texImage = ctpk->getTexture((quint32)0);
+    mipImages.clear();
+    atlasPixmaps.clear();
+    encodedSource = source;
 }
 
-void Tileset::save()
+Etc1Encoder* Tileset::createImageEncoder(const QImage& img, uint quality, bool dither, QObject* parent)
 {
+    waitForImage();
+
+    Ctpk::TextrueFormat format = ctpk->getTextureFormat(0);
+    Etc1Encoder* encoder = new Etc1Encoder(img, format != Ctpk::ETC1, quality, dither, parent);
+
+    // without the last source, blocks that decode to exactly the new pixels can still be kept
+    // only the full size level is reused, setEncodedImage() redoes the smaller ones
+    if ((format == Ctpk::ETC1 || format == Ctpk::ETC1_A4) && texImage.size() == img.size())
+    {
+        Ctpk::EncodedLevel level = ctpk->getEncodedLevel(0);
+
+        // compared against the straight source, so it has to be straight too
+        // texImage may be premultiplied, and unpremultiplying it again doesn't give back the same pixels
+        QImage reference = encodedSource;
+        if (reference.isNull())
+        {
+            if (texImage.format() == QImage::Format_RGBA8888_Premultiplied)
+            {
+                level.premultiply = false;
+                reference = Ctpk::decode(level);
+            }
+            else
+                reference = texImage;
+        }
+
+        encoder->setReference(reference, level.data.toByteArray());
+    }
+
+    return encoder;
+}
+
+bool Tileset::save()
+{
+    FilesystemTransaction transaction(archive);
+
     // Save Behaviors
     FileBase* behaviorsFile = archive->openFile("BG_chk/d_bgchk_" + name + ".bin");
     behaviorsFile->open();
     behaviorsFile->seek(0);
-    for (int i = 0; i < 441; i++)
-    {
-        for (int j = 0; j < 8; j++)
-            behaviorsFile->write8(behaviors[i][j]);
-    }
+    behaviorsFile->writeData(&behaviors[0][0], sizeof(behaviors));
     behaviorsFile->save();
     behaviorsFile->close();
     delete behaviorsFile;
@@ -573,12 +842,13 @@ void Tileset::save()
     if (archive->fileExists("BG_unt/" + name + "_add.bin"))
     {
         FileBase* overlaysFile = archive->openFile("BG_unt/" + name + "_add.bin");
+        BinaryWriter<> out(441*2);
+        for (int i = 0; i < 441; i++)
+            out.write16(overlays3D[i]);
+
         overlaysFile->open();
         overlaysFile->seek(0);
-        for (int i = 0; i < 441; i++)
-        {
-            overlaysFile->write16(overlays3D[i]);
-        }
+        overlaysFile->writeBlock(out.block());
         overlaysFile->save();
         overlaysFile->close();
         delete overlaysFile;
@@ -586,53 +856,42 @@ void Tileset::save()
 
 
     // Save Object Def
-    FileBase* objindex = archive->openFile("/BG_unt/"+name+"_hd.bin");
-    objindex->open();
-    objindex->seek(0);
-
-    FileBase* objdata = archive->openFile("/BG_unt/"+name+".bin");
-    objdata->open();
-    objdata->seek(0);
-
-    // Calc new File Sizes
-    objindex->resize(6 * objectDefs.size());
-
-    quint64 dataSize = 0;
-    for (int o = 0; o < objectDefs.size(); o++)
-    {
-        for (int r = 0; r < objectDefs[o]->rows.size(); r++)
-        {
-            if (objectDefs[o]->rows[r].slopeFlags != 0)
-                dataSize++;
-            dataSize += objectDefs[o]->rows[r].data.size();
-            dataSize++; // 0xEF
-        }
-        dataSize++; // 0xFF
-    }
-
-    objdata->resize(dataSize);
+    BinaryWriter<> indexOut(6 * objectDefs.size());
+    BinaryWriter<> dataOut;
 
     for (int o = 0; o < objectDefs.size(); o++)
     {
         ObjectDef& obj = *objectDefs[o];
 
-        objindex->write16((quint16)objdata->pos());
-        objindex->write8(obj.width);
-        objindex->write8(obj.height);
-        objindex->write8(obj.randomisation);
-        objindex->write8(obj.unkFlag);
+        indexOut.write16((quint16)dataOut.pos());
+        indexOut.write8(obj.width);
+        indexOut.write8(obj.height);
+        indexOut.write8(obj.randomisation);
+        indexOut.write8(obj.unkFlag);
 
         for (int r = 0; r < obj.rows.size(); r++)
         {
             if (obj.rows[r].slopeFlags != 0)
-                objdata->write8(obj.rows[r].slopeFlags);
+                dataOut.write8(obj.rows[r].slopeFlags);
             for (int d = 0; d < obj.rows[r].data.size(); d++)
-                objdata->write8(obj.rows[r].data[d]);
-            objdata->write8(0xFE);
+                dataOut.write8(obj.rows[r].data[d]);
+            dataOut.write8(0xFE);
         }
-        objdata->write8(0xFF);
+        dataOut.write8(0xFF);
     }
 
+    FileBase* objindex = archive->openFile("/BG_unt/"+name+"_hd.bin");
+    objindex->open();
+    objindex->resize(indexOut.size());
+    objindex->seek(0);
+    objindex->writeBlock(indexOut.block());
+
+    FileBase* objdata = archive->openFile("/BG_unt/"+name+".bin");
+    objdata->open();
+    objdata->resize(dataOut.size());
+    objdata->seek(0);
+    objdata->writeBlock(dataOut.block());
+
     objindex->save();
     objdata->save();
 
@@ -641,10 +900,13 @@ void Tileset::save()
 
     delete objindex;
     delete objdata;
+
+    return transaction.commit();
 }
 
 void Tileset::addObject(int objNbr)
 {
+    objectsChanged();
     // Create an empty object
     ObjectDef* obj = new ObjectDef();
     obj->width = 1;
@@ -667,11 +929,13 @@ void Tileset::addObject(int objNbr)
 
 void Tileset::removeObject(int objNbr)
 {
+    objectsChanged();
     objectDefs.removeAt(objNbr);
 }
 
 void Tileset::moveObjectDown(int objNbr)
 {
+    objectsChanged();
     if (objNbr < objectDefs.size())
         objectDefs.move(objNbr, objNbr+1);
 }
@@ -679,12 +943,14 @@ void Tileset::moveObjectDown(int objNbr)
 
 void Tileset::moveObjectUp(int objNbr)
 {
+    objectsChanged();
     if (objNbr > 0)
         objectDefs.move(objNbr, objNbr-1);
 }
 
 void Tileset::resizeObject(int objNbr, int width, int height)
 {
+    objectsChanged();
     ObjectDef& obj = *objectDefs[objNbr];
 
     if (width != -1)
@@ -745,6 +1011,7 @@ void Tileset::resizeObject(int objNbr, int width, int height)
 
 void Tileset::setSlot(int slot)
 {
+    objectsChanged();
     this->slot = slot;
 
     for (int o = 0; o < objectDefs.size(); o++)
@@ -807,6 +1074,7 @@ void Tileset::setRandomizeTiles(int tile, quint8 value)
 
 void Tileset::setObjectBehavior(int selObj, int type, int hStart, int hEnd, int vStart, int vEnd)
 {
+    objectsChanged();
     // Types
     //  0: Tile
     //  1: Repeat Horizontally
@@ -873,66 +1141,10 @@ void Tileset::setObjectBehavior(int selObj, int type, int hStart, int hEnd, int
 }
 
 
-void Tileset::replaceCTPK(QString filename)
-{
-    QFile newCtpk(filename);
-
-    if(!newCtpk.open(QIODevice::ReadOnly))
-        return;
-
-    newCtpk.seek(0);
-    char* data = new char[newCtpk.size()];
-    newCtpk.read(data, newCtpk.size());
-    newCtpk.close();
-
-    delete ctpk;
-
-    FileBase* texFile = archive->openFile("/BG_tex/"+name+".ctpk");
-    texFile->open();
-    texFile->resize(newCtpk.size());
-    texFile->seek(0);
-    texFile->writeData((quint8*)data, texFile->size());
-    texFile->save();
-    texFile->close();
-
-    ctpk = new Ctpk(archive->openFile("/BG_tex/"+name+".ctpk"));
-
-    texImage = ctpk->getTexture(name + ".tga");
-}
-
 void Tileset::setInternalName(QString newName)
 {
     qDebug() << "setting filename";
 
+    waitForImage();
     ctpk->setFilename(name + ".tga");
 }
-
-QImage Tileset::padTilesetImage(const QImage& img, quint32 outWidth, quint32 outHeight)
-{
-    QImage ret(outWidth, outHeight, QImage::Format_RGBA8888);
-    ret.fill(Qt::transparent);
-
-    QPainter painter(&ret);
-
-    quint32 tilew = img.width() / 20;
-    quint32 tileh = img.height() / 20;
-    quint32 tilenum = tilew * tileh;
-
-    for (quint32 i = 0; i < tilenum; i++)
-    {
-        // Margins
-        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 2, 20), img.copy(i%tilew*20, i/tilew*20, 1, 20));               // Left
-        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 2, 20), img.copy(19 + i%tilew*20, i/tilew*20, 1, 20));     // Right
-        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 20, 2), img.copy(i%tilew*20, i/tilew*20, 20, 1));               // Top
-        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 20, 2), img.copy(i%tilew*20, 19 + i/tilew*20, 20, 1));     // Bottom
-        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 2, 2), img.copy(i%tilew*20, i/tilew*20, 1, 1));                     // Top-Left
-        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, i/tilew*20 + i/tilew*4, 2, 2), img.copy(19 + i%tilew*20, i/tilew*20, 1, 1));           // Top-Right
-        painter.drawImage(QRect(i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 2, 2), img.copy(i%tilew*20, 19 + i/tilew*20, 1, 1));           // Bottom-Left
-        painter.drawImage(QRect(22 + i%tilew*20 + i%tilew*4, 22 + i/tilew*20 + i/tilew*4, 2, 2), img.copy(19 + i%tilew*20, 19 + i/tilew*20, 1, 1)); // Bottom-Right
-
-        // Core Tiles
-        painter.drawImage(QRect(2 + i%tilew*20 + i%tilew*4, 2 + i/tilew*20 + i/tilew*4, 20, 20), img.copy(i%tilew*20, i/tilew*20, 20, 20));
-    }
-
-    return ret;
-}
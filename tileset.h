@@ -20,12 +20,20 @@
 
 #include "filesystem/filesystem.h"
 #include "ctpk.h"
+#include "etc1encoder.h"
+#include "atlaskernels.h"
 
 #include <QPainter>
+#include <QPixmap>
 #include <QList>
+#include <QFuture>
+#include <functional>
 
 typedef QHash<quint32,quint8> TileGrid;
 
+// x, y, tile number and item of one tile an object puts down
+typedef std::function<void(int x, int y, int tile, int item)> TileVisitor;
+
 class Game;
 
 struct ObjectRow
@@ -58,12 +66,19 @@ public:
     QString getName() const { return name; }
     int getSlot() { return slot; }
 
+    // grid keeps track of occupied tiles, the first tile drawn to a spot wins
     void drawTile(QPainter& painter, TileGrid& grid, int num, int x, int y, float zoom, int item);
+    void drawTile(QPainter& painter, int num, int x, int y, float zoom, int item);
     void drawObject(QPainter& painter, TileGrid& grid, int num, int x, int y, int w, int h, float zoom);
+
+    // the tiles of an object in drawing order, without drawing anything, unknown objects give none
+    void expandObject(int num, int x, int y, int w, int h, const TileVisitor& visit);
     quint8 getBehaviorByte(int tile, int byte);
     void setBehaviorByte(int tile, int byte, quint8 value);
 
     int getNumObjects() { return objectDefs.size(); }
+    // changes with every edit to the object definitions, no two tilesets ever share a value
+    quint64 getObjectRevision() const { return objectRevision; }
     ObjectDef* getObjectDef(int i) { return objectDefs[i]; }
     quint8 getData(int objNbr, int x, int y, int byte);
     void setData(int objNbr, int x, int y, int byte, int value);
@@ -90,32 +105,82 @@ public:
     void Render2DTiles(bool toggle) { draw2D = toggle; }
     void Render3DOverlay(bool toggle) { draw3D = toggle; }
 
+    // tiles are drawn from a smaller mip level when zoomed out, 0 is full size
+    void setDrawLod(int lod) { drawLod = qBound(0, lod, maxLod); }
+    static int lodForZoom(float zoom);
+
+    // between these, tiles are collected and then drawn with one drawPixmapFragments() call
+    // the tiles of a batch must not overlap, like the tiles of one layer
+    void beginBatch();
+    void drawBatch(QPainter& painter);
+
     Game* game;
 
-    QImage& getImage();
+    // lod 0 is the full size image, every further level is half the size
+    // waits for the background decode if it isn't done yet
+    QImage& getImage(int lod = 0);
+
+    // the texture is decoded on a worker thread, tiles are drawn as placeholders until then
+    bool isImageReady() { return imageLoaded || texFuture.isFinished(); }
+    // callback runs in the thread of context once the texture is decoded, never if it already is
+    void whenImageReady(QObject* context, std::function<void()> callback);
     void setImage(QImage& img, uint quality = 1, bool dither = false);
+    // takes the result of a finished encoder from createImageEncoder(), the smaller mip levels get encoded here
+    void setEncodedImage(Etc1Encoder* encoder);
+
+    // the encoder only re-encodes blocks that differ from the current image
+    // it keeps the format of the texture, anything that isn't ETC1 becomes ETC1A4
+    Etc1Encoder* createImageEncoder(const QImage& img, uint quality = 1, bool dither = false, QObject* parent = nullptr);
 
-    void save();
+    bool save(); // false if the archive rolled the changes back
 
-    // temp function
-    void replaceCTPK(QString filename);
+    // created on first use, saves from then on are written in the background
+    AsyncArchiveWriter* getArchiveWriter();
 
-    static QImage padTilesetImage(const QImage& img, quint32 outWidth = 512, quint32 outHeight = 512);
+    // the atlas stores every 20x20 tile with a 2 pixel border repeating its edge pixels
+    static QImage padTilesetImage(const QImage& img) { return AtlasKernels::pad(img); }
+    static QImage unpadTilesetImage(const QImage& img) { return AtlasKernels::unpad(img); }
 
 private:
     QString name;
     bool drawOverrides = false;
     int slot;
     SarcFilesystem* archive;
+    AsyncArchiveWriter* archiveWriter = nullptr;
+    Lz11::Format archiveFormat;
     Ctpk* ctpk;
 
+    quint64 objectRevision;
+    void objectsChanged();
+
     QImage texImage;
+    QFuture<QImage> texFuture;
+    bool imageLoaded = false;
+    void waitForImage();
+    QImage encodedSource; // straight RGBA image texImage was last encoded from
+
+    // smaller versions of texImage, lod 1 and up, made on first use
+    static const int maxLod = 3;
+    QList<QImage> mipImages;
+    int drawLod = 0;
+
+    // the atlases tiles are drawn from, per lod, made on first use
+    // see AtlasKernels for the layout of the smaller ones
+    QList<QPixmap> atlasPixmaps;
+    const QPixmap& getAtlas(int lod);
+
+    bool batching = false;
+    QList<QPainter::PixmapFragment> batchTiles;
+    QList<QPair<QRect, QPixmap>> batchIcons;
+
+    void drawAtlasTile(QPainter& painter, const QRectF& dst, const QRectF& src);
+    void drawIcon(QPainter& painter, const QRect& dst, const QPixmap& icon);
 
 
     QList<ObjectDef*> objectDefs;
 
 
-    void drawRow(QPainter& painter, TileGrid& grid, ObjectDef& def, ObjectRow& row, int x, int y, int w, float zoom);
+    void expandRow(ObjectDef& def, ObjectRow& row, int x, int y, int w, const TileVisitor& visit);
 
 
     quint8 behaviors[441][8];
@@ -1,5 +1,6 @@
 #include "tileseteditorwindow.h"
 #include "ui_tileseteditorwindow.h"
+#include "game.h"
 
 #include <QDebug>
 #include <QPaintEvent>
@@ -36,7 +37,6 @@ TilesetEditorWindow::TilesetEditorWindow(WindowBase *parent, Tileset *tileset) :
     ui->actionExportImage->setIcon(QIcon(basePath + "export.png"));
     ui->actionImportImage->setIcon(QIcon(basePath + "import.png"));
     ui->actionImportImageWithPadding->setIcon(QIcon(basePath + "import.png"));
-    ui->actionImportImageLegacy->setIcon(QIcon(basePath + "import.png"));
     ui->actionDeleteAllObjects->setIcon(QIcon(basePath + "delete_objects.png"));
     ui->actionDeleteAll3DOverlays->setIcon(QIcon(basePath + "delete_overlays.png"));
     ui->actionDeleteAllBehaviors->setIcon(QIcon(basePath + "delete_behaviors.png"));
@@ -48,6 +48,19 @@ TilesetEditorWindow::TilesetEditorWindow(WindowBase *parent, Tileset *tileset) :
     editStatus = new QLabel(this);
     ui->statusBar->addWidget(editStatus);
 
+    encodeProgress = new QProgressBar(this);
+    encodeProgress->setRange(0, 100);
+    encodeProgress->setMaximumWidth(200);
+    encodeProgress->hide();
+    ui->statusBar->addPermanentWidget(encodeProgress);
+
+    encodeCancel = new QPushButton(tr("Cancel"), this);
+    encodeCancel->hide();
+    ui->statusBar->addPermanentWidget(encodeCancel);
+
+    connect(tileset->getArchiveWriter(), &AsyncArchiveWriter::progress, this, &TilesetEditorWindow::archiveWriteProgress);
+    connect(tileset->getArchiveWriter(), &AsyncArchiveWriter::finished, this, &TilesetEditorWindow::archiveWriteFinished);
+
     // Setup Behaviors Editor
     tilesetPicker = new TilesetPicker(tileset, this);
 
@@ -1014,21 +1027,7 @@ void TilesetEditorWindow::on_actionExportImage_triggered()
     if (!filename.endsWith(".png"))
         filename.append(".png");
 
-    QImage img = QImage(420, 420, tileset->getImage().format());
-    img.fill(QColor(0,0,0,0));
-    QPainter painter;
-    painter.begin(&img);
-
-    for (int x = 0; x < 21; x++)
-    {
-        for (int y = 0; y < 21; y++)
-        {
-            painter.drawImage(x*20, y*20, tileset->getImage(), x*20 + x*4 + 2, y*20 + y*4 + 2, 20, 20, Qt::AutoColor);
-        }
-    }
-
-    painter.end();
-
+    QImage img = Tileset::unpadTilesetImage(tileset->getImage());
     img.save(filename);
 
     editStatus->setText(tr("Image Exported"));
@@ -1036,6 +1035,10 @@ void TilesetEditorWindow::on_actionExportImage_triggered()
 
 void TilesetEditorWindow::importTilesetImage(bool padded)
 {
+    // one import at a time
+    if (imageEncoder)
+        return;
+
     QString pngFileName = QFileDialog::getOpenFileName(this, tr("Import Tileset Image"), QDir::currentPath(), "PNG Files (*.png)");
     if (!pngFileName.endsWith(".png"))
         pngFileName.append(".png");
@@ -1063,175 +1066,51 @@ void TilesetEditorWindow::importTilesetImage(bool padded)
     if (!ok)
         return;
 
-    qApp->processEvents();
+    QImage img = padded ? inputImg : Tileset::padTilesetImage(inputImg);
 
-    if (padded)
-        tileset->setImage(inputImg, quality, dither);
-    else {
-        QImage img = Tileset::padTilesetImage(inputImg);
-        tileset->setImage(img, quality, dither);
-    }
+    // encoding happens in the background, see imageEncodeFinished()
+    imageEncoder = tileset->createImageEncoder(img, quality, dither, this);
+    connect(imageEncoder, &Etc1Encoder::progress, encodeProgress, &QProgressBar::setValue);
+    connect(imageEncoder, &Etc1Encoder::finished, this, &TilesetEditorWindow::imageEncodeFinished);
+    connect(encodeCancel, &QPushButton::clicked, imageEncoder, &Etc1Encoder::cancel);
 
-    tilesetPicker->setTilesetImage(tileset->getImage());
-    setupObjectsModel(true);
-}
+    encodeProgress->setValue(0);
+    encodeProgress->show();
+    encodeCancel->show();
+    editStatus->setText(tr("Encoding tileset image..."));
 
-void TilesetEditorWindow::on_actionImportImage_triggered()
-{
-    importTilesetImage();
-}
-
-void TilesetEditorWindow::on_actionImportImageWithPadding_triggered()
-{
-    importTilesetImage(true);
+    imageEncoder->start();
 }
 
-void TilesetEditorWindow::on_actionImportImageLegacy_triggered()
+void TilesetEditorWindow::imageEncodeFinished(bool success)
 {
-    QString convertDir = settings->dataPath("ts_convert/");
-
-    #ifdef _WIN32
-        if (!QFile(convertDir + "convert.exe").exists())
-        {
-            QMessageBox::warning(this, "CoinKiller", tr("CoinKiller requires convert.exe from ImageMagick to be placed at %1 to convert tileset images!").arg(convertDir));
-            return;
-        }
-    #elif __linux__
-        if (system("command -v convert > /dev/null 2>&1") != 0 && !QFile(convertDir + "convert").exists())
-        {
-            QMessageBox::warning(this, "CoinKiller", tr("CoinKiller requires convert from ImageMagick to be installed to convert tileset images!"));
-            return;
-        }
-        if (system("command -v wine > /dev/null 2>&1") != 0)
-        {
-            QMessageBox::warning(this, "CoinKiller", tr("CoinKiller requires wine to be installed to convert tileset images!"));
-            return;
-        }
-    #else
-        QMessageBox::warning(this, "CoinKiller", tr("Legacy tileset importing is not supported on your operating system!"), QMessageBox::Ok);
-        return;
-    #endif
-
-        if (!QFile(convertDir + "ctr_TexturePackager32.exe").exists())
-        {
-            QMessageBox::warning(this, "CoinKiller",
-                                 tr("CoinKiller requires ctr_TexturePackager32.exe to be placed at %1 to convert tileset images!\n\n"
-                                 "We can not help you finding that file, but the filename should be enough to do some research on your own.").arg(convertDir));
-            return;
-        }
-
-        // Get input Image
-        QString pngFileName = QFileDialog::getOpenFileName(this, tr("Import Tileset Image"), QDir::currentPath(), "PNG Files (*.png)");
-        if (!pngFileName.endsWith(".png"))
-            pngFileName.append(".png");
-        if (pngFileName.isEmpty()) return;
-
-        // Add aligns to image
-        QImage inputImg;
-        if (!inputImg.load(pngFileName))
-            return;
-
-        if (inputImg.width() != 420 || inputImg.height() != 420)
-        {
-            QMessageBox::information(this, " ", tr("The input image is not 420x420 pixels."), QMessageBox::Ok);
-            return;
-        }
-
-        Tileset::padTilesetImage(inputImg).save(convertDir + tileset->getName() + ".png");
-
-        // Get wished Quality
-        QStringList qualities;
-        bool ok;
-        qualities << "Fast" << "Medium" << "Slow" << "Fast Perceptual" << "Medium Perceptual" << "Slow Perceptual" << "Fast Improved" << "Medium Improved";
-        QString quality = QInputDialog::getItem(this, "CoinKiller", tr("Select ETC1 compression quality:"), qualities, 7, false, &ok, Qt::WindowTitleHint);
-        quality.replace(" ", "");
-        if (!ok) return;
-
-        // Convert to TGA
-        QProcess pngToTga;
-    #ifdef _WIN32
-        pngToTga.start(convertDir+"convert.exe", QStringList() << (convertDir+tileset->getName()+".png") << (convertDir+tileset->getName()+".tga"));
-    #elif __linux__
-        pngToTga.start("convert", QStringList() << (convertDir+tileset->getName()+".png") << (convertDir+tileset->getName()+".tga"));
-    #endif
-        while (!pngToTga.waitForFinished()) { QThread::sleep(250); }
-
-        QFile png(convertDir + tileset->getName() + ".png");
-        png.remove();
-
-        // Convert to CTPK
-        QFile pkg(convertDir + "package.xml");
-        if (pkg.open(QIODevice::ReadWrite))
-        {
-           QTextStream stream(&pkg);
-           stream << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>" << Qt::endl
-                  << "<ctr_texturepackager>" << Qt::endl
-                  << "<texture type=\"2D\" miplimit=\"1\" format=\"ETC1_A4\" etcmethod=\"" + quality + "\">" << Qt::endl
-                  << "<imagefile src=\"" << tileset->getName() << ".tga\" />" << Qt::endl
-                  << "</texture>" << Qt::endl
-                  << "</ctr_texturepackager>" << Qt::endl;
-        }
-
-        QMessageBox* msgBox = new QMessageBox(QMessageBox::Information, "CoinKiller",
-                                              "Converting TGA to CTPK. Please wait...\n\n"
-                                              "The converting to CTPK may take up to several minutes depending on the quality you selected!",
-                                              QMessageBox::Cancel, this);
+    encodeProgress->hide();
+    encodeCancel->hide();
 
+    if (success)
+    {
+        tileset->setEncodedImage(imageEncoder);
+        tilesetPicker->setTilesetImage(tileset->getImage());
+        setupObjectsModel(true);
 
-        QProcess tgaToCtpk;
-    #ifdef _WIN32
-        tgaToCtpk.start(convertDir+"ctr_TexturePackager32.exe", QStringList() << "-i" << (convertDir+"package.xml") << "-o" << (convertDir+tileset->getName()+".ctpk"));
-    #elif __linux__
-        tgaToCtpk.setWorkingDirectory(convertDir);
-        tgaToCtpk.start("wine", QStringList() << "ctr_TexturePackager32.exe" << "-i" << (convertDir+"package.xml") << "-o" << (convertDir+tileset->getName()+".ctpk"));
-    #endif
-
-        msgBox->show();
-        isConvertCancelled = false;
-        connect(msgBox, SIGNAL(finished(int)), this, SLOT(convertCancelled()));
-
-        qApp->processEvents();
-
-        bool killed = false;
-        while (!tgaToCtpk.waitForFinished(500))
-        {
-            qApp->processEvents();
-            if (isConvertCancelled)
-            {
-                tgaToCtpk.terminate();
-                killed = true;
-                break;
-            }
-        }
-
-        msgBox->close();
-        delete msgBox;
-
-        QFile tga(convertDir + tileset->getName() + ".tga");
-        tga.remove();
-        pkg.remove();
-
-        if (killed)
-            return;
-
-        if (!QFile(convertDir + tileset->getName() + ".ctpk").exists())
-        {
-            QMessageBox::warning(this, "CoinKiller", tr("Conversion from TGA to CTPK failed!"));
-            return;
-        }
-
-        tileset->replaceCTPK(convertDir + tileset->getName() + ".ctpk");
+        int encoded = imageEncoder->getTotalBlocks() - imageEncoder->getReusedBlocks();
+        editStatus->setText(tr("Tileset image imported (%1 of %2 blocks re-encoded)").arg(encoded).arg(imageEncoder->getTotalBlocks()));
+    }
+    else
+        editStatus->setText(tr("Tileset image import cancelled"));
 
-        QFile ctpk(convertDir + tileset->getName() + ".ctpk");
-        ctpk.remove();
+    imageEncoder->deleteLater();
+    imageEncoder = nullptr;
+}
 
-        tilesetPicker->setTilesetImage(tileset->getImage());
-        setupObjectsModel(true);
+void TilesetEditorWindow::on_actionImportImage_triggered()
+{
+    importTilesetImage();
 }
 
-void TilesetEditorWindow::convertCancelled()
+void TilesetEditorWindow::on_actionImportImageWithPadding_triggered()
 {
-    isConvertCancelled = true;
+    importTilesetImage(true);
 }
 
 void TilesetEditorWindow::on_actionSetBackgroundColor_triggered()
@@ -1247,8 +1126,34 @@ void TilesetEditorWindow::on_actionSetBackgroundColor_triggered()
 
 void TilesetEditorWindow::on_actionSave_triggered()
 {
-    tileset->save();
-    editStatus->setText(tr("Changes Saved"));
+    if (!tileset->save())
+    {
+        editStatus->setText(tr("Save Failed"));
+        return;
+    }
+
+    // the archive is written to disk in the background, see archiveWriteFinished()
+    editStatus->setText(tr("Saving..."));
+}
+
+void TilesetEditorWindow::archiveWriteProgress(int percent)
+{
+    editStatus->setText(tr("Saving... %1%").arg(percent));
+}
+
+void TilesetEditorWindow::archiveWriteFinished(bool success, QString error)
+{
+    if (!success)
+    {
+        editStatus->setText(tr("Save Failed: %1").arg(error));
+        return;
+    }
+
+    // levels opened from now on load the saved tileset
+    tileset->game->invalidateTileset(tileset->getName());
+
+    if (!tileset->getArchiveWriter()->isBusy())
+        editStatus->setText(tr("Changes Saved"));
 }
 
 QWidget* hline()
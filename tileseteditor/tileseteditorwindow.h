@@ -9,11 +9,14 @@
 #include <QLabel>
 #include <QCheckBox>
 #include <QGridLayout>
+#include <QProgressBar>
+#include <QPushButton>
 
 #include "tileset.h"
 #include "tileseteditorwidgets.h"
 #include "settingsmanager.h"
 #include "windowbase.h"
+#include "etc1encoder.h"
 
 namespace Ui {
 class TilesetEditorWindow;
@@ -101,7 +104,6 @@ private slots:
 
     void on_actionImportImageWithPadding_triggered();
 
-    void on_actionImportImageLegacy_triggered();
 
     void on_actionToggleCollision_toggled(bool value);
 
@@ -163,14 +165,19 @@ private:
 
     SettingsManager* settings;
 
-    bool isConvertCancelled;
-
     QLabel* editStatus;
 
+    // image import, encoded in the background
+    Etc1Encoder* imageEncoder = nullptr;
+    QProgressBar* encodeProgress;
+    QPushButton* encodeCancel;
+
     void changeEvent(QEvent* event);
 
 private slots:
-    void convertCancelled();
+    void archiveWriteProgress(int percent);
+    void archiveWriteFinished(bool success, QString error);
+    void imageEncodeFinished(bool success);
 };
 
 class ImportTilesetImageDlg : public QDialog